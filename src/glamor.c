@@ -97,6 +97,8 @@ glamor_set_pixmap_texture(PixmapPtr pixmap, unsigned int tex)
     glamor_priv = glamor_get_screen_private(screen);
     pixmap_priv = glamor_get_pixmap_private(pixmap);
 
+    glamor_text_flush_pixmap(pixmap);
+
     if (pixmap_priv->fbo) {
         fbo = glamor_pixmap_detach_fbo(pixmap_priv);
         glamor_destroy_fbo(glamor_priv, fbo);
@@ -257,6 +259,7 @@ glamor_block_handler(ScreenPtr screen)
     glamor_screen_private *glamor_priv = glamor_get_screen_private(screen);
 
     glamor_make_current(glamor_priv);
+    glamor_composite_glyphs_upload(screen);
     glFlush();
 }
 
@@ -266,6 +269,7 @@ _glamor_block_handler(ScreenPtr screen, void *timeout)
     glamor_screen_private *glamor_priv = glamor_get_screen_private(screen);
 
     glamor_make_current(glamor_priv);
+    glamor_composite_glyphs_upload(screen);
     glFlush();
 
     screen->BlockHandler = glamor_priv->saved_procs.block_handler;
@@ -549,8 +553,11 @@ glamor_init(ScreenPtr screen, unsigned int flags)
          * or 1.30 currently.  1.30's new features are also present in
          * ES 3.0, but our glamor_program.c constructions use a lot of
          * compatibility features (to reduce the diff between 1.20 and
-         * 1.30 programs).
+         * 1.30 programs).  The few that want 1.30 anyway are
+         * translated to ESSL 3.00 when the context has it.
          */
+        glamor_priv->has_glsl_es3 =
+            gl_version >= 30 && glamor_priv->glsl_version >= 300;
         glamor_priv->glsl_version = 120;
     }
 
@@ -595,7 +602,8 @@ glamor_init(ScreenPtr screen, unsigned int flags)
     glamor_priv->has_pack_invert =
         epoxy_has_gl_extension("GL_MESA_pack_invert");
     glamor_priv->has_fbo_blit =
-        epoxy_has_gl_extension("GL_EXT_framebuffer_blit");
+        epoxy_has_gl_extension("GL_EXT_framebuffer_blit") ||
+        gl_version >= 30;
     glamor_priv->has_map_buffer_range =
         epoxy_has_gl_extension("GL_ARB_map_buffer_range") ||
         epoxy_has_gl_extension("GL_EXT_map_buffer_range");
@@ -603,6 +611,23 @@ glamor_init(ScreenPtr screen, unsigned int flags)
         epoxy_has_gl_extension("GL_ARB_buffer_storage");
     glamor_priv->has_nv_texture_barrier =
         epoxy_has_gl_extension("GL_NV_texture_barrier");
+    if (glamor_priv->gl_flavor == GLAMOR_GL_ES2) {
+        if (epoxy_has_gl_extension("GL_EXT_shader_framebuffer_fetch")) {
+            glamor_priv->fb_fetch_header =
+                "#extension GL_EXT_shader_framebuffer_fetch : require\n"
+                "#define LAST_FRAG_COLOR gl_LastFragData[0]\n";
+            /* ESSL 3.00 reads the inout fragment output instead */
+            glamor_priv->fb_fetch_es3_header =
+                "#extension GL_EXT_shader_framebuffer_fetch : require\n"
+                "#define FRAG_COLOR_INOUT\n"
+                "#define LAST_FRAG_COLOR frag_color\n";
+        } else if (epoxy_has_gl_extension("GL_ARM_shader_framebuffer_fetch")) {
+            glamor_priv->fb_fetch_header =
+                "#extension GL_ARM_shader_framebuffer_fetch : require\n"
+                "#define LAST_FRAG_COLOR gl_LastFragColorARM\n";
+            glamor_priv->fb_fetch_es3_header = glamor_priv->fb_fetch_header;
+        }
+    }
     glamor_priv->has_unpack_subimage =
         glamor_priv->gl_flavor == GLAMOR_GL_DESKTOP ||
         epoxy_gl_version() >= 30 ||
@@ -644,6 +669,26 @@ glamor_init(ScreenPtr screen, unsigned int flags)
     glamor_priv->max_fbo_size = MAX_FBO_SIZE;
 #endif
 
+    {
+        GLint max_uniform_vectors;
+
+        if (glamor_priv->gl_flavor == GLAMOR_GL_ES2) {
+            glGetIntegerv(GL_MAX_FRAGMENT_UNIFORM_VECTORS,
+                          &max_uniform_vectors);
+        } else {
+            glGetIntegerv(GL_MAX_FRAGMENT_UNIFORM_COMPONENTS,
+                          &max_uniform_vectors);
+            max_uniform_vectors /= 4;
+        }
+        /* Leave room for the other composite uniforms; weights may
+         * each take up a whole vector.
+         */
+        glamor_priv->convolution_max_taps =
+            MIN(GLAMOR_CONVOLUTION_MAX_TAPS, max_uniform_vectors - 16);
+        if (glamor_priv->convolution_max_taps < 9)
+            glamor_priv->convolution_max_taps = 0;
+    }
+
     glamor_priv->has_texture_swizzle =
         (epoxy_has_gl_extension("GL_ARB_texture_swizzle") ||
          (glamor_priv->gl_flavor != GLAMOR_GL_DESKTOP && gl_version >= 30));
@@ -711,6 +756,12 @@ glamor_init(ScreenPtr screen, unsigned int flags)
     glamor_priv->saved_procs.glyphs = ps->Glyphs;
     ps->Glyphs = glamor_composite_glyphs;
 
+    glamor_priv->saved_procs.realize_glyph = ps->RealizeGlyph;
+    ps->RealizeGlyph = glamor_realize_glyph;
+
+    glamor_priv->saved_procs.unrealize_glyph = ps->UnrealizeGlyph;
+    ps->UnrealizeGlyph = glamor_unrealize_glyph;
+
     glamor_init_vbo(screen);
 
 #ifdef GLAMOR_GRADIENT_SHADER
@@ -756,7 +807,12 @@ glamor_close_screen(ScreenPtr screen)
 
     glamor_priv = glamor_get_screen_private(screen);
     glamor_sync_close(screen);
+    glamor_text_fini(screen);
     glamor_composite_glyphs_fini(screen);
+    glamor_fini_composite(screen);
+#ifdef GLAMOR_GRADIENT_SHADER
+    glamor_fini_gradient_shader(screen);
+#endif
     screen->CloseScreen = glamor_priv->saved_procs.close_screen;
     screen->CreateScreenResources =
         glamor_priv->saved_procs.create_screen_resources;
@@ -776,6 +832,8 @@ glamor_close_screen(ScreenPtr screen)
     ps->Triangles = glamor_priv->saved_procs.triangles;
     ps->CompositeRects = glamor_priv->saved_procs.composite_rects;
     ps->Glyphs = glamor_priv->saved_procs.glyphs;
+    ps->RealizeGlyph = glamor_priv->saved_procs.realize_glyph;
+    ps->UnrealizeGlyph = glamor_priv->saved_procs.unrealize_glyph;
 
     screen_pixmap = screen->GetScreenPixmap(screen);
     glamor_pixmap_destroy_fbo(screen_pixmap);
@@ -28,11 +28,69 @@
 
 #include "glamor_priv.h"
 
+/**
+ * Adds the traps to an a8 picture on the GPU, reusing the trapezoid
+ * coverage shader.
+ */
+static Bool
+glamor_add_traps_gl(PicturePtr pPicture,
+                    INT16 x_off,
+                    INT16 y_off, int ntrap, xTrap *traps)
+{
+    xTrapezoid stack_traps[64], *trapezoids = stack_traps;
+    PixmapPtr pixmap;
+    Bool ret;
+    int n;
+
+    if (!pPicture->pDrawable ||
+        pPicture->pDrawable->type != DRAWABLE_PIXMAP ||
+        pPicture->format != PICT_a8 || pPicture->alphaMap)
+        return FALSE;
+
+    pixmap = glamor_get_drawable_pixmap(pPicture->pDrawable);
+    if (!GLAMOR_PIXMAP_PRIV_HAS_FBO(glamor_get_pixmap_private(pixmap)))
+        return FALSE;
+
+    if (ntrap > ARRAY_SIZE(stack_traps)) {
+        trapezoids = xallocarray(ntrap, sizeof(xTrapezoid));
+        if (!trapezoids)
+            return FALSE;
+    }
+
+    for (n = 0; n < ntrap; n++) {
+        xTrap *t = &traps[n];
+
+        trapezoids[n].top = t->top.y;
+        trapezoids[n].bottom = t->bot.y;
+        trapezoids[n].left.p1.x = t->top.l;
+        trapezoids[n].left.p1.y = t->top.y;
+        trapezoids[n].left.p2.x = t->bot.l;
+        trapezoids[n].left.p2.y = t->bot.y;
+        trapezoids[n].right.p1.x = t->top.r;
+        trapezoids[n].right.p1.y = t->top.y;
+        trapezoids[n].right.p2.x = t->bot.r;
+        trapezoids[n].right.p2.y = t->bot.y;
+    }
+
+    ret = glamor_rasterize_trapezoids(pixmap, FALSE, x_off, y_off,
+                                      ntrap, trapezoids);
+
+    if (trapezoids != stack_traps)
+        free(trapezoids);
+    return ret;
+}
+
 void
 glamor_add_traps(PicturePtr pPicture,
                  INT16 x_off,
                  INT16 y_off, int ntrap, xTrap *traps)
 {
+    if (ntrap <= 0)
+        return;
+
+    if (glamor_add_traps_gl(pPicture, x_off, y_off, ntrap, traps))
+        return;
+
     if (glamor_prepare_access_picture(pPicture, GLAMOR_ACCESS_RW)) {
         fbAddTraps(pPicture, x_off, y_off, ntrap, traps);
     }
@@ -30,168 +30,690 @@
 
 #define DEFAULT_ATLAS_DIM       1024
 
+/* Each atlas format gets up to GLAMOR_GLYPH_ATLAS_PAGES pages, each
+ * split into GLAMOR_GLYPH_ATLAS_BANDS horizontal bands. Glyphs are
+ * packed into a band with a skyline allocator; when every page is
+ * allocated and nothing fits, the least recently used band is emptied,
+ * leaving glyphs elsewhere in the atlas resident.
+ *
+ * With GLSL 1.30 or GLES 3 the pages are layers of one
+ * GL_TEXTURE_2D_ARRAY, so a single draw covers the whole atlas. Glyphs larger than a band then go
+ * on pages split into GLAMOR_GLYPH_ATLAS_LARGE_BANDS taller bands.
+ * Otherwise each page is a separate pixmap.
+ */
+#define GLAMOR_GLYPH_ATLAS_PAGES        4
+#define GLAMOR_GLYPH_ATLAS_BANDS        8
+#define GLAMOR_GLYPH_ATLAS_LARGE_BANDS  2
+#define GLAMOR_GLYPH_SKYLINE_NODES      128
+
+/* Newly cached glyphs are copied into a CPU-side copy of their band,
+ * and each band touched since the last flush is sent to the atlas with
+ * one glTexSubImage2D of its dirty rectangle just before drawing.
+ */
+
+/* Glyphs are shared by all screens, so each glyph points at an array
+ * holding one private per screen, the way fonts do. The array records
+ * its own length, as screens may be added after it was allocated.
+ */
 static DevPrivateKeyRec        glamor_glyph_private_key;
 
 struct glamor_glyph_private {
+    int16_t             x;
+    int16_t             y;
+    uint16_t            band;
+    uint32_t            serial;
+    Bool                realized;
+    struct xorg_list    pending;
+    GlyphPtr            glyph;
+    PixmapPtr           texture;
+};
+
+struct glamor_glyph_privates {
+    int                         nscreen;
+    struct glamor_glyph_private screen[];
+};
+
+struct glamor_glyph_skyline {
     int16_t     x;
     int16_t     y;
-    uint32_t    serial;
+    int16_t     width;
+};
+
+struct glamor_glyph_band {
+    uint32_t                    serial;
+    uint32_t                    last_use;
+    int16_t                     y;
+    int16_t                     height;
+    int                         nglyph;
+    int                         nnode;
+    struct glamor_glyph_skyline node[GLAMOR_GLYPH_SKYLINE_NODES];
+    uint8_t                     *bits;
+    BoxRec                      dirty;
 };
 
 struct glamor_glyph_atlas {
-    PixmapPtr           atlas;
-    PictFormatPtr       format;
-    int                 x, y;
-    int                 row_height;
-    int                 nglyph;
-    uint32_t            serial;
+    PixmapPtr                   page[GLAMOR_GLYPH_ATLAS_PAGES];
+    GLuint                      array_tex;
+    int                         nlayer;
+    int                         npage;
+    Bool                        large[GLAMOR_GLYPH_ATLAS_PAGES];
+    PictFormatPtr               format;
+    uint32_t                    use;
+    struct glamor_glyph_band    band[GLAMOR_GLYPH_ATLAS_PAGES * GLAMOR_GLYPH_ATLAS_BANDS];
+    int                         ndirty;
+    uint16_t                    dirty[GLAMOR_GLYPH_ATLAS_PAGES * GLAMOR_GLYPH_ATLAS_BANDS];
 };
 
-static inline struct glamor_glyph_private *glamor_get_glyph_private(PixmapPtr pixmap) {
-    return dixLookupPrivate(&pixmap->devPrivates, &glamor_glyph_private_key);
+/* Each a1 source byte expanded to eight a8 pixels */
+static uint8_t glamor_glyph_a1_to_a8[256][8];
+
+/* Band serials come from a single counter so that a glyph private,
+ * which is shared by both atlases of a screen, never matches a band it
+ * was not placed in.
+ */
+static uint32_t                glamor_glyph_serial;
+
+/* NULL if the glyph was never realized on this screen */
+static inline struct glamor_glyph_private *
+glamor_get_glyph_private(ScreenPtr screen, GlyphPtr glyph) {
+    struct glamor_glyph_privates *privates =
+        dixLookupPrivate(&glyph->devPrivates, &glamor_glyph_private_key);
+
+    if (!privates || screen->myNum >= privates->nscreen)
+        return NULL;
+    return &privates->screen[screen->myNum];
+}
+
+/* Texture arrays and instancing come with GLSL 1.30 or GLES 3 */
+static inline Bool
+glamor_glyph_use_130(glamor_screen_private *glamor_priv) {
+    return glamor_priv->glsl_version >= 130 || glamor_priv->has_glsl_es3;
 }
 
-static inline void
-glamor_copy_glyph(PixmapPtr     glyph_pixmap,
-                  DrawablePtr   atlas_draw,
-                  int16_t x,
-                  int16_t y)
+static inline int
+glamor_glyph_band_dim(glamor_screen_private *glamor_priv) {
+    return glamor_priv->glyph_atlas_dim / GLAMOR_GLYPH_ATLAS_BANDS;
+}
+
+static inline Bool
+glamor_glyph_is_large(glamor_screen_private *glamor_priv, DrawablePtr glyph_draw) {
+    return glyph_draw->width > glamor_glyph_band_dim(glamor_priv) ||
+        glyph_draw->height > glamor_glyph_band_dim(glamor_priv);
+}
+
+static void
+glamor_glyph_init_a1_to_a8(void)
+{
+    int byte, bit;
+
+    for (byte = 0; byte < 256; byte++) {
+        for (bit = 0; bit < 8; bit++) {
+#if BITMAP_BIT_ORDER == MSBFirst
+            int mask = 0x80 >> bit;
+#else
+            int mask = 1 << bit;
+#endif
+            glamor_glyph_a1_to_a8[byte][bit] = (byte & mask) ? 0xff : 0x00;
+        }
+    }
+}
+
+/*
+ * Convert one glyph into a band copy. Bitmaps are expanded a
+ * byte at a time through the lookup table, which also gives the
+ * 0xff/0x00 values that CopyPlane used to produce.
+ */
+static void
+glamor_glyph_stage_bits(PixmapPtr glyph_pixmap, uint8_t *dst, int dst_stride,
+                        int cpp)
 {
     DrawablePtr glyph_draw = &glyph_pixmap->drawable;
-    BoxRec      box = {
-        .x1 = 0,
-        .y1 = 0,
-        .x2 = glyph_draw->width,
-        .y2 = glyph_draw->height,
-    };
-    PixmapPtr upload_pixmap = glyph_pixmap;
-
-    if (glyph_pixmap->drawable.bitsPerPixel != atlas_draw->bitsPerPixel) {
-
-        /* If we're dealing with 1-bit glyphs, we copy them to a
-         * temporary 8-bit pixmap and upload them from there, since
-         * that's what GL can handle.
-         */
-        ScreenPtr       screen = atlas_draw->pScreen;
-        GCPtr           scratch_gc;
-        ChangeGCVal     changes[2];
-
-        upload_pixmap = glamor_create_pixmap(screen,
-                                             glyph_draw->width,
-                                             glyph_draw->height,
-                                             atlas_draw->depth,
-                                             GLAMOR_CREATE_PIXMAP_CPU);
-        if (!upload_pixmap)
-            return;
-
-        scratch_gc = GetScratchGC(upload_pixmap->drawable.depth, screen);
-        if (!scratch_gc) {
-            glamor_destroy_pixmap(upload_pixmap);
-            return;
+    uint8_t     *src = glyph_pixmap->devPrivate.ptr;
+    int         w = glyph_draw->width;
+    int         h = glyph_draw->height;
+
+    if (glyph_draw->bitsPerPixel == 1) {
+        while (h--) {
+            uint8_t *s = src;
+            uint8_t *d = dst;
+            int     x;
+
+            for (x = 0; x + 8 <= w; x += 8, d += 8)
+                memcpy(d, glamor_glyph_a1_to_a8[*s++], 8);
+            if (x < w)
+                memcpy(d, glamor_glyph_a1_to_a8[*s], w - x);
+            src += glyph_pixmap->devKind;
+            dst += dst_stride;
         }
-        changes[0].val = 0xff;
-        changes[1].val = 0x00;
-        if (ChangeGC(NullClient, scratch_gc,
-                     GCForeground|GCBackground, changes) != Success) {
-            glamor_destroy_pixmap(upload_pixmap);
-            FreeScratchGC(scratch_gc);
-            return;
+    } else {
+        while (h--) {
+            memcpy(dst, src, w * cpp);
+            src += glyph_pixmap->devKind;
+            dst += dst_stride;
+        }
+    }
+}
+
+/*
+ * Write a w x h block of pixels to an atlas page. The caller sets up
+ * the unpack state.
+ */
+static void
+glamor_glyph_upload(ScreenPtr screen, struct glamor_glyph_atlas *atlas,
+                    int p, int x, int y, int w, int h, uint8_t *bits)
+{
+    glamor_screen_private       *glamor_priv = glamor_get_screen_private(screen);
+    GLenum                      format, type = GL_UNSIGNED_BYTE;
+
+    if (glamor_glyph_use_130(glamor_priv)) {
+        format = atlas->format->depth == 32 ? GL_BGRA : glamor_priv->one_channel_format;
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, atlas->array_tex);
+        glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, x, y, p, w, h, 1,
+                        format, type, bits);
+    } else {
+        PixmapPtr               page = atlas->page[p];
+        glamor_pixmap_fbo       *fbo = glamor_pixmap_fbo_at(glamor_get_pixmap_private(page), 0);
+
+        glamor_format_for_pixmap(page, &format, &type);
+        glamor_bind_texture(glamor_priv, GL_TEXTURE0, fbo, TRUE);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, x, y, w, h, format, type, bits);
+    }
+}
+
+/*
+ * Send the dirty rectangle of each band staged since the last flush to
+ * its atlas page. A band's copy holds every glyph placed in it, so the
+ * whole rectangle can be sent even though it spans glyphs that were
+ * already uploaded. Without GL_UNPACK_ROW_LENGTH, whole rows of the
+ * band are sent instead.
+ */
+static void
+glamor_glyph_stage_flush(ScreenPtr screen, struct glamor_glyph_atlas *atlas)
+{
+    glamor_screen_private       *glamor_priv = glamor_get_screen_private(screen);
+    int                         dim = glamor_priv->glyph_atlas_dim;
+    int                         cpp = atlas->format->depth == 32 ? 4 : 1;
+    int                         i;
+
+    if (!atlas->ndirty)
+        return;
+
+    glamor_make_current(glamor_priv);
+
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    if (glamor_priv->has_unpack_subimage)
+        glPixelStorei(GL_UNPACK_ROW_LENGTH, dim);
+
+    for (i = 0; i < atlas->ndirty; i++) {
+        int                     b = atlas->dirty[i];
+        struct glamor_glyph_band *band = &atlas->band[b];
+        BoxRec                  dirty = band->dirty;
+
+        if (dirty.x1 >= dirty.x2)
+            continue;
+
+        if (!glamor_priv->has_unpack_subimage) {
+            dirty.x1 = 0;
+            dirty.x2 = dim;
         }
-        ValidateGC(&upload_pixmap->drawable, scratch_gc);
 
-        (*scratch_gc->ops->CopyPlane)(glyph_draw,
-                                      &upload_pixmap->drawable,
-                                      scratch_gc,
-                                      0, 0,
-                                      glyph_draw->width,
-                                      glyph_draw->height,
-                                      0, 0, 0x1);
+        glamor_glyph_upload(screen, atlas, b / GLAMOR_GLYPH_ATLAS_BANDS,
+                            dirty.x1, band->y + dirty.y1,
+                            dirty.x2 - dirty.x1, dirty.y2 - dirty.y1,
+                            band->bits + ((size_t) dirty.y1 * dim + dirty.x1) * cpp);
+        band->dirty.x1 = band->dirty.x2 = 0;
     }
-    glamor_upload_boxes((PixmapPtr) atlas_draw,
-                        &box, 1,
-                        0, 0,
-                        x, y,
-                        upload_pixmap->devPrivate.ptr,
-                        upload_pixmap->devKind);
 
-    if (upload_pixmap != glyph_pixmap)
-        glamor_destroy_pixmap(upload_pixmap);
+    if (glamor_priv->has_unpack_subimage)
+        glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+    atlas->ndirty = 0;
 }
 
+/*
+ * Glyphs on large pages are rare enough to go straight to the atlas,
+ * after any staged bands, which may still cover a page that has since
+ * been split into large bands.
+ */
 static Bool
-glamor_glyph_atlas_init(ScreenPtr screen, struct glamor_glyph_atlas *atlas)
+glamor_glyph_upload_large(ScreenPtr screen, struct glamor_glyph_atlas *atlas,
+                          PixmapPtr glyph_pixmap, int p, int16_t x, int16_t y)
+{
+    DrawablePtr                 glyph_draw = &glyph_pixmap->drawable;
+    int                         cpp = atlas->format->depth == 32 ? 4 : 1;
+    uint8_t                     *bits;
+
+    bits = xallocarray(glyph_draw->height, glyph_draw->width * cpp);
+    if (!bits)
+        return FALSE;
+
+    glamor_glyph_stage_flush(screen, atlas);
+    glamor_glyph_stage_bits(glyph_pixmap, bits, glyph_draw->width * cpp, cpp);
+
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glamor_glyph_upload(screen, atlas, p, x, y,
+                        glyph_draw->width, glyph_draw->height, bits);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+    free(bits);
+    return TRUE;
+}
+
+/*
+ * Copy a glyph into the copy of band b, at page coordinates x, y, and
+ * grow the band's dirty rectangle over it.
+ */
+static Bool
+glamor_glyph_stage(ScreenPtr screen, struct glamor_glyph_atlas *atlas,
+                   PixmapPtr glyph_pixmap, int b, int16_t x, int16_t y)
 {
     glamor_screen_private       *glamor_priv = glamor_get_screen_private(screen);
-    PictFormatPtr               format = atlas->format;
+    int                         dim = glamor_priv->glyph_atlas_dim;
+    int                         cpp = atlas->format->depth == 32 ? 4 : 1;
+    DrawablePtr                 glyph_draw = &glyph_pixmap->drawable;
+    struct glamor_glyph_band    *band = &atlas->band[b];
+    int                         p = b / GLAMOR_GLYPH_ATLAS_BANDS;
+
+    if (atlas->large[p])
+        return glamor_glyph_upload_large(screen, atlas, glyph_pixmap, p, x, y);
+
+    if (!band->bits) {
+        band->bits = calloc((size_t) dim * glamor_glyph_band_dim(glamor_priv), cpp);
+        if (!band->bits)
+            return FALSE;
+    }
 
-    atlas->atlas = glamor_create_pixmap(screen, glamor_priv->glyph_atlas_dim,
-                                        glamor_priv->glyph_atlas_dim, format->depth,
-                                        GLAMOR_CREATE_FBO_NO_FBO);
-    if (!glamor_pixmap_has_fbo(atlas->atlas)) {
-        glamor_destroy_pixmap(atlas->atlas);
-        atlas->atlas = NULL;
-    }
-    atlas->x = 0;
-    atlas->y = 0;
-    atlas->row_height = 0;
-    atlas->serial++;
-    atlas->nglyph = 0;
+    y -= band->y;
+    glamor_glyph_stage_bits(glyph_pixmap,
+                            band->bits + ((size_t) y * dim + x) * cpp,
+                            dim * cpp, cpp);
+
+    if (band->dirty.x1 >= band->dirty.x2) {
+        band->dirty.x1 = x;
+        band->dirty.y1 = y;
+        band->dirty.x2 = x + glyph_draw->width;
+        band->dirty.y2 = y + glyph_draw->height;
+        atlas->dirty[atlas->ndirty++] = b;
+    } else {
+        band->dirty.x1 = min(band->dirty.x1, x);
+        band->dirty.y1 = min(band->dirty.y1, y);
+        band->dirty.x2 = max(band->dirty.x2, x + glyph_draw->width);
+        band->dirty.y2 = max(band->dirty.y2, y + glyph_draw->height);
+    }
     return TRUE;
 }
 
+static void
+glamor_glyph_band_reset(struct glamor_glyph_band *band, int dim)
+{
+    band->serial = ++glamor_glyph_serial;
+    band->last_use = 0;
+    band->nglyph = 0;
+    band->nnode = 1;
+    band->node[0].x = 0;
+    band->node[0].y = 0;
+    band->node[0].width = dim;
+}
+
+/*
+ * The texture array starts out with one layer and doubles whenever
+ * every layer holds a page. Layers can't be copied over on GLES, where
+ * the a8 format isn't renderable, so growing forgets every glyph in the
+ * atlas and must wait until nothing queued still refers to them.
+ */
 static Bool
-glamor_glyph_can_add(struct glamor_glyph_atlas *atlas, int dim, DrawablePtr glyph_draw)
+glamor_glyph_array_grow(ScreenPtr screen, struct glamor_glyph_atlas *atlas)
 {
-    /* Step down */
-    if (atlas->x + glyph_draw->width > dim) {
-        atlas->x = 0;
-        atlas->y += atlas->row_height;
-        atlas->row_height = 0;
+    glamor_screen_private       *glamor_priv = glamor_get_screen_private(screen);
+    int                         dim = glamor_priv->glyph_atlas_dim;
+    int                         nlayer = atlas->nlayer ? atlas->nlayer * 2 : 1;
+    GLenum                      format, internal;
+    GLuint                      tex;
+    int                         b;
+
+    nlayer = min(nlayer, GLAMOR_GLYPH_ATLAS_PAGES);
+
+    glamor_make_current(glamor_priv);
+
+    if (atlas->format->depth == 32) {
+        format = GL_BGRA;
+        internal = glamor_priv->gl_flavor == GLAMOR_GL_ES2 ? GL_BGRA : GL_RGBA;
+    } else {
+        format = internal = glamor_priv->one_channel_format;
     }
 
-    /* Check for overfull */
-    if (atlas->y + glyph_draw->height > dim)
+    glGenTextures(1, &tex);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, tex);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    if (format == GL_RED) {
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_SWIZZLE_R, GL_ZERO);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_SWIZZLE_A, GL_RED);
+    }
+
+    glamor_priv->suppress_gl_out_of_memory_logging = true;
+    glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, internal, dim, dim, nlayer, 0,
+                 format, GL_UNSIGNED_BYTE, NULL);
+    glamor_priv->suppress_gl_out_of_memory_logging = false;
+
+    if (glGetError() == GL_OUT_OF_MEMORY) {
+        glDeleteTextures(1, &tex);
         return FALSE;
+    }
 
+    if (atlas->array_tex)
+        glDeleteTextures(1, &atlas->array_tex);
+    atlas->array_tex = tex;
+    atlas->nlayer = nlayer;
+
+    atlas->ndirty = 0;
+    atlas->npage = 0;
+    for (b = 0; b < ARRAY_SIZE(atlas->band); b++) {
+        glamor_glyph_band_reset(&atlas->band[b], dim);
+        atlas->band[b].height = 0;
+        atlas->band[b].dirty.x1 = atlas->band[b].dirty.x2 = 0;
+    }
     return TRUE;
 }
 
+/* Split page p into bands for normal or large glyphs */
+static void
+glamor_glyph_page_bands(glamor_screen_private *glamor_priv,
+                        struct glamor_glyph_atlas *atlas, int p, Bool large)
+{
+    int nband = large ? GLAMOR_GLYPH_ATLAS_LARGE_BANDS : GLAMOR_GLYPH_ATLAS_BANDS;
+    int b;
+
+    for (b = 0; b < GLAMOR_GLYPH_ATLAS_BANDS; b++) {
+        struct glamor_glyph_band *band = &atlas->band[p * GLAMOR_GLYPH_ATLAS_BANDS + b];
+
+        glamor_glyph_band_reset(band, glamor_priv->glyph_atlas_dim);
+        if (b < nband) {
+            band->height = glamor_priv->glyph_atlas_dim / nband;
+            band->y = b * band->height;
+        } else {
+            band->height = 0;
+            band->y = 0;
+        }
+    }
+    atlas->large[p] = large;
+}
+
+/*
+ * Add a page, returning its index or -1. Growing the texture array is
+ * only allowed with lru_ok, once no queued glyph refers to the atlas.
+ */
+static int
+glamor_glyph_page_init(ScreenPtr screen, struct glamor_glyph_atlas *atlas,
+                       Bool large, Bool lru_ok)
+{
+    glamor_screen_private       *glamor_priv = glamor_get_screen_private(screen);
+    PictFormatPtr               format = atlas->format;
+    int                         p = atlas->npage;
+
+    if (p == GLAMOR_GLYPH_ATLAS_PAGES)
+        return -1;
+
+    if (glamor_glyph_use_130(glamor_priv)) {
+        if (p == atlas->nlayer) {
+            if (atlas->nlayer && !lru_ok)
+                return -1;
+            if (!glamor_glyph_array_grow(screen, atlas))
+                return -1;
+            p = 0;
+        }
+    } else {
+        atlas->page[p] = glamor_create_pixmap(screen, glamor_priv->glyph_atlas_dim,
+                                              glamor_priv->glyph_atlas_dim, format->depth,
+                                              GLAMOR_CREATE_FBO_NO_FBO);
+        if (!atlas->page[p])
+            return -1;
+        if (!glamor_pixmap_has_fbo(atlas->page[p])) {
+            glamor_destroy_pixmap(atlas->page[p]);
+            atlas->page[p] = NULL;
+            return -1;
+        }
+    }
+
+    glamor_glyph_page_bands(glamor_priv, atlas, p, large);
+    atlas->npage++;
+    return p;
+}
+
+static inline Bool
+glamor_glyph_cached(struct glamor_glyph_atlas *atlas,
+                    struct glamor_glyph_private *glyph_priv)
+{
+    return glyph_priv->serial &&
+        atlas->band[glyph_priv->band].serial == glyph_priv->serial;
+}
+
+/*
+ * Bottom-left skyline placement of a w x h glyph within a band that is
+ * dim pixels wide. Returns the position in band-relative coordinates.
+ */
 static Bool
-glamor_glyph_add(struct glamor_glyph_atlas *atlas, DrawablePtr glyph_draw)
+glamor_glyph_band_alloc(struct glamor_glyph_band *band, int dim,
+                        int w, int h, int16_t *x, int16_t *y)
 {
-    PixmapPtr                   glyph_pixmap = (PixmapPtr) glyph_draw;
-    struct glamor_glyph_private *glyph_priv = glamor_get_glyph_private(glyph_pixmap);
+    struct glamor_glyph_skyline *node = band->node;
+    int height = band->height;
+    int best = -1, best_y = height, best_waste = 0;
+    int i, j;
+
+    if (band->nnode == GLAMOR_GLYPH_SKYLINE_NODES)
+        return FALSE;
+
+    for (i = 0; i < band->nnode; i++) {
+        int top = 0, waste = 0, left = w;
+
+        if (node[i].x + w > dim)
+            break;
 
-    glamor_copy_glyph(glyph_pixmap, &atlas->atlas->drawable, atlas->x, atlas->y);
+        for (j = i; left > 0; j++) {
+            if (node[j].y > top)
+                top = node[j].y;
+            left -= node[j].width;
+        }
+        if (top + h > height)
+            continue;
+
+        for (j = i, left = w; left > 0; j++) {
+            waste += (top - node[j].y) * min(left, node[j].width);
+            left -= node[j].width;
+        }
+
+        if (top < best_y || (top == best_y && waste < best_waste)) {
+            best = i;
+            best_y = top;
+            best_waste = waste;
+        }
+    }
+
+    if (best < 0)
+        return FALSE;
+
+    *x = node[best].x;
+    *y = best_y;
+
+    /* Insert the new segment and trim the ones it covers */
+    memmove(&node[best + 1], &node[best],
+            (band->nnode - best) * sizeof (node[0]));
+    band->nnode++;
+    node[best].y = best_y + h;
+    node[best].width = w;
+
+    for (i = best + 1; i < band->nnode; i++) {
+        int shrink = node[i - 1].x + node[i - 1].width - node[i].x;
+
+        if (shrink <= 0)
+            break;
+        node[i].x += shrink;
+        node[i].width -= shrink;
+        if (node[i].width > 0)
+            break;
+        memmove(&node[i], &node[i + 1],
+                (band->nnode - i - 1) * sizeof (node[0]));
+        band->nnode--;
+        i--;
+    }
+
+    /* Merge neighbours left at the same height */
+    for (i = 0; i < band->nnode - 1; i++) {
+        if (node[i].y == node[i + 1].y) {
+            node[i].width += node[i + 1].width;
+            memmove(&node[i + 1], &node[i + 2],
+                    (band->nnode - i - 2) * sizeof (node[0]));
+            band->nnode--;
+            i--;
+        }
+    }
+    return TRUE;
+}
+
+/*
+ * Find room for the glyph in any band of an existing page of the
+ * right size
+ */
+static Bool
+glamor_glyph_can_add(struct glamor_glyph_atlas *atlas, int dim, Bool large,
+                     DrawablePtr glyph_draw, int *b, int16_t *x, int16_t *y)
+{
+    int p, i;
+
+    for (p = 0; p < atlas->npage; p++) {
+        if (atlas->large[p] != large)
+            continue;
+        for (i = 0; i < GLAMOR_GLYPH_ATLAS_BANDS; i++) {
+            *b = p * GLAMOR_GLYPH_ATLAS_BANDS + i;
+            if (glamor_glyph_band_alloc(&atlas->band[*b], dim,
+                                        glyph_draw->width, glyph_draw->height,
+                                        x, y))
+                return TRUE;
+        }
+    }
+    return FALSE;
+}
+
+/*
+ * Make an empty band available, either on a fresh page or, when lru_ok is
+ * set, by evicting the least recently used band. A page of the other
+ * glyph size that has gone unused for longer is switched over instead,
+ * so that neither size can starve the other. Any glyphs queued against
+ * the atlas must have been drawn before evicting.
+ */
+static int
+glamor_glyph_evict(ScreenPtr screen, struct glamor_glyph_atlas *atlas,
+                   Bool large, Bool lru_ok)
+{
+    glamor_screen_private       *glamor_priv = glamor_get_screen_private(screen);
+    int                         b, p, lru = -1, lru_page = -1;
+    uint32_t                    lru_page_use = 0;
+
+    p = glamor_glyph_page_init(screen, atlas, large, lru_ok);
+    if (p >= 0)
+        return p * GLAMOR_GLYPH_ATLAS_BANDS;
+
+    if (!lru_ok)
+        return -1;
+
+    glamor_glyph_stage_flush(screen, atlas);
+
+    for (b = 0; b < atlas->npage * GLAMOR_GLYPH_ATLAS_BANDS; b++) {
+        if (atlas->large[b / GLAMOR_GLYPH_ATLAS_BANDS] != large ||
+            !atlas->band[b].height)
+            continue;
+        if (lru < 0 || atlas->band[b].last_use < atlas->band[lru].last_use)
+            lru = b;
+    }
+
+    for (p = 0; p < atlas->npage; p++) {
+        uint32_t use = 0;
+
+        if (atlas->large[p] == large)
+            continue;
+        for (b = p * GLAMOR_GLYPH_ATLAS_BANDS; b < (p + 1) * GLAMOR_GLYPH_ATLAS_BANDS; b++)
+            use = max(use, atlas->band[b].last_use);
+        if (lru_page < 0 || use < lru_page_use) {
+            lru_page = p;
+            lru_page_use = use;
+        }
+    }
+
+    if (lru_page >= 0 && (lru < 0 || lru_page_use < atlas->band[lru].last_use)) {
+        glamor_glyph_page_bands(glamor_priv, atlas, lru_page, large);
+        return lru_page * GLAMOR_GLYPH_ATLAS_BANDS;
+    }
+
+    if (lru >= 0)
+        glamor_glyph_band_reset(&atlas->band[lru],
+                                glamor_priv->glyph_atlas_dim);
+    return lru;
+}
 
-    glyph_priv->x = atlas->x;
-    glyph_priv->y = atlas->y;
-    glyph_priv->serial = atlas->serial;
+static Bool
+glamor_glyph_add(ScreenPtr screen, struct glamor_glyph_atlas *atlas,
+                 GlyphPtr glyph, DrawablePtr glyph_draw,
+                 int b, int16_t x, int16_t y)
+{
+    PixmapPtr                   glyph_pixmap = (PixmapPtr) glyph_draw;
+    struct glamor_glyph_private *glyph_priv = glamor_get_glyph_private(screen, glyph);
 
-    atlas->x += glyph_draw->width;
-    if (atlas->row_height < glyph_draw->height)
-        atlas->row_height = glyph_draw->height;
+    y += atlas->band[b].y;
 
-    atlas->nglyph++;
+    if (!glamor_glyph_stage(screen, atlas, glyph_pixmap, b, x, y))
+        return FALSE;
 
+    glyph_priv->x = x;
+    glyph_priv->y = y;
+    glyph_priv->band = b;
+    glyph_priv->serial = atlas->band[b].serial;
+    atlas->band[b].nglyph++;
     return TRUE;
 }
 
+/*
+ * Place a glyph in the atlas, evicting the least recently used band
+ * if allowed and nothing else has room.
+ */
+static Bool
+glamor_glyph_cache(ScreenPtr screen, struct glamor_glyph_atlas *atlas,
+                   GlyphPtr glyph, DrawablePtr glyph_draw, Bool lru_ok)
+{
+    glamor_screen_private       *glamor_priv = glamor_get_screen_private(screen);
+    int                         dim = glamor_priv->glyph_atlas_dim;
+    Bool                        large = glamor_glyph_is_large(glamor_priv, glyph_draw);
+    int                         b;
+    int16_t                     x, y;
+
+    if (!glamor_glyph_can_add(atlas, dim, large, glyph_draw, &b, &x, &y)) {
+        b = glamor_glyph_evict(screen, atlas, large, lru_ok);
+        if (b < 0 ||
+            !glamor_glyph_band_alloc(&atlas->band[b], dim,
+                                     glyph_draw->width, glyph_draw->height,
+                                     &x, &y))
+            return FALSE;
+    }
+    return glamor_glyph_add(screen, atlas, glyph, glyph_draw, b, x, y);
+}
+
 static const glamor_facet glamor_facet_composite_glyphs_130 = {
     .name = "composite_glyphs",
     .version = 130,
     .vs_vars = ("attribute vec4 primitive;\n"
-                "attribute vec2 source;\n"
-                "varying vec2 glyph_pos;\n"),
+                "attribute vec3 source;\n"
+                "varying vec3 glyph_pos;\n"),
     .vs_exec = ("       vec2 pos = primitive.zw * vec2(gl_VertexID&1, (gl_VertexID&2)>>1);\n"
                 GLAMOR_POS(gl_Position, (primitive.xy + pos))
-                "       glyph_pos = (source + pos) * ATLAS_DIM_INV;\n"),
-    .fs_vars = ("varying vec2 glyph_pos;\n"
-                "out vec4 color0;\n"
-                "out vec4 color1;\n"),
-    .fs_exec = ("       vec4 mask = texture2D(atlas, glyph_pos);\n"),
+                "       glyph_pos = vec3((source.xy + pos) * ATLAS_DIM_INV, source.z);\n"),
+    .fs_vars = ("varying vec3 glyph_pos;\n"),
+    .fs_exec = ("       vec4 mask = texture(atlas, glyph_pos);\n"),
     .source_name = "source",
-    .locations = glamor_program_location_atlas,
+    .locations = glamor_program_location_atlas_array,
+    .flags = glamor_program_flag_es3,
 };
 
 static const glamor_facet glamor_facet_composite_glyphs_120 = {
@@ -208,10 +730,36 @@ static const glamor_facet glamor_facet_composite_glyphs_120 = {
     .locations = glamor_program_location_atlas,
 };
 
-static inline Bool
-glamor_glyph_use_130(glamor_screen_private *glamor_priv) {
-    return glamor_priv->glsl_version >= 130;
-}
+/* Glyphs drawn straight from their own texture, which covers the
+ * whole glyph
+ */
+static const glamor_facet glamor_facet_composite_glyph_texture_130 = {
+    .name = "composite_glyph_texture",
+    .version = 130,
+    .vs_vars = ("attribute vec4 primitive;\n"
+                "varying vec2 glyph_pos;\n"),
+    .vs_exec = ("       glyph_pos = vec2(gl_VertexID&1, (gl_VertexID&2)>>1);\n"
+                "       vec2 pos = primitive.zw * glyph_pos;\n"
+                GLAMOR_POS(gl_Position, (primitive.xy + pos))),
+    .fs_vars = ("varying vec2 glyph_pos;\n"),
+    .fs_exec = ("       vec4 mask = texture(atlas, glyph_pos);\n"),
+    .locations = glamor_program_location_atlas,
+    .flags = glamor_program_flag_es3,
+};
+
+static const glamor_facet glamor_facet_composite_glyph_texture_120 = {
+    .name = "composite_glyph_texture",
+    .vs_vars = ("attribute vec2 primitive;\n"
+                "attribute vec2 source;\n"
+                "varying vec2 glyph_pos;\n"),
+    .vs_exec = ("       vec2 pos = vec2(0,0);\n"
+                GLAMOR_POS(gl_Position, primitive.xy)
+                "       glyph_pos = source;\n"),
+    .fs_vars = ("varying vec2 glyph_pos;\n"),
+    .fs_exec = ("       vec4 mask = texture2D(atlas, glyph_pos);\n"),
+    .source_name = "source",
+    .locations = glamor_program_location_atlas,
+};
 
 static Bool
 glamor_glyphs_init_facet(ScreenPtr screen)
@@ -229,25 +777,22 @@ glamor_glyphs_fini_facet(ScreenPtr screen)
     free(glamor_priv->glyph_defines);
 }
 
+/*
+ * Draw nglyph glyphs from the vertex buffer, using the mask texture
+ * bound to GL_TEXTURE1
+ */
 static void
-glamor_glyphs_flush(CARD8 op, PicturePtr src, PicturePtr dst,
-                   glamor_program *prog,
-                   struct glamor_glyph_atlas *atlas, int nglyph)
+glamor_glyphs_draw(CARD8 op, PicturePtr src, PicturePtr dst,
+                   glamor_program *prog, int nglyph)
 {
     DrawablePtr drawable = dst->pDrawable;
     glamor_screen_private *glamor_priv = glamor_get_screen_private(drawable->pScreen);
-    PixmapPtr atlas_pixmap = atlas->atlas;
-    glamor_pixmap_private *atlas_priv = glamor_get_pixmap_private(atlas_pixmap);
-    glamor_pixmap_fbo *atlas_fbo = glamor_pixmap_fbo_at(atlas_priv, 0);
     PixmapPtr pixmap = glamor_get_drawable_pixmap(drawable);
     glamor_pixmap_private *pixmap_priv = glamor_get_pixmap_private(pixmap);
     int box_index;
     int off_x, off_y;
 
-    glamor_put_vbo_space(drawable->pScreen);
-
     glEnable(GL_SCISSOR_TEST);
-    glamor_bind_texture(glamor_priv, GL_TEXTURE1, atlas_fbo, FALSE);
 
     for (;;) {
         if (!glamor_use_program_render(prog, op, src, dst))
@@ -299,6 +844,31 @@ glamor_glyphs_flush(CARD8 op, PicturePtr src, PicturePtr dst,
     glDisable(GL_BLEND);
 }
 
+static void
+glamor_glyphs_flush(CARD8 op, PicturePtr src, PicturePtr dst,
+                   glamor_program *prog, struct glamor_glyph_atlas *atlas,
+                   int page, int nglyph)
+{
+    DrawablePtr drawable = dst->pDrawable;
+    glamor_screen_private *glamor_priv = glamor_get_screen_private(drawable->pScreen);
+
+    glamor_put_vbo_space(drawable->pScreen);
+
+    glamor_glyph_stage_flush(drawable->pScreen, atlas);
+
+    if (glamor_glyph_use_130(glamor_priv)) {
+        glActiveTexture(GL_TEXTURE1);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, atlas->array_tex);
+    } else {
+        glamor_pixmap_private *atlas_priv = glamor_get_pixmap_private(atlas->page[page]);
+
+        glamor_bind_texture(glamor_priv, GL_TEXTURE1,
+                            glamor_pixmap_fbo_at(atlas_priv, 0), FALSE);
+    }
+
+    glamor_glyphs_draw(op, src, dst, prog, nglyph);
+}
+
 static GLshort *
 glamor_glyph_start(ScreenPtr screen, int count)
 {
@@ -309,17 +879,17 @@ glamor_glyph_start(ScreenPtr screen, int count)
     /* Set up the vertex buffers for the font and destination */
 
     if (glamor_glyph_use_130(glamor_priv)) {
-        v = glamor_get_vbo_space(screen, count * (6 * sizeof (GLshort)), &vbo_offset);
+        v = glamor_get_vbo_space(screen, count * (8 * sizeof (GLshort)), &vbo_offset);
 
         glEnableVertexAttribArray(GLAMOR_VERTEX_POS);
         glVertexAttribDivisor(GLAMOR_VERTEX_POS, 1);
         glVertexAttribPointer(GLAMOR_VERTEX_POS, 4, GL_SHORT, GL_FALSE,
-                              6 * sizeof (GLshort), vbo_offset);
+                              8 * sizeof (GLshort), vbo_offset);
 
         glEnableVertexAttribArray(GLAMOR_VERTEX_SOURCE);
         glVertexAttribDivisor(GLAMOR_VERTEX_SOURCE, 1);
-        glVertexAttribPointer(GLAMOR_VERTEX_SOURCE, 2, GL_SHORT, GL_FALSE,
-                              6 * sizeof (GLshort), vbo_offset + 4 * sizeof (GLshort));
+        glVertexAttribPointer(GLAMOR_VERTEX_SOURCE, 3, GL_SHORT, GL_FALSE,
+                              8 * sizeof (GLshort), vbo_offset + 4 * sizeof (GLshort));
     } else {
         v = glamor_get_vbo_space(screen, count * (16 * sizeof (GLshort)), &vbo_offset);
 
@@ -334,6 +904,207 @@ glamor_glyph_start(ScreenPtr screen, int count)
     return v;
 }
 
+/*
+ * Bitmaps are expanded to a8, other glyphs must already be in the
+ * format of their atlas.
+ */
+static inline Bool
+glamor_glyph_can_stage(DrawablePtr glyph_draw)
+{
+    switch (glyph_draw->depth) {
+    case 1:
+        return glyph_draw->bitsPerPixel == 1;
+    case 8:
+        return glyph_draw->bitsPerPixel == 8;
+    case 32:
+        return glyph_draw->bitsPerPixel == 32;
+    default:
+        return FALSE;
+    }
+}
+
+static inline Bool
+glamor_glyph_can_cache(glamor_screen_private *glamor_priv, DrawablePtr glyph_draw)
+{
+    return glyph_draw->width <= glamor_priv->glyph_max_dim &&
+        glyph_draw->height <= glamor_priv->glyph_max_dim &&
+        glamor_glyph_can_stage(glyph_draw) &&
+        glamor_pixmap_is_memory((PixmapPtr) glyph_draw);
+}
+
+/*
+ * Return a pixmap with a single texture holding the glyph, for glyphs
+ * that cannot go in the atlas. GPU glyphs are used directly; memory
+ * glyphs that are too large for the atlas get a texture of their own,
+ * kept until the glyph is unrealized.
+ */
+static PixmapPtr
+glamor_glyph_texture(ScreenPtr screen, GlyphPtr glyph, DrawablePtr glyph_draw)
+{
+    struct glamor_glyph_private *glyph_priv = glamor_get_glyph_private(screen, glyph);
+    PixmapPtr                   glyph_pixmap = (PixmapPtr) glyph_draw;
+    PixmapPtr                   texture;
+    glamor_pixmap_private       *texture_priv;
+    int                         cpp = glyph_draw->depth == 32 ? 4 : 1;
+    int                         stride;
+    uint8_t                     *bits;
+    BoxRec                      box = {
+        .x1 = 0,
+        .y1 = 0,
+        .x2 = glyph_draw->width,
+        .y2 = glyph_draw->height,
+    };
+
+    if (!glamor_pixmap_is_memory(glyph_pixmap)) {
+        texture_priv = glamor_get_pixmap_private(glyph_pixmap);
+        if (GLAMOR_PIXMAP_PRIV_HAS_FBO(texture_priv) &&
+            glamor_pixmap_priv_is_small(texture_priv))
+            return glyph_pixmap;
+        return NULL;
+    }
+
+    if (!glyph_priv)
+        return NULL;
+
+    if (glyph_priv->texture)
+        return glyph_priv->texture;
+
+    if (!glamor_glyph_can_stage(glyph_draw))
+        return NULL;
+
+    texture = glamor_create_pixmap(screen, glyph_draw->width, glyph_draw->height,
+                                   cpp == 4 ? 32 : 8, GLAMOR_CREATE_FBO_NO_FBO);
+    if (!texture)
+        return NULL;
+    texture_priv = glamor_get_pixmap_private(texture);
+    if (!GLAMOR_PIXMAP_PRIV_HAS_FBO(texture_priv) ||
+        !glamor_pixmap_priv_is_small(texture_priv)) {
+        glamor_destroy_pixmap(texture);
+        return NULL;
+    }
+
+    stride = (glyph_draw->width * cpp + 3) & ~3;
+    bits = xallocarray(glyph_draw->height, stride);
+    if (!bits) {
+        glamor_destroy_pixmap(texture);
+        return NULL;
+    }
+    glamor_glyph_stage_bits(glyph_pixmap, bits, stride, cpp);
+    glamor_upload_boxes(texture, &box, 1, 0, 0, 0, 0, bits, stride);
+    free(bits);
+
+    glyph_priv->texture = texture;
+    return texture;
+}
+
+/* A glyph waiting to be drawn from its own texture */
+struct glamor_glyph_texture {
+    PixmapPtr   texture;
+    PicturePtr  pict;
+    int16_t     x, y;
+};
+
+static int
+glamor_glyph_texture_compare(const void *a, const void *b)
+{
+    const struct glamor_glyph_texture *ta = a, *tb = b;
+
+    if (ta->texture == tb->texture)
+        return 0;
+    return (uintptr_t) ta->texture < (uintptr_t) tb->texture ? -1 : 1;
+}
+
+/*
+ * Draw the deferred texture glyphs, one draw for every distinct glyph
+ * texture. Only used for operators where the order in which
+ * overlapping glyphs land does not matter.
+ */
+static void
+glamor_glyphs_draw_textures(CARD8 op, PicturePtr src, PicturePtr dst,
+                            INT16 x_src, struct glamor_glyph_texture *tex,
+                            int ntex)
+{
+    ScreenPtr                   screen = dst->pDrawable->pScreen;
+    glamor_screen_private       *glamor_priv = glamor_get_screen_private(screen);
+    const glamor_facet          *facet;
+    int                         i, j, k;
+
+    if (glamor_glyph_use_130(glamor_priv))
+        facet = &glamor_facet_composite_glyph_texture_130;
+    else
+        facet = &glamor_facet_composite_glyph_texture_120;
+
+    qsort(tex, ntex, sizeof (tex[0]), glamor_glyph_texture_compare);
+
+    for (i = 0; i < ntex; i = j) {
+        PixmapPtr               texture = tex[i].texture;
+        glamor_pixmap_private   *texture_priv = glamor_get_pixmap_private(texture);
+        int                     w = texture->drawable.width;
+        int                     h = texture->drawable.height;
+        glamor_program          *prog;
+        char                    *vbo_offset;
+        GLshort                 *v;
+
+        for (j = i + 1; j < ntex && tex[j].texture == texture; j++)
+            ;
+
+        prog = glamor_setup_program_render(op, src, tex[i].pict, dst,
+                                           &glamor_priv->glyphs_texture_program,
+                                           facet, NULL);
+        if (!prog) {
+            for (k = i; k < j; k++)
+                glamor_composite(op, src, tex[k].pict, dst,
+                                 x_src + tex[k].x, tex[k].y,
+                                 0, 0, tex[k].x, tex[k].y, w, h);
+            continue;
+        }
+
+        if (glamor_glyph_use_130(glamor_priv)) {
+            v = glamor_get_vbo_space(screen, (j - i) * (4 * sizeof (GLshort)), &vbo_offset);
+
+            glEnableVertexAttribArray(GLAMOR_VERTEX_POS);
+            glVertexAttribDivisor(GLAMOR_VERTEX_POS, 1);
+            glVertexAttribPointer(GLAMOR_VERTEX_POS, 4, GL_SHORT, GL_FALSE,
+                                  4 * sizeof (GLshort), vbo_offset);
+
+            for (k = i; k < j; k++) {
+                v[0] = tex[k].x;
+                v[1] = tex[k].y;
+                v[2] = w;
+                v[3] = h;
+                v += 4;
+            }
+        } else {
+            v = glamor_get_vbo_space(screen, (j - i) * (16 * sizeof (GLshort)), &vbo_offset);
+
+            glEnableVertexAttribArray(GLAMOR_VERTEX_POS);
+            glVertexAttribPointer(GLAMOR_VERTEX_POS, 2, GL_SHORT, GL_FALSE,
+                                  4 * sizeof (GLshort), vbo_offset);
+
+            glEnableVertexAttribArray(GLAMOR_VERTEX_SOURCE);
+            glVertexAttribPointer(GLAMOR_VERTEX_SOURCE, 2, GL_SHORT, GL_FALSE,
+                                  4 * sizeof (GLshort), vbo_offset + 2 * sizeof (GLshort));
+
+            for (k = i; k < j; k++) {
+                v[0] = tex[k].x;        v[1] = tex[k].y;
+                v[2] = 0;               v[3] = 0;
+                v[4] = tex[k].x + w;    v[5] = tex[k].y;
+                v[6] = 1;               v[7] = 0;
+                v[8] = tex[k].x + w;    v[9] = tex[k].y + h;
+                v[10] = 1;              v[11] = 1;
+                v[12] = tex[k].x;       v[13] = tex[k].y + h;
+                v[14] = 0;              v[15] = 1;
+                v += 16;
+            }
+        }
+        glamor_put_vbo_space(screen);
+
+        glamor_bind_texture(glamor_priv, GL_TEXTURE1,
+                            glamor_pixmap_fbo_at(texture_priv, 0), FALSE);
+        glamor_glyphs_draw(op, src, dst, prog, j - i);
+    }
+}
+
 static inline struct glamor_glyph_atlas *
 glamor_atlas_for_glyph(glamor_screen_private *glamor_priv, DrawablePtr drawable)
 {
@@ -360,10 +1131,12 @@ glamor_composite_glyphs(CARD8 op,
     glamor_program *prog = NULL;
     glamor_program_render       *glyphs_program = &glamor_priv->glyphs_program;
     struct glamor_glyph_atlas    *glyph_atlas = NULL;
+    int                         glyph_page = -1;
+    struct glamor_glyph_texture *glyph_tex = NULL;
+    int                         nglyph_tex = 0;
+    Bool                        defer_ok = (op == PictOpOver || op == PictOpAdd);
     int x = 0, y = 0;
     int n;
-    int glyph_atlas_dim = glamor_priv->glyph_atlas_dim;
-    int glyph_max_dim = glamor_priv->glyph_max_dim;
     int nglyph = 0;
     int screen_num = screen->myNum;
 
@@ -387,15 +1160,29 @@ glamor_composite_glyphs(CARD8 op,
             if (glyph->info.width && glyph->info.height) {
                 PicturePtr glyph_pict = GlyphPicture(glyph)[screen_num];
                 DrawablePtr glyph_draw = glyph_pict->pDrawable;
-
-                /* Need to draw with slow path?
+                Bool cacheable = (glamor_get_glyph_private(screen, glyph) &&
+                                  glamor_glyph_can_cache(glamor_priv, glyph_draw));
+                PixmapPtr texture = NULL;
+
+                /* Too big for the atlas or already on the GPU? With an
+                 * operator that doesn't care about drawing order, save it
+                 * for the end and draw it with the other uses of its
+                 * texture.
                  */
-                if (_X_UNLIKELY(glyph_draw->width > glyph_max_dim ||
-                                glyph_draw->height > glyph_max_dim ||
-                                !glamor_pixmap_is_memory((PixmapPtr)glyph_draw)))
+                if (_X_UNLIKELY(!cacheable) && defer_ok &&
+                    (glyph_tex || (glyph_tex = xallocarray(nglyph, sizeof (*glyph_tex)))) &&
+                    (texture = glamor_glyph_texture(screen, glyph, glyph_draw)))
                 {
+                    glyph_tex[nglyph_tex].texture = texture;
+                    glyph_tex[nglyph_tex].pict = glyph_pict;
+                    glyph_tex[nglyph_tex].x = x - glyph->info.x;
+                    glyph_tex[nglyph_tex].y = y - glyph->info.y;
+                    nglyph_tex++;
+                } else if (_X_UNLIKELY(!cacheable)) {
+                    /* Need to draw with slow path
+                     */
                     if (glyphs_queued) {
-                        glamor_glyphs_flush(op, src, dst, prog, glyph_atlas, glyphs_queued);
+                        glamor_glyphs_flush(op, src, dst, prog, glyph_atlas, glyph_page, glyphs_queued);
                         glyphs_queued = 0;
                     }
                 bail_one:
@@ -405,14 +1192,14 @@ glamor_composite_glyphs(CARD8 op,
                                      x - glyph->info.x, y - glyph->info.y,
                                      glyph_draw->width, glyph_draw->height);
                 } else {
-                    struct glamor_glyph_private *glyph_priv = glamor_get_glyph_private((PixmapPtr)(glyph_draw));
+                    struct glamor_glyph_private *glyph_priv = glamor_get_glyph_private(screen, glyph);
                     struct glamor_glyph_atlas *next_atlas = glamor_atlas_for_glyph(glamor_priv, glyph_draw);
 
                     /* Switching source glyph format?
                      */
                     if (_X_UNLIKELY(next_atlas != glyph_atlas)) {
                         if (glyphs_queued) {
-                            glamor_glyphs_flush(op, src, dst, prog, glyph_atlas, glyphs_queued);
+                            glamor_glyphs_flush(op, src, dst, prog, glyph_atlas, glyph_page, glyphs_queued);
                             glyphs_queued = 0;
                         }
                         glyph_atlas = next_atlas;
@@ -420,23 +1207,28 @@ glamor_composite_glyphs(CARD8 op,
 
                     /* Glyph not cached in current atlas?
                      */
-                    if (_X_UNLIKELY(glyph_priv->serial != glyph_atlas->serial)) {
-                        if (!glamor_glyph_can_add(glyph_atlas, glyph_atlas_dim, glyph_draw)) {
+                    if (_X_UNLIKELY(!glamor_glyph_cached(glyph_atlas, glyph_priv))) {
+                        if (!glamor_glyph_cache(screen, glyph_atlas, glyph, glyph_draw, FALSE)) {
                             if (glyphs_queued) {
-                                glamor_glyphs_flush(op, src, dst, prog, glyph_atlas, glyphs_queued);
+                                glamor_glyphs_flush(op, src, dst, prog, glyph_atlas, glyph_page, glyphs_queued);
                                 glyphs_queued = 0;
                             }
-                            if (glyph_atlas->atlas) {
-                                (*screen->DestroyPixmap)(glyph_atlas->atlas);
-                                glyph_atlas->atlas = NULL;
-                            }
-                        }
-                        if (!glyph_atlas->atlas) {
-                            glamor_glyph_atlas_init(screen, glyph_atlas);
-                            if (!glyph_atlas->atlas)
+                            if (!glamor_glyph_cache(screen, glyph_atlas, glyph, glyph_draw, TRUE))
                                 goto bail_one;
                         }
-                        glamor_glyph_add(glyph_atlas, glyph_draw);
+                    }
+                    glyph_atlas->band[glyph_priv->band].last_use = ++glyph_atlas->use;
+
+                    /* Switching atlas page? Layers of the texture array
+                     * are all bound at once.
+                     */
+                    if (_X_UNLIKELY(glyph_priv->band / GLAMOR_GLYPH_ATLAS_BANDS != glyph_page) &&
+                        !glamor_glyph_use_130(glamor_priv)) {
+                        if (glyphs_queued) {
+                            glamor_glyphs_flush(op, src, dst, prog, glyph_atlas, glyph_page, glyphs_queued);
+                            glyphs_queued = 0;
+                        }
+                        glyph_page = glyph_priv->band / GLAMOR_GLYPH_ATLAS_BANDS;
                     }
 
                     /* First glyph in the current atlas?
@@ -468,7 +1260,8 @@ glamor_composite_glyphs(CARD8 op,
                         v[3] = glyph_draw->height;
                         v[4] = glyph_priv->x;
                         v[5] = glyph_priv->y;
-                        v += 6;
+                        v[6] = glyph_priv->band / GLAMOR_GLYPH_ATLAS_BANDS;
+                        v += 8;
                     } else {
                         v[0] = x - glyph->info.x;
                         v[1] = y - glyph->info.y;
@@ -503,11 +1296,137 @@ glamor_composite_glyphs(CARD8 op,
     }
 
     if (glyphs_queued)
-        glamor_glyphs_flush(op, src, dst, prog, glyph_atlas, glyphs_queued);
+        glamor_glyphs_flush(op, src, dst, prog, glyph_atlas, glyph_page, glyphs_queued);
+
+    if (nglyph_tex)
+        glamor_glyphs_draw_textures(op, src, dst, x_src, glyph_tex, nglyph_tex);
+    free(glyph_tex);
 
     return;
 }
 
+/*
+ * New glyphs are queued here and cached from the block handler once
+ * AddGlyphs has filled in their pictures, keeping the upload out of
+ * the first draw that uses them.
+ */
+Bool
+glamor_realize_glyph(ScreenPtr screen, GlyphPtr glyph)
+{
+    glamor_screen_private       *glamor_priv = glamor_get_screen_private(screen);
+    struct glamor_glyph_privates *privates =
+        dixLookupPrivate(&glyph->devPrivates, &glamor_glyph_private_key);
+    struct glamor_glyph_private *glyph_priv;
+
+    if (!privates) {
+        privates = calloc(1, sizeof (*privates) +
+                          screenInfo.numScreens * sizeof (privates->screen[0]));
+        if (!privates)
+            return FALSE;
+        privates->nscreen = screenInfo.numScreens;
+        dixSetPrivate(&glyph->devPrivates, &glamor_glyph_private_key, privates);
+    }
+
+    /* Left uncached on a screen added after the glyph */
+    glyph_priv = glamor_get_glyph_private(screen, glyph);
+    if (glyph_priv && !glyph_priv->realized) {
+        glyph_priv->realized = TRUE;
+        glyph_priv->glyph = glyph;
+        xorg_list_append(&glyph_priv->pending, &glamor_priv->glyph_pending);
+    }
+
+    return glamor_priv->saved_procs.realize_glyph(screen, glyph);
+}
+
+/*
+ * Release the atlas space held by a glyph on this screen. A band is
+ * emptied for reuse once its last glyph is gone, and the privates go
+ * with the last screen.
+ */
+void
+glamor_unrealize_glyph(ScreenPtr screen, GlyphPtr glyph)
+{
+    glamor_screen_private       *glamor_priv = glamor_get_screen_private(screen);
+    struct glamor_glyph_privates *privates =
+        dixLookupPrivate(&glyph->devPrivates, &glamor_glyph_private_key);
+    struct glamor_glyph_private *glyph_priv = glamor_get_glyph_private(screen, glyph);
+    struct glamor_glyph_atlas   *atlases[2] = {
+        glamor_priv->glyph_atlas_a, glamor_priv->glyph_atlas_argb
+    };
+    int                         i, s;
+
+    if (!glyph_priv || !glyph_priv->realized)
+        goto out;
+
+    glyph_priv->realized = FALSE;
+
+    if (glyph_priv->pending.next) {
+        xorg_list_del(&glyph_priv->pending);
+        glyph_priv->pending.next = NULL;
+    }
+
+    if (glyph_priv->texture) {
+        (*screen->DestroyPixmap)(glyph_priv->texture);
+        glyph_priv->texture = NULL;
+    }
+
+    for (i = 0; i < ARRAY_SIZE(atlases); i++) {
+        struct glamor_glyph_band *band;
+
+        if (!glamor_glyph_cached(atlases[i], glyph_priv))
+            continue;
+        band = &atlases[i]->band[glyph_priv->band];
+        if (--band->nglyph == 0)
+            glamor_glyph_band_reset(band, glamor_priv->glyph_atlas_dim);
+        glyph_priv->serial = 0;
+    }
+
+    for (s = 0; s < privates->nscreen; s++)
+        if (privates->screen[s].realized)
+            goto out;
+
+    free(privates);
+    dixSetPrivate(&glyph->devPrivates, &glamor_glyph_private_key, NULL);
+
+out:
+    glamor_priv->saved_procs.unrealize_glyph(screen, glyph);
+}
+
+/*
+ * Cache any glyphs added since the last call. Only free space is used;
+ * resident glyphs are never evicted for glyphs that may not be drawn.
+ */
+void
+glamor_composite_glyphs_upload(ScreenPtr screen)
+{
+    glamor_screen_private       *glamor_priv = glamor_get_screen_private(screen);
+    struct glamor_glyph_private *glyph_priv, *tmp;
+    int                         screen_num = screen->myNum;
+
+    if (xorg_list_is_empty(&glamor_priv->glyph_pending))
+        return;
+
+    xorg_list_for_each_entry_safe(glyph_priv, tmp, &glamor_priv->glyph_pending, pending) {
+        GlyphPtr                glyph = glyph_priv->glyph;
+        PicturePtr              glyph_pict = GlyphPicture(glyph)[screen_num];
+        struct glamor_glyph_atlas *atlas;
+
+        xorg_list_del(&glyph_priv->pending);
+        glyph_priv->pending.next = NULL;
+
+        if (!glyph_pict || !glyph_pict->pDrawable ||
+            !glamor_glyph_can_cache(glamor_priv, glyph_pict->pDrawable))
+            continue;
+
+        atlas = glamor_atlas_for_glyph(glamor_priv, glyph_pict->pDrawable);
+        if (!glamor_glyph_cached(atlas, glyph_priv))
+            glamor_glyph_cache(screen, atlas, glyph, glyph_pict->pDrawable, FALSE);
+    }
+
+    glamor_glyph_stage_flush(screen, glamor_priv->glyph_atlas_a);
+    glamor_glyph_stage_flush(screen, glamor_priv->glyph_atlas_argb);
+}
+
 static struct glamor_glyph_atlas *
 glamor_alloc_glyph_atlas(ScreenPtr screen, int depth, CARD32 f)
 {
@@ -521,7 +1440,6 @@ glamor_alloc_glyph_atlas(ScreenPtr screen, int depth, CARD32 f)
     if (!glyph_atlas)
         return NULL;
     glyph_atlas->format = format;
-    glyph_atlas->serial = 1;
 
     return glyph_atlas;
 }
@@ -531,16 +1449,25 @@ glamor_composite_glyphs_init(ScreenPtr screen)
 {
     glamor_screen_private *glamor_priv = glamor_get_screen_private(screen);
 
-    if (!dixRegisterPrivateKey(&glamor_glyph_private_key, PRIVATE_PIXMAP, sizeof (struct glamor_glyph_private)))
+    if (!dixRegisterPrivateKey(&glamor_glyph_private_key, PRIVATE_GLYPH, 0))
         return FALSE;
 
+    xorg_list_init(&glamor_priv->glyph_pending);
+
+    glamor_glyph_init_a1_to_a8();
+
     /* Make glyph atlases of a reasonable size, but no larger than the maximum
      * supported by the hardware
      */
     glamor_priv->glyph_atlas_dim = MIN(DEFAULT_ATLAS_DIM, glamor_priv->max_fbo_size);
 
-    /* Don't stick huge glyphs in the atlases */
-    glamor_priv->glyph_max_dim = glamor_priv->glyph_atlas_dim / 8;
+    /* Don't stick huge glyphs in the atlases. The layered atlas has room
+     * for glyphs up to half a page on dedicated pages.
+     */
+    if (glamor_glyph_use_130(glamor_priv))
+        glamor_priv->glyph_max_dim = glamor_priv->glyph_atlas_dim / GLAMOR_GLYPH_ATLAS_LARGE_BANDS;
+    else
+        glamor_priv->glyph_max_dim = glamor_priv->glyph_atlas_dim / GLAMOR_GLYPH_ATLAS_BANDS;
 
     glamor_priv->glyph_atlas_a = glamor_alloc_glyph_atlas(screen, 8, PICT_a8);
     if (!glamor_priv->glyph_atlas_a)
@@ -558,10 +1485,17 @@ glamor_composite_glyphs_init(ScreenPtr screen)
 static void
 glamor_free_glyph_atlas(struct glamor_glyph_atlas *atlas)
 {
+    int p, b;
+
     if (!atlas)
         return;
-    if (atlas->atlas)
-        (*atlas->atlas->drawable.pScreen->DestroyPixmap)(atlas->atlas);
+    for (p = 0; p < GLAMOR_GLYPH_ATLAS_PAGES; p++)
+        if (atlas->page[p])
+            (*atlas->page[p]->drawable.pScreen->DestroyPixmap)(atlas->page[p]);
+    if (atlas->array_tex)
+        glDeleteTextures(1, &atlas->array_tex);
+    for (b = 0; b < ARRAY_SIZE(atlas->band); b++)
+        free (atlas->band[b].bits);
     free (atlas);
 }
 
@@ -569,7 +1503,14 @@ void
 glamor_composite_glyphs_fini(ScreenPtr screen)
 {
     glamor_screen_private *glamor_priv = glamor_get_screen_private(screen);
+    struct glamor_glyph_private *glyph_priv, *tmp;
 
+    xorg_list_for_each_entry_safe(glyph_priv, tmp, &glamor_priv->glyph_pending, pending) {
+        xorg_list_del(&glyph_priv->pending);
+        glyph_priv->pending.next = NULL;
+    }
+
+    glamor_make_current(glamor_priv);
     glamor_glyphs_fini_facet(screen);
     glamor_free_glyph_atlas(glamor_priv->glyph_atlas_a);
     glamor_free_glyph_atlas(glamor_priv->glyph_atlas_argb);
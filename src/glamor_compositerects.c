@@ -241,7 +241,10 @@ glamor_composite_rectangles(CARD8 op,
             pixel = 0;
         else
             miRenderColorToPixel(dst->pFormat, color, &pixel);
-        glamor_solid_boxes(pixmap, boxes, num_boxes, pixel);
+        if (num_boxes <= GLAMOR_CLEAR_MAX_BOXES)
+            glamor_clear_boxes(pixmap, boxes, num_boxes, pixel);
+        else
+            glamor_solid_boxes(pixmap, boxes, num_boxes, pixel);
 
         goto done;
     }
@@ -311,6 +311,75 @@ bail:
     return FALSE;
 }
 
+/*
+ * Copy from GPU to GPU with glBlitFramebuffer. Each box is a separate
+ * blit, while the textured path draws all boxes at once, so this is
+ * only used for a single box, where both take one call and the
+ * GXcopy blit skips the shader and vertex setup. Unobscured window
+ * moves and scrolls look like that.
+ */
+
+static Bool
+glamor_copy_fbo_fbo_blit(DrawablePtr src,
+                         DrawablePtr dst,
+                         GCPtr gc,
+                         BoxPtr box,
+                         int nbox,
+                         int dx,
+                         int dy,
+                         Bool reverse,
+                         Bool upsidedown,
+                         Pixel bitplane,
+                         void *closure)
+{
+    ScreenPtr screen = dst->pScreen;
+    glamor_screen_private *glamor_priv = glamor_get_screen_private(screen);
+    PixmapPtr src_pixmap = glamor_get_drawable_pixmap(src);
+    PixmapPtr dst_pixmap = glamor_get_drawable_pixmap(dst);
+    glamor_pixmap_private *src_priv = glamor_get_pixmap_private(src_pixmap);
+    glamor_pixmap_private *dst_priv = glamor_get_pixmap_private(dst_pixmap);
+    int src_off_x, src_off_y, dst_off_x, dst_off_y;
+
+    if (!glamor_priv->has_fbo_blit || bitplane)
+        return FALSE;
+
+    if (gc && (gc->alu != GXcopy ||
+               !glamor_pm_is_solid(gc->depth, gc->planemask)))
+        return FALSE;
+
+    if (nbox != 1)
+        return FALSE;
+
+    if (!glamor_pixmap_priv_is_small(src_priv) ||
+        !glamor_pixmap_priv_is_small(dst_priv))
+        return FALSE;
+
+    if (src_priv->fbo->format != dst_priv->fbo->format ||
+        !src_priv->fbo->fb || !dst_priv->fbo->fb)
+        return FALSE;
+
+    glamor_make_current(glamor_priv);
+    glamor_set_gxcopy(screen);
+
+    glamor_get_drawable_deltas(src, src_pixmap, &src_off_x, &src_off_y);
+    glamor_get_drawable_deltas(dst, dst_pixmap, &dst_off_x, &dst_off_y);
+    src_off_x += dx;
+    src_off_y += dy;
+
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, src_priv->fbo->fb);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, dst_priv->fbo->fb);
+
+    glBlitFramebuffer(box->x1 + src_off_x, box->y1 + src_off_y,
+                      box->x2 + src_off_x, box->y2 + src_off_y,
+                      box->x1 + dst_off_x, box->y1 + dst_off_y,
+                      box->x2 + dst_off_x, box->y2 + dst_off_y,
+                      GL_COLOR_BUFFER_BIT, GL_NEAREST);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, dst_priv->fbo->fb);
+
+    return TRUE;
+}
+
 /*
  * Copy from GPU to GPU by using the source
  * as a texture and painting that into the destination
@@ -343,22 +412,32 @@ glamor_copy_fbo_fbo_draw(DrawablePtr src,
     struct copy_args args;
     glamor_program *prog;
     const glamor_facet *copy_facet;
+    Bool dest_read = glamor_gc_needs_dest_read(screen, gc);
+    Bool dest_copy = glamor_gc_needs_dest_copy(screen, gc);
+    glamor_dest_bounds bounds;
     int n;
 
     glamor_make_current(glamor_priv);
 
-    if (gc && !glamor_set_planemask(gc->depth, gc->planemask))
-        goto bail_ctx;
+    if (!gc) {
+        glamor_set_gxcopy(screen);
+    } else if (!dest_read) {
+        if (!glamor_set_alu(screen, gc->alu))
+            goto bail_ctx;
 
-    if (!glamor_set_alu(screen, gc ? gc->alu : GXcopy))
-        goto bail_ctx;
+        if (!glamor_set_planemask(screen, gc->depth, gc->planemask))
+            goto bail_ctx;
+    }
 
-    if (bitplane && !glamor_priv->can_copyplane)
+    if (bitplane && (!glamor_priv->can_copyplane || dest_read))
         goto bail_ctx;
 
     if (bitplane) {
         prog = &glamor_priv->copy_plane_prog;
         copy_facet = &glamor_facet_copyplane;
+    } else if (dest_read) {
+        prog = &glamor_priv->copy_area_fetch_prog;
+        copy_facet = &glamor_facet_copyarea;
     } else {
         prog = &glamor_priv->copy_area_prog;
         copy_facet = &glamor_facet_copyarea;
@@ -368,6 +447,7 @@ glamor_copy_fbo_fbo_draw(DrawablePtr src,
         goto bail_ctx;
 
     if (!prog->prog) {
+        prog->dest_read = dest_read;
         if (!glamor_build_program(screen, prog,
                                   copy_facet, NULL, NULL, NULL))
             goto bail_ctx;
@@ -384,7 +464,11 @@ glamor_copy_fbo_fbo_draw(DrawablePtr src,
     glVertexAttribPointer(GLAMOR_VERTEX_POS, 2, GL_SHORT, GL_FALSE,
                           2 * sizeof (GLshort), vbo_offset);
 
+    glamor_dest_bounds_init(&bounds);
+
     for (n = 0; n < nbox; n++) {
+        if (dest_copy)
+            glamor_dest_bounds_add(&bounds, box->x1, box->y1, box->x2, box->y2);
         v[0] = box->x1; v[1] = box->y1;
         v[2] = box->x1; v[3] = box->y2;
         v[4] = box->x2; v[5] = box->y2;
@@ -406,6 +490,9 @@ glamor_copy_fbo_fbo_draw(DrawablePtr src,
         args.dy = dy + src_off_y - src_box->y1;
         args.src = glamor_pixmap_fbo_at(src_priv, src_box_index);
 
+        if (dest_copy && !glamor_set_dest_copy_bounds(dst, gc, &bounds))
+            goto bail_ctx;
+
         if (!glamor_use_program(dst_pixmap, gc, prog, &args))
             goto bail_ctx;
 
@@ -465,11 +552,15 @@ glamor_copy_fbo_fbo_temp(DrawablePtr src,
      */
     glamor_make_current(glamor_priv);
 
-    if (gc && !glamor_set_planemask(gc->depth, gc->planemask))
-        goto bail_ctx;
+    if (!gc) {
+        glamor_set_gxcopy(screen);
+    } else if (!glamor_gc_needs_dest_read(screen, gc)) {
+        if (!glamor_set_alu(screen, gc->alu))
+            goto bail_ctx;
 
-    if (!glamor_set_alu(screen, gc ? gc->alu : GXcopy))
-        goto bail_ctx;
+        if (!glamor_set_planemask(screen, gc->depth, gc->planemask))
+            goto bail_ctx;
+    }
 
     /* Find the size of the area to copy
      */
@@ -541,6 +632,367 @@ bail_ctx:
     return FALSE;
 }
 
+/**
+ * Copies within one pixmap where the source and destination overlap,
+ * without a temporary pixmap. The region is cut into bands across the
+ * direction of the move, as thick as the move itself, so that no band
+ * overlaps its own source. Bands are copied starting from the side
+ * the contents move towards, so each band reads only pixels no
+ * earlier band has written.
+ *
+ * Bands are blitted where the GL can. Drawing them with the copy
+ * program samples the pixmap while rendering to it, which is only
+ * defined with a texture barrier before each band, so without
+ * NV_texture_barrier that is left to glamor_copy_fbo_fbo_scratch().
+ * Scrolling by a few pixels would take too many bands, and is left to
+ * the scratch texture or a temporary pixmap as well.
+ */
+
+#define GLAMOR_COPY_MAX_BANDS   64
+
+static Bool
+glamor_copy_fbo_fbo_banded(DrawablePtr src,
+                           DrawablePtr dst,
+                           GCPtr gc,
+                           BoxPtr box,
+                           int nbox,
+                           int dx,
+                           int dy,
+                           Bool reverse,
+                           Bool upsidedown,
+                           Pixel bitplane,
+                           void *closure)
+{
+    ScreenPtr screen = dst->pScreen;
+    glamor_screen_private *glamor_priv = glamor_get_screen_private(screen);
+    PixmapPtr pixmap = glamor_get_drawable_pixmap(dst);
+    glamor_pixmap_private *priv = glamor_get_pixmap_private(pixmap);
+    int src_off_x, src_off_y, dst_off_x, dst_off_y;
+    int shift, step, lo, hi, nband;
+    Bool vertical, blit;
+    BoxRec bounds;
+    BoxPtr band_box = NULL;
+    int b, n;
+
+    if (glamor_get_drawable_pixmap(src) != pixmap ||
+        !glamor_pixmap_priv_is_small(priv) || !priv->fbo->fb)
+        return FALSE;
+
+    blit = (glamor_priv->has_fbo_blit && !bitplane &&
+            (!gc || (gc->alu == GXcopy &&
+                     glamor_pm_is_solid(gc->depth, gc->planemask))));
+    if (!blit && !glamor_priv->has_nv_texture_barrier)
+        return FALSE;
+
+    glamor_get_drawable_deltas(src, pixmap, &src_off_x, &src_off_y);
+    glamor_get_drawable_deltas(dst, pixmap, &dst_off_x, &dst_off_y);
+    src_off_x += dx;
+    src_off_y += dy;
+
+    bounds = box[0];
+    for (n = 1; n < nbox; n++) {
+        bounds.x1 = min(bounds.x1, box[n].x1);
+        bounds.x2 = max(bounds.x2, box[n].x2);
+        bounds.y1 = min(bounds.y1, box[n].y1);
+        bounds.y2 = max(bounds.y2, box[n].y2);
+    }
+
+    /* Band along the larger component of the move, for fewer bands */
+    vertical = abs(src_off_y - dst_off_y) >= abs(src_off_x - dst_off_x);
+    if (vertical) {
+        shift = src_off_y - dst_off_y;
+        lo = bounds.y1;
+        hi = bounds.y2;
+    } else {
+        shift = src_off_x - dst_off_x;
+        lo = bounds.x1;
+        hi = bounds.x2;
+    }
+
+    step = abs(shift);
+    if (step == 0)
+        return FALSE;
+
+    nband = (hi - lo + step - 1) / step;
+    if (nband > GLAMOR_COPY_MAX_BANDS)
+        return FALSE;
+
+    if (!blit) {
+        band_box = xallocarray(nbox, sizeof (BoxRec));
+        if (!band_box)
+            return FALSE;
+    } else {
+        glamor_make_current(glamor_priv);
+        glamor_set_gxcopy(screen);
+        glBindFramebuffer(GL_FRAMEBUFFER, priv->fbo->fb);
+    }
+
+    for (b = 0; b < nband; b++) {
+        int b1 = shift > 0 ? lo + b * step : hi - (b + 1) * step;
+        int b2 = b1 + step;
+        int nband_box = 0;
+
+        b1 = max(b1, lo);
+        b2 = min(b2, hi);
+
+        for (n = 0; n < nbox; n++) {
+            BoxRec band = box[n];
+
+            if (vertical) {
+                band.y1 = max(band.y1, b1);
+                band.y2 = min(band.y2, b2);
+            } else {
+                band.x1 = max(band.x1, b1);
+                band.x2 = min(band.x2, b2);
+            }
+            if (band.x1 >= band.x2 || band.y1 >= band.y2)
+                continue;
+
+            if (blit)
+                glBlitFramebuffer(band.x1 + src_off_x, band.y1 + src_off_y,
+                                  band.x2 + src_off_x, band.y2 + src_off_y,
+                                  band.x1 + dst_off_x, band.y1 + dst_off_y,
+                                  band.x2 + dst_off_x, band.y2 + dst_off_y,
+                                  GL_COLOR_BUFFER_BIT, GL_NEAREST);
+            else
+                band_box[nband_box++] = band;
+        }
+
+        if (blit || !nband_box)
+            continue;
+
+        /* Makes the previous band's writes, and anything drawn to the
+         * pixmap before this copy, visible to this band's texel fetches
+         */
+        glamor_make_current(glamor_priv);
+        glTextureBarrierNV();
+
+        if (!glamor_copy_fbo_fbo_draw(src, dst, gc, band_box, nband_box,
+                                      dx, dy, reverse, upsidedown,
+                                      bitplane, closure)) {
+            free(band_box);
+            return FALSE;
+        }
+    }
+
+    free(band_box);
+    return TRUE;
+}
+
+/**
+ * Copies within one pixmap through the screen's scratch destination
+ * copy texture: the source extents are copied there in one go, and
+ * the boxes are drawn back from it in a single call. This is one more
+ * copy than a blit, but needs neither glBlitFramebuffer nor a texture
+ * barrier, and reuses the texture instead of allocating a temporary
+ * pixmap.
+ */
+
+static Bool
+glamor_copy_fbo_fbo_scratch(DrawablePtr src,
+                            DrawablePtr dst,
+                            GCPtr gc,
+                            BoxPtr box,
+                            int nbox,
+                            int dx,
+                            int dy,
+                            Bool reverse,
+                            Bool upsidedown,
+                            Pixel bitplane,
+                            void *closure)
+{
+    ScreenPtr screen = dst->pScreen;
+    glamor_screen_private *glamor_priv = glamor_get_screen_private(screen);
+    PixmapPtr pixmap = glamor_get_drawable_pixmap(dst);
+    glamor_pixmap_private *priv = glamor_get_pixmap_private(pixmap);
+    int src_off_x, src_off_y;
+    struct copy_args args;
+    glamor_program *prog;
+    const glamor_facet *copy_facet;
+    Bool dest_read = glamor_gc_needs_dest_read(screen, gc);
+    BoxRec src_box;
+    GLshort *v;
+    char *vbo_offset;
+    int n;
+
+    if (glamor_get_drawable_pixmap(src) != pixmap ||
+        !glamor_pixmap_priv_is_small(priv) || !priv->fbo->fb)
+        return FALSE;
+
+    /* Emulated logic ops need the scratch texture for the destination */
+    if (glamor_gc_needs_dest_copy(screen, gc))
+        return FALSE;
+
+    glamor_get_drawable_deltas(src, pixmap, &src_off_x, &src_off_y);
+    src_off_x += dx;
+    src_off_y += dy;
+
+    src_box = box[0];
+    for (n = 1; n < nbox; n++) {
+        src_box.x1 = min(src_box.x1, box[n].x1);
+        src_box.x2 = max(src_box.x2, box[n].x2);
+        src_box.y1 = min(src_box.y1, box[n].y1);
+        src_box.y2 = max(src_box.y2, box[n].y2);
+    }
+    src_box.x1 = max(src_box.x1 + src_off_x, 0);
+    src_box.y1 = max(src_box.y1 + src_off_y, 0);
+    src_box.x2 = min(src_box.x2 + src_off_x, pixmap->drawable.width);
+    src_box.y2 = min(src_box.y2 + src_off_y, pixmap->drawable.height);
+    if (src_box.x1 >= src_box.x2 || src_box.y1 >= src_box.y2)
+        return FALSE;
+
+    glamor_make_current(glamor_priv);
+
+    if (!gc) {
+        glamor_set_gxcopy(screen);
+    } else if (!dest_read) {
+        if (!glamor_set_alu(screen, gc->alu))
+            return FALSE;
+
+        if (!glamor_set_planemask(screen, gc->depth, gc->planemask))
+            return FALSE;
+    }
+
+    if (bitplane && (!glamor_priv->can_copyplane || dest_read))
+        return FALSE;
+
+    if (bitplane) {
+        prog = &glamor_priv->copy_plane_prog;
+        copy_facet = &glamor_facet_copyplane;
+    } else if (dest_read) {
+        prog = &glamor_priv->copy_area_fetch_prog;
+        copy_facet = &glamor_facet_copyarea;
+    } else {
+        prog = &glamor_priv->copy_area_prog;
+        copy_facet = &glamor_facet_copyarea;
+    }
+
+    if (prog->failed)
+        return FALSE;
+
+    if (!prog->prog) {
+        prog->dest_read = dest_read;
+        if (!glamor_build_program(screen, prog,
+                                  copy_facet, NULL, NULL, NULL))
+            return FALSE;
+    }
+
+    glBindFramebuffer(GL_FRAMEBUFFER, priv->fbo->fb);
+    args.src = glamor_copy_dest_box(glamor_priv, priv->fbo, &src_box,
+                                    GL_TEXTURE0);
+    if (!args.src)
+        return FALSE;
+
+    args.src_pixmap = pixmap;
+    args.bitplane = bitplane;
+    args.dx = src_off_x - src_box.x1;
+    args.dy = src_off_y - src_box.y1;
+
+    if (!glamor_use_program(pixmap, gc, prog, &args))
+        return FALSE;
+
+    v = glamor_get_vbo_space(screen, nbox * 8 * sizeof (int16_t), &vbo_offset);
+
+    glEnableVertexAttribArray(GLAMOR_VERTEX_POS);
+    glVertexAttribPointer(GLAMOR_VERTEX_POS, 2, GL_SHORT, GL_FALSE,
+                          2 * sizeof (GLshort), vbo_offset);
+
+    for (n = 0; n < nbox; n++) {
+        v[0] = box->x1; v[1] = box->y1;
+        v[2] = box->x1; v[3] = box->y2;
+        v[4] = box->x2; v[5] = box->y2;
+        v[6] = box->x2; v[7] = box->y1;
+        v += 8;
+        box++;
+    }
+
+    glamor_put_vbo_space(screen);
+
+    glamor_set_destination_drawable(dst, 0, FALSE, FALSE,
+                                    prog->matrix_uniform, NULL, NULL);
+
+    glamor_glDrawArrays_GL_QUADS(glamor_priv, nbox);
+
+    glDisableVertexAttribArray(GLAMOR_VERTEX_POS);
+
+    return TRUE;
+}
+
+/**
+ * Copies from the CPU to the GPU through a temporary pixmap, so that
+ * the alu and planemask get applied by the GPU copy from there.
+ */
+static Bool
+glamor_copy_cpu_fbo_temp(DrawablePtr src,
+                         DrawablePtr dst,
+                         GCPtr gc,
+                         BoxPtr box,
+                         int nbox,
+                         int dx,
+                         int dy,
+                         Bool reverse,
+                         Bool upsidedown,
+                         Pixel bitplane,
+                         void *closure)
+{
+    ScreenPtr screen = dst->pScreen;
+    PixmapPtr tmp_pixmap;
+    FbBits *src_bits;
+    FbStride src_stride;
+    int src_bpp;
+    int src_xoff, src_yoff;
+    BoxRec bounds;
+    Bool ret;
+    int n;
+
+    if (bitplane)
+        goto bail;
+
+    bounds = box[0];
+    for (n = 1; n < nbox; n++) {
+        bounds.x1 = min(bounds.x1, box[n].x1);
+        bounds.x2 = max(bounds.x2, box[n].x2);
+        bounds.y1 = min(bounds.y1, box[n].y1);
+        bounds.y2 = max(bounds.y2, box[n].y2);
+    }
+
+    tmp_pixmap = glamor_create_pixmap(screen,
+                                      bounds.x2 - bounds.x1,
+                                      bounds.y2 - bounds.y1,
+                                      src->depth, 0);
+    if (!tmp_pixmap)
+        goto bail;
+
+    if (!GLAMOR_PIXMAP_PRIV_HAS_FBO(glamor_get_pixmap_private(tmp_pixmap)))
+        goto bail_pixmap;
+
+    if (!glamor_prepare_access(src, GLAMOR_ACCESS_RO))
+        goto bail_pixmap;
+    fbGetDrawable(src, src_bits, src_stride, src_bpp, src_xoff, src_yoff);
+    glamor_upload_boxes(tmp_pixmap, box, nbox, src_xoff + dx, src_yoff + dy,
+                        -bounds.x1, -bounds.y1,
+                        (uint8_t *) src_bits, src_stride * sizeof (FbBits));
+    glamor_finish_access(src);
+
+    ret = glamor_copy_fbo_fbo_draw(&tmp_pixmap->drawable,
+                                   dst,
+                                   gc,
+                                   box,
+                                   nbox,
+                                   -bounds.x1,
+                                   -bounds.y1,
+                                   FALSE, FALSE,
+                                   0, closure);
+
+    glamor_destroy_pixmap(tmp_pixmap);
+    return ret;
+
+bail_pixmap:
+    glamor_destroy_pixmap(tmp_pixmap);
+bail:
+    return FALSE;
+}
+
 /**
  * Returns TRUE if the copy has to be implemented with
  * glamor_copy_fbo_fbo_temp() instead of glamor_copy_fbo_fbo().
@@ -640,14 +1092,29 @@ glamor_copy_gl(DrawablePtr src,
 
     if (GLAMOR_PIXMAP_PRIV_HAS_FBO(dst_priv)) {
         if (GLAMOR_PIXMAP_PRIV_HAS_FBO(src_priv)) {
-            if (glamor_copy_needs_temp(src, dst, box, nbox, dx, dy))
+            if (glamor_copy_needs_temp(src, dst, box, nbox, dx, dy)) {
+                if (glamor_copy_fbo_fbo_banded(src, dst, gc, box, nbox, dx, dy,
+                                               reverse, upsidedown, bitplane, closure))
+                    return TRUE;
+                if (glamor_copy_fbo_fbo_scratch(src, dst, gc, box, nbox, dx, dy,
+                                                reverse, upsidedown, bitplane, closure))
+                    return TRUE;
                 return glamor_copy_fbo_fbo_temp(src, dst, gc, box, nbox, dx, dy,
                                                 reverse, upsidedown, bitplane, closure);
+            }
+            else if (glamor_copy_fbo_fbo_blit(src, dst, gc, box, nbox, dx, dy,
+                                              reverse, upsidedown, bitplane, closure))
+                return TRUE;
             else
                 return glamor_copy_fbo_fbo_draw(src, dst, gc, box, nbox, dx, dy,
                                                 reverse, upsidedown, bitplane, closure);
         }
 
+        if (gc && (gc->alu != GXcopy ||
+                   !glamor_pm_is_solid(gc->depth, gc->planemask)))
+            return glamor_copy_cpu_fbo_temp(src, dst, gc, box, nbox, dx, dy,
+                                            reverse, upsidedown, bitplane, closure);
+
         return glamor_copy_cpu_fbo(src, dst, gc, box, nbox, dx, dy,
                                    reverse, upsidedown, bitplane, closure);
     } else if (GLAMOR_PIXMAP_PRIV_HAS_FBO(src_priv) &&
@@ -702,6 +1169,111 @@ glamor_copy_plane(DrawablePtr src, DrawablePtr dst, GCPtr gc,
                     dstx, dsty, glamor_copy, bitplane, NULL);
 }
 
+/*
+ * Merges the boxes of a y-x banded region that continue straight down
+ * from a box in the band above, so a window clipped on one side moves
+ * as a few tall boxes rather than one per band. open is scratch space
+ * for 2 * nbox indices. Returns the number of boxes written to out.
+ */
+static int
+glamor_copy_window_bands(const BoxRec *box, int nbox, BoxPtr out, int *open)
+{
+    int *prev = open, *cur = open + nbox, *t;
+    int nprev = 0, ncur, nout = 0;
+    int n = 0, p;
+
+    while (n < nbox) {
+        int y1 = box[n].y1;
+
+        ncur = 0;
+        p = 0;
+        for (; n < nbox && box[n].y1 == y1; n++) {
+            while (p < nprev && out[prev[p]].x1 < box[n].x1)
+                p++;
+            if (p < nprev && out[prev[p]].y2 == y1 &&
+                out[prev[p]].x1 == box[n].x1 && out[prev[p]].x2 == box[n].x2) {
+                out[prev[p]].y2 = box[n].y2;
+                cur[ncur++] = prev[p++];
+            } else {
+                out[nout] = box[n];
+                cur[ncur++] = nout++;
+            }
+        }
+        t = prev;
+        prev = cur;
+        cur = t;
+        nprev = ncur;
+    }
+    return nout;
+}
+
+/*
+ * Moves a window's contents within its pixmap. The region's boxes are
+ * merged into bands first. A move that doesn't overlap its source is
+ * blitted, or drawn straight from the pixmap behind a texture barrier.
+ * Otherwise the source extents are copied into the persistent scratch
+ * destination copy texture, and the bands are drawn from there in a
+ * single call, instead of through a temporary pixmap.
+ */
+static Bool
+glamor_copy_window_gl(PixmapPtr pixmap, RegionPtr region, int dx, int dy)
+{
+    ScreenPtr screen = pixmap->drawable.pScreen;
+    glamor_screen_private *glamor_priv = glamor_get_screen_private(screen);
+    glamor_pixmap_private *priv = glamor_get_pixmap_private(pixmap);
+    DrawablePtr drawable = &pixmap->drawable;
+    BoxPtr extents = RegionExtents(region);
+    BoxPtr box;
+    int *open;
+    int nbox = RegionNumRects(region);
+    Bool ret = FALSE;
+    int n;
+
+    if (!GLAMOR_PIXMAP_PRIV_HAS_FBO(priv) ||
+        !glamor_pixmap_priv_is_small(priv) || !priv->fbo->fb)
+        return FALSE;
+
+    if (nbox == 0)
+        return TRUE;
+
+    box = xallocarray(nbox, sizeof (BoxRec));
+    open = xallocarray(nbox, 2 * sizeof (int));
+    if (!box || !open)
+        goto bail;
+
+    nbox = glamor_copy_window_bands(RegionRects(region), nbox, box, open);
+
+    if (extents->x2 <= extents->x1 + dx || extents->x2 + dx <= extents->x1 ||
+        extents->y2 <= extents->y1 + dy || extents->y2 + dy <= extents->y1) {
+        if (glamor_priv->has_fbo_blit) {
+            glamor_make_current(glamor_priv);
+            glamor_set_gxcopy(screen);
+            glBindFramebuffer(GL_FRAMEBUFFER, priv->fbo->fb);
+            for (n = 0; n < nbox; n++)
+                glBlitFramebuffer(box[n].x1 + dx, box[n].y1 + dy,
+                                  box[n].x2 + dx, box[n].y2 + dy,
+                                  box[n].x1, box[n].y1,
+                                  box[n].x2, box[n].y2,
+                                  GL_COLOR_BUFFER_BIT, GL_NEAREST);
+            ret = TRUE;
+        } else if (glamor_priv->has_nv_texture_barrier) {
+            glamor_make_current(glamor_priv);
+            glTextureBarrierNV();
+            ret = glamor_copy_fbo_fbo_draw(drawable, drawable, NULL, box, nbox,
+                                           dx, dy, FALSE, FALSE, 0, NULL);
+        }
+    }
+
+    if (!ret)
+        ret = glamor_copy_fbo_fbo_scratch(drawable, drawable, NULL, box, nbox,
+                                          dx, dy, FALSE, FALSE, 0, NULL);
+
+bail:
+    free(open);
+    free(box);
+    return ret;
+}
+
 void
 glamor_copy_window(WindowPtr window, DDXPointRec old_origin, RegionPtr src_region)
 {
@@ -723,8 +1295,9 @@ glamor_copy_window(WindowPtr window, DDXPointRec old_origin, RegionPtr src_regio
         RegionTranslate(&dst_region, -pixmap->screen_x, -pixmap->screen_y);
 #endif
 
-    miCopyRegion(drawable, drawable,
-                 0, &dst_region, dx, dy, glamor_copy, 0, 0);
+    if (!glamor_copy_window_gl(pixmap, &dst_region, dx, dy))
+        miCopyRegion(drawable, drawable,
+                     0, &dst_region, dx, dy, glamor_copy, 0, 0);
 
     RegionUninit(&dst_region);
 }
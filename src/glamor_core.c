@@ -132,7 +132,7 @@ static GCOps glamor_gc_ops = {
     .PolyText16 = glamor_poly_text16,
     .ImageText8 = glamor_image_text8,
     .ImageText16 = glamor_image_text16,
-    .ImageGlyphBlt = miImageGlyphBlt,
+    .ImageGlyphBlt = glamor_image_glyph_blt,
     .PolyGlyphBlt = glamor_poly_glyph_blt,
     .PushPixels = glamor_push_pixels,
 };
@@ -168,6 +168,12 @@ glamor_dash_setup(DrawablePtr drawable, GCPtr gc)
 
         prog = &glamor_priv->double_dash_line_prog;
 
+        if (!glamor_set_alu(screen, gc->alu))
+            goto bail;
+
+        if (!glamor_set_planemask(screen, gc->depth, gc->planemask))
+            goto bail;
+
         if (!prog->prog) {
             if (!glamor_build_program(screen, prog,
                                       &glamor_facet_double_dash_lines,
@@ -253,6 +259,10 @@ glamor_poly_lines_dash_gl(DrawablePtr drawable, GCPtr gc,
     if (n < 2)
         return TRUE;
 
+    if (glamor_gc_needs_dest_copy(screen, gc) &&
+        !glamor_set_dest_copy_bounds_lines(drawable, gc, mode, n, points))
+        return FALSE;
+
     if (!(prog = glamor_dash_setup(drawable, gc)))
         return FALSE;
 
@@ -328,6 +338,10 @@ glamor_poly_segment_dash_gl(DrawablePtr drawable, GCPtr gc,
     int add_last;
     int i;
 
+    if (glamor_gc_needs_dest_copy(screen, gc) &&
+        !glamor_set_dest_copy_bounds_segments(drawable, gc, nseg, segs))
+        return FALSE;
+
     if (!(prog = glamor_dash_setup(drawable, gc)))
         return FALSE;
 
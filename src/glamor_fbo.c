@@ -161,6 +161,50 @@ glamor_create_fbo(glamor_screen_private *glamor_priv,
     return glamor_create_fbo_from_tex(glamor_priv, w, h, format, tex, flag);
 }
 
+/**
+ * Copies the box (in coordinates of fbo, which must be bound for
+ * reading) into the screen's scratch destination copy, growing it as
+ * needed, and leaves the copy bound to the given texture unit. Used
+ * by shaders that need to read the destination they are drawing to.
+ */
+glamor_pixmap_fbo *
+glamor_copy_dest_box(glamor_screen_private *glamor_priv,
+                     glamor_pixmap_fbo *fbo, const BoxRec *box, GLenum unit)
+{
+    glamor_pixmap_fbo *copy = glamor_priv->dest_copy_fbo;
+    int w = box->x2 - box->x1, h = box->y2 - box->y1;
+
+    if (copy && (copy->format != fbo->format ||
+                 copy->width < w || copy->height < h)) {
+        /* Grow rather than shrink to avoid thrashing. */
+        if (copy->format == fbo->format) {
+            w = MAX(w, copy->width);
+            h = MAX(h, copy->height);
+        }
+        glamor_destroy_fbo(glamor_priv, copy);
+        copy = NULL;
+    }
+    if (!copy)
+        copy = glamor_create_fbo(glamor_priv, w, h, fbo->format,
+                                 GLAMOR_CREATE_FBO_NO_FBO);
+
+    if (copy && !copy->tex) {
+        glamor_destroy_fbo(glamor_priv, copy);
+        copy = NULL;
+    }
+    glamor_priv->dest_copy_fbo = copy;
+    if (!copy) {
+        glamor_fallback("failed to allocate destination copy\n");
+        return NULL;
+    }
+
+    glActiveTexture(unit);
+    glBindTexture(GL_TEXTURE_2D, copy->tex);
+    glCopyTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, box->x1, box->y1,
+                        box->x2 - box->x1, box->y2 - box->y1);
+    return copy;
+}
+
 /**
  * Create storage for the w * h region, using FBOs of the GL's maximum
  * supported size.
@@ -281,6 +325,8 @@ glamor_pixmap_destroy_fbo(PixmapPtr pixmap)
     glamor_pixmap_private *priv = glamor_get_pixmap_private(pixmap);
     glamor_pixmap_fbo *fbo;
 
+    glamor_text_flush_pixmap(pixmap);
+
     if (glamor_pixmap_priv_is_large(priv)) {
         int i;
 
@@ -335,6 +381,9 @@ glamor_pixmap_exchange_fbos(PixmapPtr front, PixmapPtr back)
     glamor_pixmap_private *front_priv, *back_priv;
     glamor_pixmap_fbo *temp_fbo;
 
+    glamor_text_flush_pixmap(front);
+    glamor_text_flush_pixmap(back);
+
     front_priv = glamor_get_pixmap_private(front);
     back_priv = glamor_get_pixmap_private(back);
     temp_fbo = front_priv->fbo;
@@ -28,6 +28,41 @@ static int glamor_font_generation;
 static int glamor_font_private_index;
 static int glamor_font_screen_count;
 
+/*
+ * Without integer textures (GLSL 1.20 and GLES2), the font is stored
+ * with each bit expanded to a byte, so that the shader can sample it
+ * directly
+ */
+static Bool
+glamor_font_use_a8(glamor_screen_private *glamor_priv)
+{
+    return glamor_priv->glsl_version < 130;
+}
+
+static char *
+glamor_font_expand_a8(char *bits, int width, int height)
+{
+    unsigned char       *src = (unsigned char *) bits;
+    unsigned char       *a8, *dst;
+    int                 i, b;
+
+    a8 = xallocarray(width * 8, height);
+    if (!a8)
+        return NULL;
+
+    dst = a8;
+    for (i = 0; i < width * height; i++) {
+        for (b = 0; b < 8; b++) {
+#if BITMAP_BIT_ORDER == MSBFirst
+            *dst++ = (src[i] & (0x80 >> b)) ? 0xff : 0x00;
+#else
+            *dst++ = (src[i] & (1 << b)) ? 0xff : 0x00;
+#endif
+        }
+    }
+    return (char *) a8;
+}
+
 glamor_font_t *
 glamor_font_get(ScreenPtr screen, FontPtr font)
 {
@@ -35,20 +70,19 @@ glamor_font_get(ScreenPtr screen, FontPtr font)
 
     glamor_font_t       *privates;
     glamor_font_t       *glamor_font;
-    int                 overall_width, overall_height;
+    Bool                a8 = glamor_font_use_a8(glamor_priv);
     int                 num_rows;
     int                 num_cols;
+    int                 rows_per_page;
+    int                 cols_per_strip;
+    int                 strips_per_row;
+    int                 row_height;
     int                 glyph_width_pixels;
     int                 glyph_width_bytes;
     int                 glyph_height;
-    int                 row, col;
     unsigned char       c[2];
     CharInfoPtr         glyph;
     unsigned long       count;
-    char                *bits;
-
-    if (glamor_priv->glsl_version < 130)
-        return NULL;
 
     privates = FontGetPrivate(font, glamor_font_private_index);
     if (!privates) {
@@ -71,6 +105,9 @@ glamor_font_get(ScreenPtr screen, FontPtr font)
     glyph_width_pixels = font->info.maxbounds.rightSideBearing - font->info.minbounds.leftSideBearing;
     glyph_height = font->info.maxbounds.ascent + font->info.maxbounds.descent;
 
+    if (glyph_width_pixels <= 0 || glyph_height <= 0)
+        return NULL;
+
     glyph_width_bytes = (glyph_width_pixels + 7) >> 3;
 
     glamor_font->glyph_width_pixels = glyph_width_pixels;
@@ -78,27 +115,45 @@ glamor_font_get(ScreenPtr screen, FontPtr font)
     glamor_font->glyph_height = glyph_height;
 
     /*
-     * Layout the font two blocks of columns wide.
-     * This avoids a problem with some fonts that are too high to fit.
+     * Layout the font one row of glyphs per strip, with a few rows
+     * stacked in each texture page. A row too wide for a texture
+     * wraps onto several strips. Pages are only allocated, and rows
+     * only painted, when text first uses them.
      */
-    glamor_font->row_width = glyph_width_bytes * num_cols;
-
-    if (num_rows > 1) {
-       overall_width = glamor_font->row_width * 2;
-       overall_height = glyph_height * ((num_rows + 1) / 2);
-    } else {
-       overall_width = glamor_font->row_width;
-       overall_height = glyph_height;
+    cols_per_strip = glamor_priv->max_fbo_size /
+        (a8 ? glyph_width_bytes * 8 : glyph_width_bytes);
+    cols_per_strip = MIN(cols_per_strip, num_cols);
+    if (cols_per_strip == 0) {
+        /* fallback if a glyph doesn't fit inside a texture */
+        return NULL;
     }
+    strips_per_row = (num_cols + cols_per_strip - 1) / cols_per_strip;
+    row_height = strips_per_row * glyph_height;
+
+    glamor_font->cols_per_strip = cols_per_strip;
+    glamor_font->strips_per_row = strips_per_row;
+    glamor_font->row_width = glyph_width_bytes * cols_per_strip;
+    glamor_font->page_width = a8 ? glamor_font->row_width * 8 : glamor_font->row_width;
+
+    rows_per_page = MIN(num_rows, GLAMOR_FONT_PAGE_ROWS);
+    if (rows_per_page > glamor_priv->max_fbo_size / row_height)
+        rows_per_page = glamor_priv->max_fbo_size / row_height;
 
-    if (overall_width > glamor_priv->max_fbo_size ||
-        overall_height > glamor_priv->max_fbo_size) {
+    if (rows_per_page == 0) {
         /* fallback if we don't fit inside a texture */
         return NULL;
     }
-    bits = malloc(overall_width * overall_height);
-    if (!bits)
+
+    glamor_font->rows_per_page = rows_per_page;
+    glamor_font->page_height = rows_per_page * row_height;
+    glamor_font->num_pages = (num_rows + rows_per_page - 1) / rows_per_page;
+    glamor_font->page_texture = calloc(glamor_font->num_pages, sizeof (GLuint));
+    if (!glamor_font->page_texture)
         return NULL;
+    memset(glamor_font->row_loaded, 0, sizeof (glamor_font->row_loaded));
+    glamor_font->num_chars = 0;
+    glamor_font->size_chars = 0;
+    glamor_font->chars_rows = 0;
 
     /* Check whether the font has a default character */
     c[0] = font->info.lastRow + 1;
@@ -109,59 +164,210 @@ glamor_font_get(ScreenPtr screen, FontPtr font)
     glamor_font->default_row = font->info.defaultCh >> 8;
     glamor_font->default_col = font->info.defaultCh;
 
-    glamor_priv = glamor_get_screen_private(screen);
-    glamor_make_current(glamor_priv);
+    glamor_font->realized = TRUE;
+
+    return glamor_font;
+}
+
+/*
+ * Make sure one row of glyphs, counted from the first row of the
+ * font, is in its texture page, allocating the page as needed
+ */
+Bool
+glamor_font_load_row(ScreenPtr screen, FontPtr font,
+                     glamor_font_t *glamor_font, int row)
+{
+    glamor_screen_private *glamor_priv = glamor_get_screen_private(screen);
+    Bool                a8 = glamor_font_use_a8(glamor_priv);
+    int                 page = row / glamor_font->rows_per_page;
+    int                 num_cols = font->info.lastCol - font->info.firstCol + 1;
+    int                 glyph_width_bytes = glamor_font->glyph_width_bytes;
+    int                 glyph_height = glamor_font->glyph_height;
+    int                 row_width = glamor_font->row_width;
+    int                 cols_per_strip = glamor_font->cols_per_strip;
+    int                 row_height = glamor_font->strips_per_row * glyph_height;
+    GLenum              format;
+    int                 col;
+    unsigned char       c[2];
+    CharInfoPtr         glyph;
+    unsigned long       count;
+    char                *bits;
+
+    if (glamor_font->row_loaded[row >> 5] & (1U << (row & 31)))
+        return TRUE;
+
+    if (a8)
+        format = glamor_priv->one_channel_format;
+    else
+        format = GL_RED_INTEGER;
 
-    glGenTextures(1, &glamor_font->texture_id);
     glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, glamor_font->texture_id);
-
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-
-    /* Paint all of the glyphs */
-    for (row = 0; row < num_rows; row++) {
-        for (col = 0; col < num_cols; col++) {
-            c[0] = row + font->info.firstRow;
-            c[1] = col + font->info.firstCol;
-
-            (*font->get_glyphs)(font, 1, c, TwoD16Bit, &count, &glyph);
-
-            if (count) {
-                char *dst;
-                char *src = glyph->bits;
-                unsigned y;
-
-                dst = bits;
-                /* get offset of start of first row */
-                dst += (row / 2) * glyph_height * overall_width;
-                /* add offset into second row */
-                dst += (row & 1) ? glamor_font->row_width : 0;
-
-                dst += col * glyph_width_bytes;
-                for (y = 0; y < GLYPHHEIGHTPIXELS(glyph); y++) {
-                    memcpy(dst, src, GLYPHWIDTHBYTES(glyph));
-                    dst += overall_width;
-                    src += GLYPHWIDTHBYTESPADDED(glyph);
-                }
+
+    if (!glamor_font->page_texture[page]) {
+        glGenTextures(1, &glamor_font->page_texture[page]);
+        glBindTexture(GL_TEXTURE_2D, glamor_font->page_texture[page]);
+
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        if (format == GL_RED)
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_A, GL_RED);
+
+        glamor_priv->suppress_gl_out_of_memory_logging = true;
+        glTexImage2D(GL_TEXTURE_2D, 0, a8 ? format : GL_R8UI,
+                     glamor_font->page_width, glamor_font->page_height,
+                     0, format, GL_UNSIGNED_BYTE, NULL);
+        glamor_priv->suppress_gl_out_of_memory_logging = false;
+        if (glGetError() == GL_OUT_OF_MEMORY) {
+            glDeleteTextures(1, &glamor_font->page_texture[page]);
+            glamor_font->page_texture[page] = 0;
+            return FALSE;
+        }
+    } else
+        glBindTexture(GL_TEXTURE_2D, glamor_font->page_texture[page]);
+
+    bits = calloc(row_height, row_width);
+    if (!bits)
+        return FALSE;
+
+    /* Paint the glyphs of the row, strip by strip */
+    for (col = 0; col < num_cols; col++) {
+        c[0] = row + font->info.firstRow;
+        c[1] = col + font->info.firstCol;
+
+        (*font->get_glyphs)(font, 1, c, TwoD16Bit, &count, &glyph);
+
+        if (count) {
+            char *dst = bits +
+                (col / cols_per_strip) * glyph_height * row_width +
+                (col % cols_per_strip) * glyph_width_bytes;
+            char *src = glyph->bits;
+            unsigned y;
+
+            for (y = 0; y < GLYPHHEIGHTPIXELS(glyph); y++) {
+                memcpy(dst, src, GLYPHWIDTHBYTES(glyph));
+                dst += row_width;
+                src += GLYPHWIDTHBYTESPADDED(glyph);
             }
         }
     }
 
-    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    if (a8) {
+        char *a8_bits = glamor_font_expand_a8(bits, row_width, row_height);
 
-    glamor_priv->suppress_gl_out_of_memory_logging = true;
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_R8UI, overall_width, overall_height,
-                 0, GL_RED_INTEGER, GL_UNSIGNED_BYTE, bits);
-    glamor_priv->suppress_gl_out_of_memory_logging = false;
-    if (glGetError() == GL_OUT_OF_MEMORY)
-        return NULL;
+        free(bits);
+        if (!a8_bits)
+            return FALSE;
+        bits = a8_bits;
+    }
 
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTexSubImage2D(GL_TEXTURE_2D, 0,
+                    0, (row % glamor_font->rows_per_page) * row_height,
+                    glamor_font->page_width, row_height,
+                    format, GL_UNSIGNED_BYTE, bits);
     free(bits);
 
-    glamor_font->realized = TRUE;
+    glamor_font->row_loaded[row >> 5] |= 1U << (row & 31);
+    return TRUE;
+}
 
-    return glamor_font;
+static int
+glamor_font_char_compare(const void *a, const void *b)
+{
+    const glamor_font_char *ca = a, *cb = b;
+
+    if (ca->ci == cb->ci)
+        return 0;
+    return (uintptr_t) ca->ci < (uintptr_t) cb->ci ? -1 : 1;
+}
+
+/*
+ * Add the glyphs of one row to the table, noting where ci is if it's
+ * there. Codes the font lacks come back as the default character,
+ * which is only recorded at its own code.
+ */
+static Bool
+glamor_font_add_row(FontPtr font, glamor_font_t *glamor_font, int r,
+                    CharInfoPtr ci, int *row, int *col, Bool *found)
+{
+    int             num_cols = font->info.lastCol - font->info.firstCol + 1;
+    int             c;
+    unsigned char   code[2];
+    CharInfoPtr     glyph;
+    unsigned long   count;
+
+    for (c = 0; c < num_cols; c++) {
+        glamor_font_char *entry;
+
+        code[0] = r + font->info.firstRow;
+        code[1] = c + font->info.firstCol;
+
+        (*font->get_glyphs)(font, 1, code, TwoD16Bit, &count, &glyph);
+        if (!count || !glyph)
+            continue;
+        if (glyph == glamor_font->default_char &&
+            (code[0] != glamor_font->default_row ||
+             code[1] != glamor_font->default_col))
+            continue;
+
+        if (glamor_font->num_chars == glamor_font->size_chars) {
+            int size = glamor_font->size_chars ? glamor_font->size_chars * 2 : 256;
+
+            entry = reallocarray(glamor_font->chars, size, sizeof (glamor_font_char));
+            if (!entry)
+                return FALSE;
+            glamor_font->chars = entry;
+            glamor_font->size_chars = size;
+        }
+
+        entry = &glamor_font->chars[glamor_font->num_chars++];
+        entry->ci = glyph;
+        entry->row = r;
+        entry->col = c;
+
+        if (glyph == ci && !*found) {
+            *row = r;
+            *col = c;
+            *found = TRUE;
+        }
+    }
+    return TRUE;
+}
+
+/*
+ * Find the row and column, counted from the first ones in the font,
+ * of a glyph given only its CharInfo. The table is filled in a row at
+ * a time, only as far as needed to find the glyph
+ */
+Bool
+glamor_font_find_char(FontPtr font, glamor_font_t *glamor_font,
+                      CharInfoPtr ci, int *row, int *col)
+{
+    int                 num_rows = font->info.lastRow - font->info.firstRow + 1;
+    int                 num_chars = glamor_font->num_chars;
+    glamor_font_char    key, *found;
+    Bool                in_row = FALSE;
+
+    key.ci = ci;
+    found = bsearch(&key, glamor_font->chars, glamor_font->num_chars,
+                    sizeof (glamor_font_char), glamor_font_char_compare);
+    if (found) {
+        *row = found->row;
+        *col = found->col;
+        return TRUE;
+    }
+
+    while (!in_row && glamor_font->chars_rows < num_rows) {
+        if (!glamor_font_add_row(font, glamor_font, glamor_font->chars_rows,
+                                 ci, row, col, &in_row))
+            break;
+        glamor_font->chars_rows++;
+    }
+
+    if (glamor_font->num_chars != num_chars)
+        qsort(glamor_font->chars, glamor_font->num_chars,
+              sizeof (glamor_font_char), glamor_font_char_compare);
+    return in_row;
 }
 
 static Bool
@@ -186,12 +392,16 @@ glamor_unrealize_font(ScreenPtr screen, FontPtr font)
     if (!glamor_font->realized)
         return TRUE;
 
-    /* Unrealize the font, freeing the allocated texture */
+    /* Unrealize the font, freeing the allocated texture pages */
     glamor_font->realized = FALSE;
 
     glamor_priv = glamor_get_screen_private(screen);
     glamor_make_current(glamor_priv);
-    glDeleteTextures(1, &glamor_font->texture_id);
+    glDeleteTextures(glamor_font->num_pages, glamor_font->page_texture);
+    free(glamor_font->page_texture);
+    glamor_font->page_texture = NULL;
+    free(glamor_font->chars);
+    glamor_font->chars = NULL;
 
     /* Check to see if all of the screens are  done with this font
      * and free the private when that happens
@@ -208,11 +418,6 @@ glamor_unrealize_font(ScreenPtr screen, FontPtr font)
 Bool
 glamor_font_init(ScreenPtr screen)
 {
-    glamor_screen_private *glamor_priv = glamor_get_screen_private(screen);
-
-    if (glamor_priv->glsl_version < 130)
-        return TRUE;
-
     if (glamor_font_generation != serverGeneration) {
         glamor_font_private_index = xfont2_allocate_font_private_index();
         if (glamor_font_private_index == -1)
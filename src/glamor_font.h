@@ -23,13 +23,34 @@
 #ifndef _GLAMOR_FONT_H_
 #define _GLAMOR_FONT_H_
 
+/* Rows of glyphs held in each font texture page */
+#define GLAMOR_FONT_PAGE_ROWS   16
+
+/* Where a glyph is in the font, for callers which only have its CharInfo */
+typedef struct {
+    CharInfoPtr ci;
+    CARD8       row;
+    CARD8       col;
+} glamor_font_char;
+
 typedef struct {
     Bool        realized;
     CharInfoPtr default_char;
     CARD8       default_row;
     CARD8       default_col;
 
-    GLuint      texture_id;
+    GLuint      *page_texture;
+    GLuint      num_pages;
+    GLuint      rows_per_page;
+    GLuint      cols_per_strip;
+    GLuint      strips_per_row;
+    GLuint      page_width;
+    GLuint      page_height;
+    CARD32      row_loaded[256 / 32];
+    glamor_font_char    *chars;
+    int         num_chars;
+    int         size_chars;
+    int         chars_rows;
     GLuint      row_width;
     CARD16      glyph_width_bytes;
     CARD16      glyph_width_pixels;
@@ -40,6 +61,14 @@ typedef struct {
 glamor_font_t *
 glamor_font_get(ScreenPtr screen, FontPtr font);
 
+Bool
+glamor_font_load_row(ScreenPtr screen, FontPtr font,
+                     glamor_font_t *glamor_font, int row);
+
+Bool
+glamor_font_find_char(FontPtr font, glamor_font_t *glamor_font,
+                      CharInfoPtr ci, int *row, int *col);
+
 Bool
 glamor_font_init(ScreenPtr screen);
 
@@ -30,13 +30,131 @@
 #include <dixfontstr.h>
 #include "glamor_transform.h"
 
+/*
+ * Glyphs and bitmaps are expanded to a byte per pixel, packed side by
+ * side into a scratch texture and drawn as one quad each, discarding
+ * the unset pixels
+ */
 static const glamor_facet glamor_facet_poly_glyph_blt = {
     .name = "poly_glyph_blt",
-    .vs_vars = "attribute vec2 primitive;\n",
-    .vs_exec = ("       vec2 pos = vec2(0,0);\n"
-                GLAMOR_POS(gl_Position, primitive)),
+    .vs_vars = ("attribute vec2 primitive;\n"
+                "attribute vec2 source;\n"
+                "varying vec2 bitmap_pos;\n"),
+    .vs_exec = (GLAMOR_POS(gl_Position, primitive)
+                "       bitmap_pos = source * font_size_inv;\n"),
+    .fs_vars = "varying vec2 bitmap_pos;\n",
+    .fs_exec = ("       if (texture2D(font, bitmap_pos).w == 0.0)\n"
+                "               discard;\n"),
+    .source_name = "source",
+    .locations = glamor_program_location_font_a8,
 };
 
+typedef struct {
+    int         x, y;           /* destination, in screen coordinates */
+    int         w, h;
+    int         tx;             /* position in the strip */
+} glamor_bitmap_quad;
+
+static void
+glamor_bitmap_expand(uint8_t *dst, int dst_stride,
+                     const uint8_t *src, int src_stride, int w, int h)
+{
+    int xx, yy;
+
+    for (yy = 0; yy < h; yy++) {
+        for (xx = 0; xx < w; xx++) {
+#if BITMAP_BIT_ORDER == MSBFirst
+            dst[xx] = (src[xx >> 3] & (0x80 >> (xx & 7))) ? 0xff : 0x00;
+#else
+            dst[xx] = (src[xx >> 3] & (1 << (xx & 7))) ? 0xff : 0x00;
+#endif
+        }
+        dst += dst_stride;
+        src += src_stride;
+    }
+}
+
+static void
+glamor_bitmap_draw(DrawablePtr drawable, GCPtr gc, glamor_program *prog,
+                   uint8_t *strip, int strip_w, int strip_h,
+                   glamor_bitmap_quad *quads, int nquad)
+{
+    ScreenPtr screen = drawable->pScreen;
+    glamor_screen_private *glamor_priv = glamor_get_screen_private(screen);
+    PixmapPtr pixmap = glamor_get_drawable_pixmap(drawable);
+    glamor_pixmap_private *pixmap_priv = glamor_get_pixmap_private(pixmap);
+    GLenum format = glamor_priv->one_channel_format;
+    GLuint tex;
+    GLshort *v;
+    char *vbo_offset;
+    int box_index;
+    int off_x, off_y;
+    int n;
+
+    glActiveTexture(GL_TEXTURE1);
+    glGenTextures(1, &tex);
+    glBindTexture(GL_TEXTURE_2D, tex);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    if (format == GL_RED)
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_A, GL_RED);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTexImage2D(GL_TEXTURE_2D, 0, format, strip_w, strip_h, 0,
+                 format, GL_UNSIGNED_BYTE, strip);
+
+    glUniform1i(prog->font_uniform, 1);
+    glUniform2f(prog->font_size_inv_uniform, 1.0f / strip_w, 1.0f / strip_h);
+
+    v = glamor_get_vbo_space(screen, nquad * (16 * sizeof (GLshort)), &vbo_offset);
+
+    glEnableVertexAttribArray(GLAMOR_VERTEX_POS);
+    glVertexAttribPointer(GLAMOR_VERTEX_POS, 2, GL_SHORT, GL_FALSE,
+                          4 * sizeof (GLshort), vbo_offset);
+
+    glEnableVertexAttribArray(GLAMOR_VERTEX_SOURCE);
+    glVertexAttribPointer(GLAMOR_VERTEX_SOURCE, 2, GL_SHORT, GL_FALSE,
+                          4 * sizeof (GLshort), vbo_offset + 2 * sizeof (GLshort));
+
+    for (n = 0; n < nquad; n++) {
+        glamor_bitmap_quad *q = &quads[n];
+
+        v[ 0] = q->x;           v[ 1] = q->y;
+        v[ 2] = q->tx;          v[ 3] = 0;
+        v[ 4] = q->x + q->w;    v[ 5] = q->y;
+        v[ 6] = q->tx + q->w;   v[ 7] = 0;
+        v[ 8] = q->x + q->w;    v[ 9] = q->y + q->h;
+        v[10] = q->tx + q->w;   v[11] = q->h;
+        v[12] = q->x;           v[13] = q->y + q->h;
+        v[14] = q->tx;          v[15] = q->h;
+        v += 16;
+    }
+    glamor_put_vbo_space(screen);
+
+    glEnable(GL_SCISSOR_TEST);
+
+    glamor_pixmap_loop(pixmap_priv, box_index) {
+        BoxPtr box = RegionRects(gc->pCompositeClip);
+        int nbox = RegionNumRects(gc->pCompositeClip);
+
+        glamor_set_destination_drawable(drawable, box_index, FALSE, FALSE,
+                                        prog->matrix_uniform, &off_x, &off_y);
+
+        while (nbox--) {
+            glScissor(box->x1 + off_x,
+                      box->y1 + off_y,
+                      box->x2 - box->x1,
+                      box->y2 - box->y1);
+            box++;
+            glamor_glDrawArrays_GL_QUADS(glamor_priv, nquad);
+        }
+    }
+
+    glDisable(GL_SCISSOR_TEST);
+    glDisableVertexAttribArray(GLAMOR_VERTEX_SOURCE);
+    glDisableVertexAttribArray(GLAMOR_VERTEX_POS);
+    glDeleteTextures(1, &tex);
+}
+
 static Bool
 glamor_poly_glyph_blt_gl(DrawablePtr drawable, GCPtr gc,
                          int start_x, int y, unsigned int nglyph,
@@ -47,99 +165,118 @@ glamor_poly_glyph_blt_gl(DrawablePtr drawable, GCPtr gc,
     PixmapPtr pixmap = glamor_get_drawable_pixmap(drawable);
     glamor_pixmap_private *pixmap_priv;
     glamor_program *prog;
-    RegionPtr clip = gc->pCompositeClip;
-    int box_index;
+    glamor_bitmap_quad *quads;
+    uint8_t *strip;
+    int strip_w = 0, strip_h = 0;
+    int max_w = glamor_priv->max_fbo_size;
+    int x, n, nquad, tx;
 
     pixmap_priv = glamor_get_pixmap_private(pixmap);
     if (!GLAMOR_PIXMAP_PRIV_HAS_FBO(pixmap_priv))
         goto bail;
 
-    glamor_make_current(glamor_priv);
+    /* Glyphs from the GC font are already in the font texture */
+    if (glamor_poly_glyph_blt_text(drawable, gc, start_x, y, nglyph, ppci))
+        return TRUE;
 
-    prog = glamor_use_program_fill(pixmap, gc,
-                                   &glamor_priv->poly_glyph_blt_progs,
-                                   &glamor_facet_poly_glyph_blt);
-    if (!prog)
-        goto bail;
+    /* Size the strip, checking that every glyph fits before drawing
+     * any of them
+     */
+    for (n = 0; n < nglyph; n++) {
+        int w = GLYPHWIDTHPIXELS(ppci[n]);
+        int h = GLYPHHEIGHTPIXELS(ppci[n]);
+
+        if (w > max_w || h > glamor_priv->max_fbo_size)
+            goto bail;
+        strip_w = min(strip_w + w, max_w);
+        strip_h = max(strip_h, h);
+    }
+    if (!strip_w || !strip_h)
+        return TRUE;
 
-    glEnableVertexAttribArray(GLAMOR_VERTEX_POS);
+    quads = xallocarray(nglyph, sizeof (glamor_bitmap_quad));
+    if (!quads)
+        goto bail;
+    strip = xallocarray(strip_w, strip_h);
+    if (!strip) {
+        free(quads);
+        goto bail;
+    }
 
     start_x += drawable->x;
     y += drawable->y;
 
-    glamor_pixmap_loop(pixmap_priv, box_index) {
-        int x;
-        int n;
-        int num_points, max_points;
-        INT16 *points = NULL;
-        int off_x, off_y;
-        char *vbo_offset;
-
-        glamor_set_destination_drawable(drawable, box_index, FALSE, TRUE,
-                                        prog->matrix_uniform, &off_x, &off_y);
+    glamor_make_current(glamor_priv);
 
-        max_points = 500;
-        num_points = 0;
+    if (glamor_gc_needs_dest_copy(screen, gc)) {
+        glamor_dest_bounds bounds;
+
+        glamor_dest_bounds_init(&bounds);
         x = start_x;
         for (n = 0; n < nglyph; n++) {
             CharInfoPtr charinfo = ppci[n];
-            int w = GLYPHWIDTHPIXELS(charinfo);
-            int h = GLYPHHEIGHTPIXELS(charinfo);
-            uint8_t *glyphbits = FONTGLYPHBITS(NULL, charinfo);
-
-            if (w && h) {
-                int glyph_x = x + charinfo->metrics.leftSideBearing;
-                int glyph_y = y - charinfo->metrics.ascent;
-                int glyph_stride = GLYPHWIDTHBYTESPADDED(charinfo);
-                int xx, yy;
-
-                for (yy = 0; yy < h; yy++) {
-                    uint8_t *glyph = glyphbits;
-                    for (xx = 0; xx < w; glyph += ((xx&7) == 7), xx++) {
-                        int pt_x_i = glyph_x + xx;
-                        int pt_y_i = glyph_y + yy;
-
-                        if (!(*glyph & (1 << (xx & 7))))
-                            continue;
-
-                        if (!RegionContainsPoint(clip, pt_x_i, pt_y_i, NULL))
-                            continue;
-
-                        if (!num_points) {
-                            points = glamor_get_vbo_space(screen,
-                                                          max_points *
-                                                          (2 * sizeof (INT16)),
-                                                          &vbo_offset);
-
-                            glVertexAttribPointer(GLAMOR_VERTEX_POS,
-                                                  2, GL_SHORT,
-                                                  GL_FALSE, 0, vbo_offset);
-                        }
-
-                        *points++ = pt_x_i;
-                        *points++ = pt_y_i;
-                        num_points++;
-
-                        if (num_points == max_points) {
-                            glamor_put_vbo_space(screen);
-                            glDrawArrays(GL_POINTS, 0, num_points);
-                            num_points = 0;
-                        }
-                    }
-                    glyphbits += glyph_stride;
-                }
-            }
+            int x1 = x + charinfo->metrics.leftSideBearing;
+            int y1 = y - charinfo->metrics.ascent;
+
+            glamor_dest_bounds_add(&bounds, x1, y1,
+                                   x1 + GLYPHWIDTHPIXELS(charinfo),
+                                   y1 + GLYPHHEIGHTPIXELS(charinfo));
             x += charinfo->metrics.characterWidth;
         }
+        if (!glamor_set_dest_copy_bounds(drawable, gc, &bounds)) {
+            free(strip);
+            free(quads);
+            goto bail;
+        }
+    }
 
-        if (num_points) {
-            glamor_put_vbo_space(screen);
-            glDrawArrays(GL_POINTS, 0, num_points);
+    prog = glamor_use_program_fill(pixmap, gc,
+                                   &glamor_priv->poly_glyph_blt_progs,
+                                   &glamor_facet_poly_glyph_blt);
+    if (!prog) {
+        free(strip);
+        free(quads);
+        goto bail;
+    }
+
+    x = start_x;
+    nquad = 0;
+    tx = 0;
+    for (n = 0; n < nglyph; n++) {
+        CharInfoPtr charinfo = ppci[n];
+        int w = GLYPHWIDTHPIXELS(charinfo);
+        int h = GLYPHHEIGHTPIXELS(charinfo);
+
+        if (w && h) {
+            /* Strip full? Draw what's in it and start over */
+            if (tx + w > strip_w) {
+                glamor_bitmap_draw(drawable, gc, prog, strip, strip_w, strip_h,
+                                   quads, nquad);
+                nquad = 0;
+                tx = 0;
+            }
+
+            glamor_bitmap_expand(strip + tx, strip_w,
+                                 FONTGLYPHBITS(NULL, charinfo),
+                                 GLYPHWIDTHBYTESPADDED(charinfo), w, h);
+
+            quads[nquad].x = x + charinfo->metrics.leftSideBearing;
+            quads[nquad].y = y - charinfo->metrics.ascent;
+            quads[nquad].w = w;
+            quads[nquad].h = h;
+            quads[nquad].tx = tx;
+            nquad++;
+            tx += w;
         }
+        x += charinfo->metrics.characterWidth;
     }
 
-    glDisableVertexAttribArray(GLAMOR_VERTEX_POS);
+    if (nquad)
+        glamor_bitmap_draw(drawable, gc, prog, strip, strip_w, strip_h,
+                           quads, nquad);
 
+    free(strip);
+    free(quads);
     return TRUE;
 bail:
     return FALSE;
@@ -165,69 +302,60 @@ glamor_push_pixels_gl(GCPtr gc, PixmapPtr bitmap,
     glamor_screen_private *glamor_priv = glamor_get_screen_private(screen);
     PixmapPtr pixmap = glamor_get_drawable_pixmap(drawable);
     glamor_pixmap_private *pixmap_priv;
-    uint8_t *bitmap_data = bitmap->devPrivate.ptr;
-    int bitmap_stride = bitmap->devKind;
     glamor_program *prog;
-    RegionPtr clip = gc->pCompositeClip;
-    int box_index;
-    int yy, xx;
-    int num_points;
-    INT16 *points = NULL;
-    char *vbo_offset;
+    glamor_bitmap_quad quad;
+    uint8_t *strip;
 
-    if (w * h > MAXINT / (2 * sizeof(float)))
+    if (w <= 0 || h <= 0)
+        return TRUE;
+
+    if (w > glamor_priv->max_fbo_size || h > glamor_priv->max_fbo_size)
         goto bail;
 
     pixmap_priv = glamor_get_pixmap_private(pixmap);
     if (!GLAMOR_PIXMAP_PRIV_HAS_FBO(pixmap_priv))
         goto bail;
 
+    strip = xallocarray(w, h);
+    if (!strip)
+        goto bail;
+
     glamor_make_current(glamor_priv);
 
+    if (glamor_gc_needs_dest_copy(screen, gc)) {
+        glamor_dest_bounds bounds;
+
+        glamor_dest_bounds_init(&bounds);
+        glamor_dest_bounds_add(&bounds, x, y, x + w, y + h);
+        if (!glamor_set_dest_copy_bounds(drawable, gc, &bounds)) {
+            free(strip);
+            goto bail;
+        }
+    }
+
     prog = glamor_use_program_fill(pixmap, gc,
                                    &glamor_priv->poly_glyph_blt_progs,
                                    &glamor_facet_poly_glyph_blt);
-    if (!prog)
+    if (!prog) {
+        free(strip);
         goto bail;
+    }
 
-    glEnableVertexAttribArray(GLAMOR_VERTEX_POS);
-
-    points = glamor_get_vbo_space(screen, w * h * sizeof(INT16) * 2,
-                                  &vbo_offset);
-    num_points = 0;
+    glamor_bitmap_expand(strip, w, bitmap->devPrivate.ptr, bitmap->devKind, w, h);
 
     /* Note that because fb sets miTranslate in the GC, our incoming X
      * and Y are in screen coordinate space (same for spans, but not
      * other operations).
      */
+    quad.x = x;
+    quad.y = y;
+    quad.w = w;
+    quad.h = h;
+    quad.tx = 0;
 
-    for (yy = 0; yy < h; yy++) {
-        uint8_t *bitmap_row = bitmap_data + yy * bitmap_stride;
-        for (xx = 0; xx < w; xx++) {
-            if (bitmap_row[xx / 8] & (1 << xx % 8) &&
-                RegionContainsPoint(clip,
-                                    x + xx,
-                                    y + yy,
-                                    NULL)) {
-                *points++ = x + xx;
-                *points++ = y + yy;
-                num_points++;
-            }
-        }
-    }
-    glVertexAttribPointer(GLAMOR_VERTEX_POS, 2, GL_SHORT,
-                          GL_FALSE, 0, vbo_offset);
-
-    glamor_put_vbo_space(screen);
+    glamor_bitmap_draw(drawable, gc, prog, strip, w, h, &quad, 1);
 
-    glamor_pixmap_loop(pixmap_priv, box_index) {
-        glamor_set_destination_drawable(drawable, box_index, FALSE, TRUE,
-                                        prog->matrix_uniform, NULL, NULL);
-
-        glDrawArrays(GL_POINTS, 0, num_points);
-    }
-
-    glDisableVertexAttribArray(GLAMOR_VERTEX_POS);
+    free(strip);
     return TRUE;
 
 bail:
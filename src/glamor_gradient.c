@@ -32,160 +32,39 @@
 
 #include "glamor_priv.h"
 
-#define LINEAR_SMALL_STOPS (6 + 2)
-#define LINEAR_LARGE_STOPS (16 + 2)
-
-#define RADIAL_SMALL_STOPS (6 + 2)
-#define RADIAL_LARGE_STOPS (16 + 2)
-
 #ifdef GLAMOR_GRADIENT_SHADER
 
-static const char *
-_glamor_create_getcolor_fs_source(ScreenPtr screen, int stops_count,
-                                  int use_array)
+/* The stops of a gradient are expanded into a row of the shared ramp
+ * texture, so get_color() is a single texture lookup whatever the
+ * number of stops.
+ */
+static char *
+_glamor_create_getcolor_fs_source(void)
 {
     char *gradient_fs = NULL;
 
-#define gradient_fs_getcolor\
-	    GLAMOR_DEFAULT_PRECISION\
-	    "uniform int n_stop;\n"\
-	    "uniform float stops[%d];\n"\
-	    "uniform vec4 stop_colors[%d];\n"\
-	    "vec4 get_color(float stop_len)\n"\
-	    "{\n"\
-	    "    int i = 0;\n"\
-	    "    float new_alpha; \n"\
-	    "    vec4 gradient_color;\n"\
-	    "    float percentage; \n"\
-	    "    for(i = 0; i < n_stop - 1; i++) {\n"\
-	    "        if(stop_len < stops[i])\n"\
-	    "            break; \n"\
-	    "    }\n"\
-	    "    \n"\
-	    "    if(stops[i] - stops[i-1] > 2.0)\n"\
-	    "        percentage = 0.0;\n" /*For comply with pixman, walker->stepper overflow.*/\
-	    "    else if(stops[i] - stops[i-1] < 0.000001)\n"\
-	    "        percentage = 0.0;\n"\
-	    "    else \n"\
-	    "        percentage = (stop_len - stops[i-1])/(stops[i] - stops[i-1]);\n"\
-	    "    new_alpha = percentage * stop_colors[i].a + \n"\
-	    "                       (1.0-percentage) * stop_colors[i-1].a; \n"\
-	    "    gradient_color = vec4((percentage * stop_colors[i].rgb \n"\
-	    "                          + (1.0-percentage) * stop_colors[i-1].rgb)*new_alpha, \n"\
-	    "                          new_alpha);\n"\
-	    "    \n"\
-	    "    return gradient_color;\n"\
-	    "}\n"
-
-    /* Because the array access for shader is very slow, the performance is very low
-       if use array. So use global uniform to replace for it if the number of n_stops is small. */
-    const char *gradient_fs_getcolor_no_array =
-        GLAMOR_DEFAULT_PRECISION
-        "uniform int n_stop;\n"
-        "uniform float stop0;\n"
-        "uniform float stop1;\n"
-        "uniform float stop2;\n"
-        "uniform float stop3;\n"
-        "uniform float stop4;\n"
-        "uniform float stop5;\n"
-        "uniform float stop6;\n"
-        "uniform float stop7;\n"
-        "uniform vec4 stop_color0;\n"
-        "uniform vec4 stop_color1;\n"
-        "uniform vec4 stop_color2;\n"
-        "uniform vec4 stop_color3;\n"
-        "uniform vec4 stop_color4;\n"
-        "uniform vec4 stop_color5;\n"
-        "uniform vec4 stop_color6;\n"
-        "uniform vec4 stop_color7;\n"
-        "\n"
-        "vec4 get_color(float stop_len)\n"
-        "{\n"
-        "    float stop_after;\n"
-        "    float stop_before;\n"
-        "    vec4 stop_color_before;\n"
-        "    vec4 stop_color_after;\n"
-        "    float new_alpha; \n"
-        "    vec4 gradient_color;\n"
-        "    float percentage; \n"
-        "    \n"
-        "    if((stop_len < stop0) && (n_stop >= 1)) {\n"
-        "        stop_color_before = stop_color0;\n"
-        "        stop_color_after = stop_color0;\n"
-        "        stop_after = stop0;\n"
-        "        stop_before = stop0;\n"
-        "    } else if((stop_len < stop1) && (n_stop >= 2)) {\n"
-        "        stop_color_before = stop_color0;\n"
-        "        stop_color_after = stop_color1;\n"
-        "        stop_after = stop1;\n"
-        "        stop_before = stop0;\n"
-        "    } else if((stop_len < stop2) && (n_stop >= 3)) {\n"
-        "        stop_color_before = stop_color1;\n"
-        "        stop_color_after = stop_color2;\n"
-        "        stop_after = stop2;\n"
-        "        stop_before = stop1;\n"
-        "    } else if((stop_len < stop3) && (n_stop >= 4)){\n"
-        "        stop_color_before = stop_color2;\n"
-        "        stop_color_after = stop_color3;\n"
-        "        stop_after = stop3;\n"
-        "        stop_before = stop2;\n"
-        "    } else if((stop_len < stop4) && (n_stop >= 5)){\n"
-        "        stop_color_before = stop_color3;\n"
-        "        stop_color_after = stop_color4;\n"
-        "        stop_after = stop4;\n"
-        "        stop_before = stop3;\n"
-        "    } else if((stop_len < stop5) && (n_stop >= 6)){\n"
-        "        stop_color_before = stop_color4;\n"
-        "        stop_color_after = stop_color5;\n"
-        "        stop_after = stop5;\n"
-        "        stop_before = stop4;\n"
-        "    } else if((stop_len < stop6) && (n_stop >= 7)){\n"
-        "        stop_color_before = stop_color5;\n"
-        "        stop_color_after = stop_color6;\n"
-        "        stop_after = stop6;\n"
-        "        stop_before = stop5;\n"
-        "    } else if((stop_len < stop7) && (n_stop >= 8)){\n"
-        "        stop_color_before = stop_color6;\n"
-        "        stop_color_after = stop_color7;\n"
-        "        stop_after = stop7;\n"
-        "        stop_before = stop6;\n"
-        "    } else {\n"
-        "        stop_color_before = stop_color7;\n"
-        "        stop_color_after = stop_color7;\n"
-        "        stop_after = stop7;\n"
-        "        stop_before = stop7;\n"
-        "    }\n"
-        "    if(stop_after - stop_before > 2.0)\n"
-        "        percentage = 0.0;\n" //For comply with pixman, walker->stepper overflow.
-        "    else if(stop_after - stop_before < 0.000001)\n"
-        "        percentage = 0.0;\n"
-        "    else \n"
-        "        percentage = (stop_len - stop_before)/(stop_after - stop_before);\n"
-        "    new_alpha = percentage * stop_color_after.a + \n"
-        "                       (1.0-percentage) * stop_color_before.a; \n"
-        "    gradient_color = vec4((percentage * stop_color_after.rgb \n"
-        "                          + (1.0-percentage) * stop_color_before.rgb)*new_alpha, \n"
-        "                          new_alpha);\n"
-        "    \n"
-        "    return gradient_color;\n"
-        "}\n";
-
-    if (use_array) {
-        XNFasprintf(&gradient_fs,
-                    gradient_fs_getcolor, stops_count, stops_count);
-        return gradient_fs;
-    }
-    else {
-        return XNFstrdup(gradient_fs_getcolor_no_array);
-    }
+    XNFasprintf(&gradient_fs,
+                "uniform sampler2D ramp_sampler;\n"
+                "uniform float ramp_row;\n"
+                "vec4 get_color(float stop_len)\n"
+                "{\n"
+                "    if(repeat_type == %d &&\n" /* RepeatNone case. */
+                "       (stop_len < 0.0 || stop_len > 1.0))\n"
+                "        return vec4(0.0, 0.0, 0.0, 0.0);\n"
+                "    stop_len = clamp(stop_len, 0.0, 1.0);\n"
+                "    return texture2D(ramp_sampler,\n"
+                "                     vec2((stop_len * %d.0 + 0.5) / %d.0,\n"
+                "                          ramp_row));\n"
+                "}\n",
+                PIXMAN_REPEAT_NONE,
+                GLAMOR_GRADIENT_RAMP_WIDTH - 1, GLAMOR_GRADIENT_RAMP_WIDTH);
+    return gradient_fs;
 }
 
 static void
-_glamor_create_radial_gradient_program(ScreenPtr screen, int stops_count,
-                                       int dyn_gen)
+_glamor_create_radial_gradient_program(ScreenPtr screen)
 {
     glamor_screen_private *glamor_priv;
-    int index;
 
     GLint gradient_prog = 0;
     char *gradient_fs = NULL;
@@ -313,29 +192,17 @@ _glamor_create_radial_gradient_program(ScreenPtr screen, int stops_count,
 	    "}\n"\
 	    "\n"\
             "%s\n" /* fs_getcolor_source */
-    const char *fs_getcolor_source;
+    char *fs_getcolor_source;
 
     glamor_priv = glamor_get_screen_private(screen);
 
-    if ((glamor_priv->radial_max_nstops >= stops_count) && (dyn_gen)) {
-        /* Very Good, not to generate again. */
-        return;
-    }
-
     glamor_make_current(glamor_priv);
 
-    if (dyn_gen && glamor_priv->gradient_prog[SHADER_GRADIENT_RADIAL][2]) {
-        glDeleteProgram(glamor_priv->gradient_prog[SHADER_GRADIENT_RADIAL][2]);
-        glamor_priv->gradient_prog[SHADER_GRADIENT_RADIAL][2] = 0;
-    }
-
     gradient_prog = glCreateProgram();
 
     vs_prog = glamor_compile_glsl_prog(GL_VERTEX_SHADER, gradient_vs);
 
-    fs_getcolor_source =
-        _glamor_create_getcolor_fs_source(screen, stops_count,
-                                          (stops_count > 0));
+    fs_getcolor_source = _glamor_create_getcolor_fs_source();
 
     XNFasprintf(&gradient_fs,
                 gradient_radial_fs_template,
@@ -346,6 +213,7 @@ _glamor_create_radial_gradient_program(ScreenPtr screen, int stops_count,
     fs_prog = glamor_compile_glsl_prog(GL_FRAGMENT_SHADER, gradient_fs);
 
     free(gradient_fs);
+    free(fs_getcolor_source);
 
     glAttachShader(gradient_prog, vs_prog);
     glAttachShader(gradient_prog, fs_prog);
@@ -357,27 +225,17 @@ _glamor_create_radial_gradient_program(ScreenPtr screen, int stops_count,
 
     glamor_link_glsl_prog(screen, gradient_prog, "radial gradient");
 
-    if (dyn_gen) {
-        index = 2;
-        glamor_priv->radial_max_nstops = stops_count;
-    }
-    else if (stops_count) {
-        index = 1;
-    }
-    else {
-        index = 0;
-    }
+    glUseProgram(gradient_prog);
+    glUniform1i(glGetUniformLocation(gradient_prog, "ramp_sampler"), 0);
 
-    glamor_priv->gradient_prog[SHADER_GRADIENT_RADIAL][index] = gradient_prog;
+    glamor_priv->gradient_prog[SHADER_GRADIENT_RADIAL] = gradient_prog;
 }
 
 static void
-_glamor_create_linear_gradient_program(ScreenPtr screen, int stops_count,
-                                       int dyn_gen)
+_glamor_create_linear_gradient_program(ScreenPtr screen)
 {
     glamor_screen_private *glamor_priv;
 
-    int index = 0;
     GLint gradient_prog = 0;
     char *gradient_fs = NULL;
     GLint fs_prog, vs_prog;
@@ -506,27 +364,17 @@ _glamor_create_linear_gradient_program(ScreenPtr screen, int stops_count,
 	    "}\n"\
 	    "\n"\
             "%s" /* fs_getcolor_source */
-    const char *fs_getcolor_source;
+    char *fs_getcolor_source;
 
     glamor_priv = glamor_get_screen_private(screen);
 
-    if ((glamor_priv->linear_max_nstops >= stops_count) && (dyn_gen)) {
-        /* Very Good, not to generate again. */
-        return;
-    }
-
     glamor_make_current(glamor_priv);
-    if (dyn_gen && glamor_priv->gradient_prog[SHADER_GRADIENT_LINEAR][2]) {
-        glDeleteProgram(glamor_priv->gradient_prog[SHADER_GRADIENT_LINEAR][2]);
-        glamor_priv->gradient_prog[SHADER_GRADIENT_LINEAR][2] = 0;
-    }
 
     gradient_prog = glCreateProgram();
 
     vs_prog = glamor_compile_glsl_prog(GL_VERTEX_SHADER, gradient_vs);
 
-    fs_getcolor_source =
-        _glamor_create_getcolor_fs_source(screen, stops_count, stops_count > 0);
+    fs_getcolor_source = _glamor_create_getcolor_fs_source();
 
     XNFasprintf(&gradient_fs,
                 gradient_fs_template,
@@ -535,6 +383,7 @@ _glamor_create_linear_gradient_program(ScreenPtr screen, int stops_count,
 
     fs_prog = glamor_compile_glsl_prog(GL_FRAGMENT_SHADER, gradient_fs);
     free(gradient_fs);
+    free(fs_getcolor_source);
 
     glAttachShader(gradient_prog, vs_prog);
     glAttachShader(gradient_prog, fs_prog);
@@ -546,40 +395,35 @@ _glamor_create_linear_gradient_program(ScreenPtr screen, int stops_count,
 
     glamor_link_glsl_prog(screen, gradient_prog, "linear gradient");
 
-    if (dyn_gen) {
-        index = 2;
-        glamor_priv->linear_max_nstops = stops_count;
-    }
-    else if (stops_count) {
-        index = 1;
-    }
-    else {
-        index = 0;
-    }
+    glUseProgram(gradient_prog);
+    glUniform1i(glGetUniformLocation(gradient_prog, "ramp_sampler"), 0);
 
-    glamor_priv->gradient_prog[SHADER_GRADIENT_LINEAR][index] = gradient_prog;
+    glamor_priv->gradient_prog[SHADER_GRADIENT_LINEAR] = gradient_prog;
 }
 
 void
 glamor_init_gradient_shader(ScreenPtr screen)
 {
-    glamor_screen_private *glamor_priv;
-    int i;
+    _glamor_create_linear_gradient_program(screen);
+    _glamor_create_radial_gradient_program(screen);
+}
 
-    glamor_priv = glamor_get_screen_private(screen);
+void
+glamor_fini_gradient_shader(ScreenPtr screen)
+{
+    glamor_screen_private *glamor_priv = glamor_get_screen_private(screen);
+    int i;
 
-    for (i = 0; i < 3; i++) {
-        glamor_priv->gradient_prog[SHADER_GRADIENT_LINEAR][i] = 0;
-        glamor_priv->gradient_prog[SHADER_GRADIENT_RADIAL][i] = 0;
+    for (i = 0; i < GLAMOR_GRADIENT_RAMP_ROWS; i++) {
+        free(glamor_priv->gradient_ramps[i].stops);
+        glamor_priv->gradient_ramps[i].stops = NULL;
     }
-    glamor_priv->linear_max_nstops = 0;
-    glamor_priv->radial_max_nstops = 0;
-
-    _glamor_create_linear_gradient_program(screen, 0, 0);
-    _glamor_create_linear_gradient_program(screen, LINEAR_LARGE_STOPS, 0);
 
-    _glamor_create_radial_gradient_program(screen, 0, 0);
-    _glamor_create_radial_gradient_program(screen, RADIAL_LARGE_STOPS, 0);
+    if (glamor_priv->gradient_ramp_texture) {
+        glamor_make_current(glamor_priv);
+        glDeleteTextures(1, &glamor_priv->gradient_ramp_texture);
+        glamor_priv->gradient_ramp_texture = 0;
+    }
 }
 
 static void
@@ -803,6 +647,237 @@ _glamor_gradient_set_stops(PicturePtr src_picture, PictGradient *pgradient,
     return count;
 }
 
+static uint32_t
+glamor_gradient_hash(PictGradient *gradient, int repeat)
+{
+    const unsigned char *p = (const unsigned char *) gradient->stops;
+    size_t len = gradient->nstops * sizeof(PictGradientStop);
+    uint32_t hash = 2166136261u ^ repeat;
+
+    /* FNV-1a */
+    while (len--) {
+        hash ^= *p++;
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+/* Evaluates the gradient at each texel of a ramp row, t running from 0
+ * to 1, with the same stop padding the shaders used to interpolate.
+ */
+static void
+glamor_gradient_fill_ramp(PicturePtr picture, PictGradient *gradient,
+                          CARD8 *texels)
+{
+    GLfloat *stop_colors, *n_stops;
+    int count, i, j, k;
+
+    stop_colors = xallocarray(gradient->nstops + 2, 4 * sizeof(GLfloat));
+    n_stops = xallocarray(gradient->nstops + 2, sizeof(GLfloat));
+    if (!stop_colors || !n_stops) {
+        memset(texels, 0, GLAMOR_GRADIENT_RAMP_WIDTH * 4);
+        goto done;
+    }
+
+    count = _glamor_gradient_set_stops(picture, gradient,
+                                       stop_colors, n_stops);
+
+    for (i = 0, j = 1; i < GLAMOR_GRADIENT_RAMP_WIDTH; i++) {
+        float t = (float) i / (GLAMOR_GRADIENT_RAMP_WIDTH - 1);
+        float percentage = 0.0, delta, alpha;
+        int before, after;
+
+        while (j < count && t >= n_stops[j])
+            j++;
+        if (j == count) {
+            before = after = count - 1;
+        } else {
+            before = j - 1;
+            after = j;
+        }
+
+        /* For comply with pixman, walker->stepper overflow. */
+        delta = n_stops[after] - n_stops[before];
+        if (delta <= 2.0 && delta >= 0.000001)
+            percentage = (t - n_stops[before]) / delta;
+
+        alpha = percentage * stop_colors[after * 4 + 3] +
+            (1.0 - percentage) * stop_colors[before * 4 + 3];
+        for (k = 0; k < 3; k++)
+            texels[i * 4 + k] =
+                (percentage * stop_colors[after * 4 + k] +
+                 (1.0 - percentage) * stop_colors[before * 4 + k]) *
+                alpha * 255.0 + 0.5;
+        texels[i * 4 + 3] = alpha * 255.0 + 0.5;
+    }
+
+ done:
+    free(stop_colors);
+    free(n_stops);
+}
+
+/**
+ * Binds the gradient ramp texture to the given texture unit and returns
+ * the texture coordinate of the row holding this gradient's colors.
+ *
+ * Rows are cached by stops and repeat type, and the least recently used
+ * row is replaced on a miss, so gradients reused across draws cost no
+ * more than a lookup.
+ */
+GLfloat
+glamor_gradient_bind_ramp(ScreenPtr screen, PicturePtr picture, int unit)
+{
+    glamor_screen_private *glamor_priv = glamor_get_screen_private(screen);
+    PictGradient *gradient = &picture->pSourcePict->gradient;
+    int repeat = picture->repeatType;
+    uint32_t hash = glamor_gradient_hash(gradient, repeat);
+    glamor_gradient_ramp *ramp, *lru = NULL;
+    CARD8 texels[GLAMOR_GRADIENT_RAMP_WIDTH * 4];
+    int row;
+
+    glActiveTexture(GL_TEXTURE0 + unit);
+    if (!glamor_priv->gradient_ramp_texture) {
+        glGenTextures(1, &glamor_priv->gradient_ramp_texture);
+        glBindTexture(GL_TEXTURE_2D, glamor_priv->gradient_ramp_texture);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA,
+                     GLAMOR_GRADIENT_RAMP_WIDTH, GLAMOR_GRADIENT_RAMP_ROWS,
+                     0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    } else {
+        glBindTexture(GL_TEXTURE_2D, glamor_priv->gradient_ramp_texture);
+    }
+
+    for (row = 0; row < GLAMOR_GRADIENT_RAMP_ROWS; row++) {
+        ramp = &glamor_priv->gradient_ramps[row];
+        if (ramp->stops && ramp->hash == hash && ramp->repeat == repeat &&
+            ramp->nstops == gradient->nstops &&
+            memcmp(ramp->stops, gradient->stops,
+                   gradient->nstops * sizeof(PictGradientStop)) == 0)
+            goto done;
+
+        if (!lru || (lru->stops &&
+                     (!ramp->stops || ramp->last_used < lru->last_used)))
+            lru = ramp;
+    }
+
+    ramp = lru;
+    free(ramp->stops);
+    ramp->stops = xallocarray(gradient->nstops, sizeof(PictGradientStop));
+    if (ramp->stops)
+        memcpy(ramp->stops, gradient->stops,
+               gradient->nstops * sizeof(PictGradientStop));
+    ramp->hash = hash;
+    ramp->repeat = repeat;
+    ramp->nstops = gradient->nstops;
+
+    glamor_gradient_fill_ramp(picture, gradient, texels);
+    glTexSubImage2D(GL_TEXTURE_2D, 0,
+                    0, ramp - glamor_priv->gradient_ramps,
+                    GLAMOR_GRADIENT_RAMP_WIDTH, 1,
+                    GL_RGBA, GL_UNSIGNED_BYTE, texels);
+
+ done:
+    ramp->last_used = ++glamor_priv->gradient_ramp_serial;
+    return ((ramp - glamor_priv->gradient_ramps) + 0.5) /
+        GLAMOR_GRADIENT_RAMP_ROWS;
+}
+
+/**
+ * Returns whether the composite shader can evaluate this gradient
+ * source directly, without rendering it to a temporary picture first.
+ */
+Bool
+glamor_gradient_composite_supported(PicturePtr picture)
+{
+    SourcePictPtr pict = picture->pSourcePict;
+
+    if (!pict)
+        return FALSE;
+
+    switch (pict->type) {
+    case SourcePictTypeLinear:
+        if (pict->linear.p1.x == pict->linear.p2.x &&
+            pict->linear.p1.y == pict->linear.p2.y)
+            return FALSE;
+        break;
+    case SourcePictTypeRadial:
+    case SourcePictTypeConical:
+        break;
+    default:
+        return FALSE;
+    }
+
+    return pict->gradient.nstops >= 1;
+}
+
+/**
+ * Uploads the transform, ramp row and geometry of a gradient source to
+ * the currently bound composite shader, and binds the ramp texture to
+ * unit 0.  The shader receives the untransformed picture coordinates of
+ * each fragment.
+ */
+void
+glamor_set_composite_gradient(ScreenPtr screen,
+                              glamor_composite_shader *shader,
+                              PicturePtr picture)
+{
+    SourcePictPtr pict = picture->pSourcePict;
+    GLfloat transform[9] = { 1.0, 0.0, 0.0,
+                             0.0, 1.0, 0.0,
+                             0.0, 0.0, 1.0 };
+    int i, j;
+
+    /* GLES can't transpose at upload time, so store it column major. */
+    if (picture->transform) {
+        for (i = 0; i < 3; i++)
+            for (j = 0; j < 3; j++)
+                transform[j * 3 + i] =
+                    pixman_fixed_to_double(picture->transform->matrix[i][j]);
+    }
+    glUniformMatrix3fv(shader->source_transform, 1, GL_FALSE, transform);
+    glUniform1i(shader->source_repeat_mode, picture->repeatType);
+    glUniform1f(shader->source_ramp_row,
+                glamor_gradient_bind_ramp(screen, picture, 0));
+
+    switch (pict->type) {
+    case SourcePictTypeLinear: {
+        double x1 = pixman_fixed_to_double(pict->linear.p1.x);
+        double y1 = pixman_fixed_to_double(pict->linear.p1.y);
+        double dx = pixman_fixed_to_double(pict->linear.p2.x) - x1;
+        double dy = pixman_fixed_to_double(pict->linear.p2.y) - y1;
+        double l2 = dx * dx + dy * dy;
+
+        /* t = ((p - p1) . (p2 - p1)) / |p2 - p1|^2, as in pixman. */
+        glUniform4f(shader->source_gradient,
+                    dx / l2, dy / l2, -(x1 * dx + y1 * dy) / l2, 0.0);
+        break;
+    }
+    case SourcePictTypeRadial: {
+        double c1x = pixman_fixed_to_double(pict->radial.c1.x);
+        double c1y = pixman_fixed_to_double(pict->radial.c1.y);
+        double r1 = pixman_fixed_to_double(pict->radial.c1.radius);
+        double cdx = pixman_fixed_to_double(pict->radial.c2.x) - c1x;
+        double cdy = pixman_fixed_to_double(pict->radial.c2.y) - c1y;
+        double dr = pixman_fixed_to_double(pict->radial.c2.radius) - r1;
+
+        glUniform4f(shader->source_gradient,
+                    c1x, c1y, r1, cdx * cdx + cdy * cdy - dr * dr);
+        glUniform4f(shader->source_gradient_delta, cdx, cdy, dr, 0.0);
+        break;
+    }
+    case SourcePictTypeConical:
+        glUniform4f(shader->source_gradient,
+                    pixman_fixed_to_double(pict->conical.center.x),
+                    pixman_fixed_to_double(pict->conical.center.y),
+                    pixman_fixed_to_double(pict->conical.angle) *
+                    (3.14159265358979 / 180.0), 0.0);
+        break;
+    }
+}
+
 PicturePtr
 glamor_generate_radial_gradient_picture(ScreenPtr screen,
                                         PicturePtr src_picture,
@@ -815,43 +890,19 @@ glamor_generate_radial_gradient_picture(ScreenPtr screen,
     PixmapPtr pixmap = NULL;
     GLint gradient_prog = 0;
     int error;
-    int stops_count = 0;
-    int count = 0;
-    GLfloat *stop_colors = NULL;
-    GLfloat *n_stops = NULL;
     GLfloat xscale, yscale;
     float transform_mat[3][3];
     static const float identity_mat[3][3] = { {1.0, 0.0, 0.0},
     {0.0, 1.0, 0.0},
     {0.0, 0.0, 1.0}
     };
-    GLfloat stop_colors_st[RADIAL_SMALL_STOPS * 4];
-    GLfloat n_stops_st[RADIAL_SMALL_STOPS];
     GLfloat A_value;
     GLfloat cxy[4];
     float c1x, c1y, c2x, c2y, r1, r2;
 
     GLint transform_mat_uniform_location = 0;
     GLint repeat_type_uniform_location = 0;
-    GLint n_stop_uniform_location = 0;
-    GLint stops_uniform_location = 0;
-    GLint stop_colors_uniform_location = 0;
-    GLint stop0_uniform_location = 0;
-    GLint stop1_uniform_location = 0;
-    GLint stop2_uniform_location = 0;
-    GLint stop3_uniform_location = 0;
-    GLint stop4_uniform_location = 0;
-    GLint stop5_uniform_location = 0;
-    GLint stop6_uniform_location = 0;
-    GLint stop7_uniform_location = 0;
-    GLint stop_color0_uniform_location = 0;
-    GLint stop_color1_uniform_location = 0;
-    GLint stop_color2_uniform_location = 0;
-    GLint stop_color3_uniform_location = 0;
-    GLint stop_color4_uniform_location = 0;
-    GLint stop_color5_uniform_location = 0;
-    GLint stop_color6_uniform_location = 0;
-    GLint stop_color7_uniform_location = 0;
+    GLint ramp_row_uniform_location = 0;
     GLint A_value_uniform_location = 0;
     GLint c1_uniform_location = 0;
     GLint r1_uniform_location = 0;
@@ -882,77 +933,21 @@ glamor_generate_radial_gradient_picture(ScreenPtr screen,
 
     ValidatePicture(dst_picture);
 
-    stops_count = src_picture->pSourcePict->radial.nstops + 2;
-
-    /* Because the max value of nstops is unknown, so create a program
-       when nstops > LINEAR_LARGE_STOPS. */
-    if (stops_count <= RADIAL_SMALL_STOPS) {
-        gradient_prog = glamor_priv->gradient_prog[SHADER_GRADIENT_RADIAL][0];
-    }
-    else if (stops_count <= RADIAL_LARGE_STOPS) {
-        gradient_prog = glamor_priv->gradient_prog[SHADER_GRADIENT_RADIAL][1];
-    }
-    else {
-        _glamor_create_radial_gradient_program(screen,
-                                               src_picture->pSourcePict->linear.
-                                               nstops + 2, 1);
-        gradient_prog = glamor_priv->gradient_prog[SHADER_GRADIENT_RADIAL][2];
-    }
+    gradient_prog = glamor_priv->gradient_prog[SHADER_GRADIENT_RADIAL];
 
     /* Bind all the uniform vars . */
     transform_mat_uniform_location = glGetUniformLocation(gradient_prog,
                                                           "transform_mat");
     repeat_type_uniform_location = glGetUniformLocation(gradient_prog,
                                                         "repeat_type");
-    n_stop_uniform_location = glGetUniformLocation(gradient_prog, "n_stop");
+    ramp_row_uniform_location = glGetUniformLocation(gradient_prog,
+                                                     "ramp_row");
     A_value_uniform_location = glGetUniformLocation(gradient_prog, "A_value");
     c1_uniform_location = glGetUniformLocation(gradient_prog, "c1");
     r1_uniform_location = glGetUniformLocation(gradient_prog, "r1");
     c2_uniform_location = glGetUniformLocation(gradient_prog, "c2");
     r2_uniform_location = glGetUniformLocation(gradient_prog, "r2");
 
-    if (src_picture->pSourcePict->radial.nstops + 2 <= RADIAL_SMALL_STOPS) {
-        stop0_uniform_location =
-            glGetUniformLocation(gradient_prog, "stop0");
-        stop1_uniform_location =
-            glGetUniformLocation(gradient_prog, "stop1");
-        stop2_uniform_location =
-            glGetUniformLocation(gradient_prog, "stop2");
-        stop3_uniform_location =
-            glGetUniformLocation(gradient_prog, "stop3");
-        stop4_uniform_location =
-            glGetUniformLocation(gradient_prog, "stop4");
-        stop5_uniform_location =
-            glGetUniformLocation(gradient_prog, "stop5");
-        stop6_uniform_location =
-            glGetUniformLocation(gradient_prog, "stop6");
-        stop7_uniform_location =
-            glGetUniformLocation(gradient_prog, "stop7");
-
-        stop_color0_uniform_location =
-            glGetUniformLocation(gradient_prog, "stop_color0");
-        stop_color1_uniform_location =
-            glGetUniformLocation(gradient_prog, "stop_color1");
-        stop_color2_uniform_location =
-            glGetUniformLocation(gradient_prog, "stop_color2");
-        stop_color3_uniform_location =
-            glGetUniformLocation(gradient_prog, "stop_color3");
-        stop_color4_uniform_location =
-            glGetUniformLocation(gradient_prog, "stop_color4");
-        stop_color5_uniform_location =
-            glGetUniformLocation(gradient_prog, "stop_color5");
-        stop_color6_uniform_location =
-            glGetUniformLocation(gradient_prog, "stop_color6");
-        stop_color7_uniform_location =
-            glGetUniformLocation(gradient_prog, "stop_color7");
-    }
-    else {
-        stops_uniform_location =
-            glGetUniformLocation(gradient_prog, "stops");
-        stop_colors_uniform_location =
-            glGetUniformLocation(gradient_prog, "stop_colors");
-    }
-
     glUseProgram(gradient_prog);
 
     glUniform1i(repeat_type_uniform_location, src_picture->repeatType);
@@ -973,83 +968,11 @@ glamor_generate_radial_gradient_picture(ScreenPtr screen,
          0))
         goto GRADIENT_FAIL;
 
-    glamor_set_alu(screen, GXcopy);
-
-    /* Set all the stops and colors to shader. */
-    if (stops_count > RADIAL_SMALL_STOPS) {
-        stop_colors = xallocarray(stops_count, 4 * sizeof(float));
-        if (stop_colors == NULL) {
-            ErrorF("Failed to allocate stop_colors memory.\n");
-            goto GRADIENT_FAIL;
-        }
-
-        n_stops = xallocarray(stops_count, sizeof(float));
-        if (n_stops == NULL) {
-            ErrorF("Failed to allocate n_stops memory.\n");
-            goto GRADIENT_FAIL;
-        }
-    }
-    else {
-        stop_colors = stop_colors_st;
-        n_stops = n_stops_st;
-    }
+    glamor_set_gxcopy(screen);
 
-    count =
-        _glamor_gradient_set_stops(src_picture,
-                                   &src_picture->pSourcePict->gradient,
-                                   stop_colors, n_stops);
-
-    if (src_picture->pSourcePict->linear.nstops + 2 <= RADIAL_SMALL_STOPS) {
-        int j = 0;
-
-        glUniform4f(stop_color0_uniform_location,
-                    stop_colors[4 * j + 0], stop_colors[4 * j + 1],
-                    stop_colors[4 * j + 2], stop_colors[4 * j + 3]);
-        j++;
-        glUniform4f(stop_color1_uniform_location,
-                    stop_colors[4 * j + 0], stop_colors[4 * j + 1],
-                    stop_colors[4 * j + 2], stop_colors[4 * j + 3]);
-        j++;
-        glUniform4f(stop_color2_uniform_location,
-                    stop_colors[4 * j + 0], stop_colors[4 * j + 1],
-                    stop_colors[4 * j + 2], stop_colors[4 * j + 3]);
-        j++;
-        glUniform4f(stop_color3_uniform_location,
-                    stop_colors[4 * j + 0], stop_colors[4 * j + 1],
-                    stop_colors[4 * j + 2], stop_colors[4 * j + 3]);
-        j++;
-        glUniform4f(stop_color4_uniform_location,
-                    stop_colors[4 * j + 0], stop_colors[4 * j + 1],
-                    stop_colors[4 * j + 2], stop_colors[4 * j + 3]);
-        j++;
-        glUniform4f(stop_color5_uniform_location,
-                    stop_colors[4 * j + 0], stop_colors[4 * j + 1],
-                    stop_colors[4 * j + 2], stop_colors[4 * j + 3]);
-        j++;
-        glUniform4f(stop_color6_uniform_location,
-                    stop_colors[4 * j + 0], stop_colors[4 * j + 1],
-                    stop_colors[4 * j + 2], stop_colors[4 * j + 3]);
-        j++;
-        glUniform4f(stop_color7_uniform_location,
-                    stop_colors[4 * j + 0], stop_colors[4 * j + 1],
-                    stop_colors[4 * j + 2], stop_colors[4 * j + 3]);
-
-        j = 0;
-        glUniform1f(stop0_uniform_location, n_stops[j++]);
-        glUniform1f(stop1_uniform_location, n_stops[j++]);
-        glUniform1f(stop2_uniform_location, n_stops[j++]);
-        glUniform1f(stop3_uniform_location, n_stops[j++]);
-        glUniform1f(stop4_uniform_location, n_stops[j++]);
-        glUniform1f(stop5_uniform_location, n_stops[j++]);
-        glUniform1f(stop6_uniform_location, n_stops[j++]);
-        glUniform1f(stop7_uniform_location, n_stops[j++]);
-        glUniform1i(n_stop_uniform_location, count);
-    }
-    else {
-        glUniform4fv(stop_colors_uniform_location, count, stop_colors);
-        glUniform1fv(stops_uniform_location, count, n_stops);
-        glUniform1i(n_stop_uniform_location, count);
-    }
+    /* Set the color ramp of the stops. */
+    glUniform1f(ramp_row_uniform_location,
+                glamor_gradient_bind_ramp(screen, src_picture, 0));
 
     c1x = (float) pixman_fixed_to_double(src_picture->pSourcePict->radial.c1.x);
     c1y = (float) pixman_fixed_to_double(src_picture->pSourcePict->radial.c1.y);
@@ -1081,12 +1004,6 @@ glamor_generate_radial_gradient_picture(ScreenPtr screen,
     /* Now rendering. */
     glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
 
-    /* Do the clear logic. */
-    if (stops_count > RADIAL_SMALL_STOPS) {
-        free(n_stops);
-        free(stop_colors);
-    }
-
     glDisableVertexAttribArray(GLAMOR_VERTEX_POS);
     glDisableVertexAttribArray(GLAMOR_VERTEX_SOURCE);
 
@@ -1097,13 +1014,6 @@ glamor_generate_radial_gradient_picture(ScreenPtr screen,
         FreePicture(dst_picture, 0);
     }
 
-    if (stops_count > RADIAL_SMALL_STOPS) {
-        if (n_stops)
-            free(n_stops);
-        if (stop_colors)
-            free(stop_colors);
-    }
-
     glDisableVertexAttribArray(GLAMOR_VERTEX_POS);
     glDisableVertexAttribArray(GLAMOR_VERTEX_SOURCE);
     return NULL;
@@ -1124,10 +1034,6 @@ glamor_generate_linear_gradient_picture(ScreenPtr screen,
     float pt_distance;
     float p1_distance;
     GLfloat cos_val;
-    int stops_count = 0;
-    GLfloat *stop_colors = NULL;
-    GLfloat *n_stops = NULL;
-    int count = 0;
     float slope;
     GLfloat xscale, yscale;
     GLfloat pt1[2], pt2[2];
@@ -1136,29 +1042,9 @@ glamor_generate_linear_gradient_picture(ScreenPtr screen,
     {0.0, 1.0, 0.0},
     {0.0, 0.0, 1.0}
     };
-    GLfloat stop_colors_st[LINEAR_SMALL_STOPS * 4];
-    GLfloat n_stops_st[LINEAR_SMALL_STOPS];
 
     GLint transform_mat_uniform_location = 0;
-    GLint n_stop_uniform_location = 0;
-    GLint stops_uniform_location = 0;
-    GLint stop0_uniform_location = 0;
-    GLint stop1_uniform_location = 0;
-    GLint stop2_uniform_location = 0;
-    GLint stop3_uniform_location = 0;
-    GLint stop4_uniform_location = 0;
-    GLint stop5_uniform_location = 0;
-    GLint stop6_uniform_location = 0;
-    GLint stop7_uniform_location = 0;
-    GLint stop_colors_uniform_location = 0;
-    GLint stop_color0_uniform_location = 0;
-    GLint stop_color1_uniform_location = 0;
-    GLint stop_color2_uniform_location = 0;
-    GLint stop_color3_uniform_location = 0;
-    GLint stop_color4_uniform_location = 0;
-    GLint stop_color5_uniform_location = 0;
-    GLint stop_color6_uniform_location = 0;
-    GLint stop_color7_uniform_location = 0;
+    GLint ramp_row_uniform_location = 0;
     GLint pt_slope_uniform_location = 0;
     GLint repeat_type_uniform_location = 0;
     GLint hor_ver_uniform_location = 0;
@@ -1191,26 +1077,11 @@ glamor_generate_linear_gradient_picture(ScreenPtr screen,
 
     ValidatePicture(dst_picture);
 
-    stops_count = src_picture->pSourcePict->linear.nstops + 2;
-
-    /* Because the max value of nstops is unknown, so create a program
-       when nstops > LINEAR_LARGE_STOPS. */
-    if (stops_count <= LINEAR_SMALL_STOPS) {
-        gradient_prog = glamor_priv->gradient_prog[SHADER_GRADIENT_LINEAR][0];
-    }
-    else if (stops_count <= LINEAR_LARGE_STOPS) {
-        gradient_prog = glamor_priv->gradient_prog[SHADER_GRADIENT_LINEAR][1];
-    }
-    else {
-        _glamor_create_linear_gradient_program(screen,
-                                               src_picture->pSourcePict->linear.
-                                               nstops + 2, 1);
-        gradient_prog = glamor_priv->gradient_prog[SHADER_GRADIENT_LINEAR][2];
-    }
+    gradient_prog = glamor_priv->gradient_prog[SHADER_GRADIENT_LINEAR];
 
     /* Bind all the uniform vars . */
-    n_stop_uniform_location =
-        glGetUniformLocation(gradient_prog, "n_stop");
+    ramp_row_uniform_location =
+        glGetUniformLocation(gradient_prog, "ramp_row");
     pt_slope_uniform_location =
         glGetUniformLocation(gradient_prog, "pt_slope");
     repeat_type_uniform_location =
@@ -1226,48 +1097,6 @@ glamor_generate_linear_gradient_picture(ScreenPtr screen,
     pt_distance_uniform_location =
         glGetUniformLocation(gradient_prog, "pt_distance");
 
-    if (src_picture->pSourcePict->linear.nstops + 2 <= LINEAR_SMALL_STOPS) {
-        stop0_uniform_location =
-            glGetUniformLocation(gradient_prog, "stop0");
-        stop1_uniform_location =
-            glGetUniformLocation(gradient_prog, "stop1");
-        stop2_uniform_location =
-            glGetUniformLocation(gradient_prog, "stop2");
-        stop3_uniform_location =
-            glGetUniformLocation(gradient_prog, "stop3");
-        stop4_uniform_location =
-            glGetUniformLocation(gradient_prog, "stop4");
-        stop5_uniform_location =
-            glGetUniformLocation(gradient_prog, "stop5");
-        stop6_uniform_location =
-            glGetUniformLocation(gradient_prog, "stop6");
-        stop7_uniform_location =
-            glGetUniformLocation(gradient_prog, "stop7");
-
-        stop_color0_uniform_location =
-            glGetUniformLocation(gradient_prog, "stop_color0");
-        stop_color1_uniform_location =
-            glGetUniformLocation(gradient_prog, "stop_color1");
-        stop_color2_uniform_location =
-            glGetUniformLocation(gradient_prog, "stop_color2");
-        stop_color3_uniform_location =
-            glGetUniformLocation(gradient_prog, "stop_color3");
-        stop_color4_uniform_location =
-            glGetUniformLocation(gradient_prog, "stop_color4");
-        stop_color5_uniform_location =
-            glGetUniformLocation(gradient_prog, "stop_color5");
-        stop_color6_uniform_location =
-            glGetUniformLocation(gradient_prog, "stop_color6");
-        stop_color7_uniform_location =
-            glGetUniformLocation(gradient_prog, "stop_color7");
-    }
-    else {
-        stops_uniform_location =
-            glGetUniformLocation(gradient_prog, "stops");
-        stop_colors_uniform_location =
-            glGetUniformLocation(gradient_prog, "stop_colors");
-    }
-
     glUseProgram(gradient_prog);
 
     glUniform1i(repeat_type_uniform_location, src_picture->repeatType);
@@ -1289,7 +1118,7 @@ glamor_generate_linear_gradient_picture(ScreenPtr screen,
          1))
         goto GRADIENT_FAIL;
 
-    glamor_set_alu(screen, GXcopy);
+    glamor_set_gxcopy(screen);
 
     /* Normalize the PTs. */
     glamor_set_normalize_pt(xscale, yscale,
@@ -1314,82 +1143,9 @@ glamor_generate_linear_gradient_picture(ScreenPtr screen,
            pixman_fixed_to_double(src_picture->pSourcePict->linear.p2.y),
            pt2[0], pt2[1]);
 
-    /* Set all the stops and colors to shader. */
-    if (stops_count > LINEAR_SMALL_STOPS) {
-        stop_colors = xallocarray(stops_count, 4 * sizeof(float));
-        if (stop_colors == NULL) {
-            ErrorF("Failed to allocate stop_colors memory.\n");
-            goto GRADIENT_FAIL;
-        }
-
-        n_stops = xallocarray(stops_count, sizeof(float));
-        if (n_stops == NULL) {
-            ErrorF("Failed to allocate n_stops memory.\n");
-            goto GRADIENT_FAIL;
-        }
-    }
-    else {
-        stop_colors = stop_colors_st;
-        n_stops = n_stops_st;
-    }
-
-    count =
-        _glamor_gradient_set_stops(src_picture,
-                                   &src_picture->pSourcePict->gradient,
-                                   stop_colors, n_stops);
-
-    if (src_picture->pSourcePict->linear.nstops + 2 <= LINEAR_SMALL_STOPS) {
-        int j = 0;
-
-        glUniform4f(stop_color0_uniform_location,
-                    stop_colors[4 * j + 0], stop_colors[4 * j + 1],
-                    stop_colors[4 * j + 2], stop_colors[4 * j + 3]);
-        j++;
-        glUniform4f(stop_color1_uniform_location,
-                    stop_colors[4 * j + 0], stop_colors[4 * j + 1],
-                    stop_colors[4 * j + 2], stop_colors[4 * j + 3]);
-        j++;
-        glUniform4f(stop_color2_uniform_location,
-                    stop_colors[4 * j + 0], stop_colors[4 * j + 1],
-                    stop_colors[4 * j + 2], stop_colors[4 * j + 3]);
-        j++;
-        glUniform4f(stop_color3_uniform_location,
-                    stop_colors[4 * j + 0], stop_colors[4 * j + 1],
-                    stop_colors[4 * j + 2], stop_colors[4 * j + 3]);
-        j++;
-        glUniform4f(stop_color4_uniform_location,
-                    stop_colors[4 * j + 0], stop_colors[4 * j + 1],
-                    stop_colors[4 * j + 2], stop_colors[4 * j + 3]);
-        j++;
-        glUniform4f(stop_color5_uniform_location,
-                    stop_colors[4 * j + 0], stop_colors[4 * j + 1],
-                    stop_colors[4 * j + 2], stop_colors[4 * j + 3]);
-        j++;
-        glUniform4f(stop_color6_uniform_location,
-                    stop_colors[4 * j + 0], stop_colors[4 * j + 1],
-                    stop_colors[4 * j + 2], stop_colors[4 * j + 3]);
-        j++;
-        glUniform4f(stop_color7_uniform_location,
-                    stop_colors[4 * j + 0], stop_colors[4 * j + 1],
-                    stop_colors[4 * j + 2], stop_colors[4 * j + 3]);
-
-        j = 0;
-        glUniform1f(stop0_uniform_location, n_stops[j++]);
-        glUniform1f(stop1_uniform_location, n_stops[j++]);
-        glUniform1f(stop2_uniform_location, n_stops[j++]);
-        glUniform1f(stop3_uniform_location, n_stops[j++]);
-        glUniform1f(stop4_uniform_location, n_stops[j++]);
-        glUniform1f(stop5_uniform_location, n_stops[j++]);
-        glUniform1f(stop6_uniform_location, n_stops[j++]);
-        glUniform1f(stop7_uniform_location, n_stops[j++]);
-
-        glUniform1i(n_stop_uniform_location, count);
-    }
-    else {
-        glUniform4fv(stop_colors_uniform_location, count, stop_colors);
-        glUniform1fv(stops_uniform_location, count, n_stops);
-        glUniform1i(n_stop_uniform_location, count);
-    }
+    /* Set the color ramp of the stops. */
+    glUniform1f(ramp_row_uniform_location,
+                glamor_gradient_bind_ramp(screen, src_picture, 0));
 
     if (src_picture->pSourcePict->linear.p2.y == src_picture->pSourcePict->linear.p1.y) {       // The horizontal case.
         glUniform1i(hor_ver_uniform_location, 1);
@@ -1424,12 +1180,6 @@ glamor_generate_linear_gradient_picture(ScreenPtr screen,
     /* Now rendering. */
     glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
 
-    /* Do the clear logic. */
-    if (stops_count > LINEAR_SMALL_STOPS) {
-        free(n_stops);
-        free(stop_colors);
-    }
-
     glDisableVertexAttribArray(GLAMOR_VERTEX_POS);
     glDisableVertexAttribArray(GLAMOR_VERTEX_SOURCE);
 
@@ -1440,13 +1190,6 @@ glamor_generate_linear_gradient_picture(ScreenPtr screen,
         FreePicture(dst_picture, 0);
     }
 
-    if (stops_count > LINEAR_SMALL_STOPS) {
-        if (n_stops)
-            free(n_stops);
-        if (stop_colors)
-            free(stop_colors);
-    }
-
     glDisableVertexAttribArray(GLAMOR_VERTEX_POS);
     glDisableVertexAttribArray(GLAMOR_VERTEX_SOURCE);
     return NULL;
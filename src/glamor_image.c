@@ -28,6 +28,44 @@
  * PutImage. Only does ZPixmap right now as other formats are quite a bit harder
  */
 
+/*
+ * Uploads the image to a temporary pixmap and copies it from there, so
+ * that the GPU applies the GC alu and planemask.
+ */
+static Bool
+glamor_put_image_copy(DrawablePtr drawable, GCPtr gc, int x, int y,
+                      int w, int h, char *bits, uint32_t byte_stride)
+{
+    PixmapPtr tmp_pixmap;
+    RegionPtr exposed;
+    BoxRec box;
+
+    tmp_pixmap = glamor_create_pixmap(drawable->pScreen, w, h,
+                                      drawable->depth, 0);
+    if (!tmp_pixmap)
+        return FALSE;
+
+    if (!GLAMOR_PIXMAP_PRIV_HAS_FBO(glamor_get_pixmap_private(tmp_pixmap))) {
+        glamor_destroy_pixmap(tmp_pixmap);
+        return FALSE;
+    }
+
+    box.x1 = 0;
+    box.y1 = 0;
+    box.x2 = w;
+    box.y2 = h;
+    glamor_upload_boxes(tmp_pixmap, &box, 1, 0, 0, 0, 0,
+                        (uint8_t *) bits, byte_stride);
+
+    exposed = glamor_copy_area(&tmp_pixmap->drawable, drawable, gc,
+                               0, 0, w, h, x, y);
+    if (exposed)
+        RegionDestroy(exposed);
+
+    glamor_destroy_pixmap(tmp_pixmap);
+    return TRUE;
+}
+
 static Bool
 glamor_put_image_gl(DrawablePtr drawable, GCPtr gc, int depth, int x, int y,
                     int w, int h, int leftPad, int format, char *bits)
@@ -46,18 +84,16 @@ glamor_put_image_gl(DrawablePtr drawable, GCPtr gc, int depth, int x, int y,
     if (!GLAMOR_PIXMAP_PRIV_HAS_FBO(pixmap_priv))
         return FALSE;
 
-    if (gc->alu != GXcopy)
-        goto bail;
-
-    if (!glamor_pm_is_solid(gc->depth, gc->planemask))
-        goto bail;
-
     if (format == XYPixmap && drawable->depth == 1 && leftPad == 0)
         format = ZPixmap;
 
     if (format != ZPixmap)
         goto bail;
 
+    if (gc->alu != GXcopy || !glamor_pm_is_solid(gc->depth, gc->planemask))
+        return glamor_put_image_copy(drawable, gc, x, y, w, h,
+                                     bits, byte_stride);
+
     x += drawable->x;
     y += drawable->y;
     box.x1 = x;
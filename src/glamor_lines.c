@@ -60,6 +60,10 @@ glamor_poly_lines_solid_gl(DrawablePtr drawable, GCPtr gc,
 
     glamor_make_current(glamor_priv);
 
+    if (glamor_gc_needs_dest_copy(screen, gc) &&
+        !glamor_set_dest_copy_bounds_lines(drawable, gc, mode, n, points))
+        goto bail;
+
     prog = glamor_use_program_fill(pixmap, gc,
                                    &glamor_priv->poly_line_program,
                                    &glamor_facet_poly_lines);
@@ -108,15 +108,82 @@ glamor_set_destination_pixmap(PixmapPtr pixmap)
     return err;
 }
 
+/*
+ * Returns whether the planemask selects whole 8-bit channels, which
+ * glColorMask can apply, and which channels those are.
+ */
+static Bool
+glamor_planemask_channels(int depth, unsigned long planemask,
+                          GLboolean *channels)
+{
+    unsigned long bits[4];
+    int i;
+
+    switch (depth) {
+    case 1:
+        planemask = (planemask & 1) ? 0xff : 0;
+        /* fall through */
+    case 8:
+        bits[0] = bits[1] = bits[2] = bits[3] = planemask & 0xff;
+        break;
+    case 24:
+    case 32:
+        bits[0] = (planemask >> 16) & 0xff;
+        bits[1] = (planemask >> 8) & 0xff;
+        bits[2] = planemask & 0xff;
+        bits[3] = depth == 32 ? (planemask >> 24) & 0xff : 0xff;
+        break;
+    default:
+        return FALSE;
+    }
+
+    for (i = 0; i < 4; i++) {
+        if (bits[i] != 0 && bits[i] != 0xff)
+            return FALSE;
+        channels[i] = bits[i] != 0;
+    }
+    return TRUE;
+}
+
+/*
+ * Sets glColorMask for the planemask, putting it back to all channels
+ * for a full one, so it doesn't matter what was drawn before or
+ * whether the alu is set first.
+ */
 Bool
-glamor_set_planemask(int depth, unsigned long planemask)
+glamor_set_planemask(ScreenPtr screen, int depth, unsigned long planemask)
 {
-    if (glamor_pm_is_solid(depth, planemask)) {
+    glamor_screen_private *glamor_priv = glamor_get_screen_private(screen);
+    GLboolean channels[4];
+
+    /* Framebuffer fetch programs mask the planes in the shader. */
+    if (glamor_pm_is_solid(depth, planemask) || glamor_priv->fb_fetch_active) {
+        if (glamor_priv->color_mask_active) {
+            glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+            glamor_priv->color_mask_active = FALSE;
+        }
         return GL_TRUE;
     }
 
-    glamor_fallback("unsupported planemask %lx\n", planemask);
-    return GL_FALSE;
+    if (!glamor_planemask_channels(depth, planemask, channels)) {
+        glamor_fallback("unsupported planemask %lx\n", planemask);
+        return GL_FALSE;
+    }
+
+    glColorMask(channels[0], channels[1], channels[2], channels[3]);
+    glamor_priv->color_mask_active = TRUE;
+    return GL_TRUE;
+}
+
+/*
+ * Drawing that doesn't come from a GC, like Render and internal
+ * copies, writes every plane with GXcopy.
+ */
+void
+glamor_set_gxcopy(ScreenPtr screen)
+{
+    glamor_set_alu(screen, GXcopy);
+    glamor_set_planemask(screen, 32, ~0UL);
 }
 
 Bool
@@ -124,6 +191,10 @@ glamor_set_alu(ScreenPtr screen, unsigned char alu)
 {
     glamor_screen_private *glamor_priv = glamor_get_screen_private(screen);
 
+    /* Framebuffer fetch programs apply the alu in the shader. */
+    if (glamor_priv->fb_fetch_active)
+        alu = GXcopy;
+
     if (glamor_priv->gl_flavor == GLAMOR_GL_ES2) {
         if (alu != GXcopy)
             return FALSE;
@@ -189,3 +260,42 @@ glamor_set_alu(ScreenPtr screen, unsigned char alu)
 
     return TRUE;
 }
+
+/*
+ * GLES has no logic ops, and neither GL can apply planemasks that
+ * don't line up with whole channels, so GCs using either need a
+ * program applying them with framebuffer fetch, or with a copy of
+ * the destination when that is missing. That is limited to depths
+ * whose channels all hold 8 bits.
+ */
+Bool
+glamor_gc_needs_dest_read(ScreenPtr screen, GCPtr gc)
+{
+    glamor_screen_private *glamor_priv = glamor_get_screen_private(screen);
+    GLboolean channels[4];
+
+    if (!gc)
+        return FALSE;
+
+    if (gc->depth != 1 && gc->depth != 8 &&
+        gc->depth != 24 && gc->depth != 32)
+        return FALSE;
+
+    if (gc->alu != GXcopy && glamor_priv->gl_flavor == GLAMOR_GL_ES2)
+        return TRUE;
+
+    return !glamor_planemask_channels(gc->depth, gc->planemask, channels);
+}
+
+/*
+ * Whether the GC's program reads a copy of the destination, and so
+ * needs glamor_set_dest_copy_bounds before it is set up.
+ */
+Bool
+glamor_gc_needs_dest_copy(ScreenPtr screen, GCPtr gc)
+{
+    glamor_screen_private *glamor_priv = glamor_get_screen_private(screen);
+
+    return !glamor_priv->fb_fetch_header &&
+        glamor_gc_needs_dest_read(screen, gc);
+}
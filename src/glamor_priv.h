@@ -80,6 +80,20 @@ typedef struct glamor_composite_shader {
     GLint mask_wh;
     GLint source_repeat_mode;
     GLint mask_repeat_mode;
+    GLint source_texel;
+    GLint source_kernel_size;
+    GLint source_kernel;
+    GLint source_kernel_x;
+    GLint source_kernel_y;
+    GLint source_transform;
+    GLint source_gradient;
+    GLint source_gradient_delta;
+    GLint source_ramp_row;
+    GLint dest_coords;
+    GLint dest_opaque;
+    GLint combine_fa;
+    GLint combine_fb;
+    GLint combine_mode;
     union {
         float source_solid_color[4];
         struct {
@@ -107,6 +121,9 @@ enum shader_source {
     SHADER_SOURCE_SOLID,
     SHADER_SOURCE_TEXTURE,
     SHADER_SOURCE_TEXTURE_ALPHA,
+    SHADER_SOURCE_LINEAR_GRADIENT,
+    SHADER_SOURCE_RADIAL_GRADIENT,
+    SHADER_SOURCE_CONICAL_GRADIENT,
     SHADER_SOURCE_COUNT,
 };
 
@@ -124,11 +141,42 @@ enum shader_dest_swizzle {
     SHADER_DEST_SWIZZLE_COUNT,
 };
 
+/* Filtering applied to the source texture. Convolution kernels that
+ * factor into a row and a column vector use the separable variant,
+ * which needs only width + height weights.
+ */
+enum shader_filter {
+    SHADER_FILTER_NONE,
+    SHADER_FILTER_CONVOLUTION,
+    SHADER_FILTER_SEPARABLE,
+    SHADER_FILTER_COUNT,
+};
+
+/* Upper bound on the kernel weights passed as uniforms; the actual
+ * limit is lowered at init to fit the fragment uniform space.
+ */
+#define GLAMOR_CONVOLUTION_MAX_TAPS     64
+
+/* How the composite result is combined with the destination. All but
+ * SHADER_COMBINE_BLEND read the destination in the shader and write the
+ * final color with blending disabled.
+ */
+enum shader_combine {
+    SHADER_COMBINE_BLEND,
+    SHADER_COMBINE_DISJOINT,
+    SHADER_COMBINE_CONJOINT,
+    SHADER_COMBINE_SEPARABLE,
+    SHADER_COMBINE_NONSEPARABLE,
+    SHADER_COMBINE_COUNT,
+};
+
 struct shader_key {
     enum shader_source source;
     enum shader_mask mask;
     glamor_program_alpha in;
     enum shader_dest_swizzle dest_swizzle;
+    enum shader_filter filter;
+    enum shader_combine combine;
 };
 
 struct blendinfo {
@@ -162,6 +210,20 @@ enum gradient_shader {
     SHADER_GRADIENT_COUNT,
 };
 
+/* Gradient stops are expanded into rows of a shared color ramp
+ * texture, cached by stops and repeat type.
+ */
+#define GLAMOR_GRADIENT_RAMP_WIDTH 1024
+#define GLAMOR_GRADIENT_RAMP_ROWS 64
+
+typedef struct glamor_gradient_ramp {
+    uint32_t hash;
+    int repeat;
+    int nstops;
+    PictGradientStop *stops;
+    uint32_t last_used;
+} glamor_gradient_ramp;
+
 struct glamor_screen_private;
 struct glamor_pixmap_private;
 
@@ -184,6 +246,8 @@ struct glamor_saved_procs {
     CompositeRectsProcPtr composite_rects;
     TrapezoidsProcPtr trapezoids;
     GlyphsProcPtr glyphs;
+    RealizeGlyphProcPtr realize_glyph;
+    UnrealizeGlyphProcPtr unrealize_glyph;
     ChangeWindowAttributesProcPtr change_window_attributes;
     CopyWindowProcPtr copy_window;
     BitmapToRegionProcPtr bitmap_to_region;
@@ -198,12 +262,26 @@ struct glamor_saved_procs {
 typedef struct glamor_screen_private {
     enum glamor_gl_flavor gl_flavor;
     int glsl_version;
+    /* GLES 3 context, where programs asking for GLSL 1.30 are built
+       as ESSL 3.00 instead. */
+    Bool has_glsl_es3;
     Bool has_pack_invert;
     Bool has_fbo_blit;
     Bool has_map_buffer_range;
     Bool has_buffer_storage;
     Bool has_khr_debug;
     Bool has_nv_texture_barrier;
+    /* Fragment shader header enabling framebuffer fetch and defining
+       LAST_FRAG_COLOR, or NULL when the GL can't read the fbo. */
+    const char *fb_fetch_header;
+    /* The same for ESSL 3.00 programs */
+    const char *fb_fetch_es3_header;
+    /* Set while a program that applies the GC alu and planemask with
+       framebuffer fetch, or with a copy of the destination, is being
+       set up. */
+    Bool fb_fetch_active;
+    /* Set while glColorMask applies a planemask. */
+    Bool color_mask_active;
     Bool has_pack_subimage;
     Bool has_unpack_subimage;
     Bool has_rw_pbo;
@@ -233,9 +311,12 @@ typedef struct glamor_screen_private {
     glamor_program_fill poly_text_progs;
     glamor_program      te_text_prog;
     glamor_program      image_text_prog;
+    struct glamor_text_batch    *text_batch;
+    Bool                text_pending;
 
     /* glamor copy shaders */
     glamor_program      copy_area_prog;
+    glamor_program      copy_area_fetch_prog;
     glamor_program      copy_plane_prog;
 
     /* glamor line shader */
@@ -248,10 +329,15 @@ typedef struct glamor_screen_private {
     glamor_program_fill on_off_dash_line_progs;
     glamor_program      double_dash_line_prog;
 
+    /* glamor trapezoid shaders, antialiased and sharp */
+    glamor_program      trapezoid_progs[2];
+
     /* glamor composite_glyphs shaders */
     glamor_program_render       glyphs_program;
+    glamor_program_render       glyphs_texture_program;
     struct glamor_glyph_atlas   *glyph_atlas_a;
     struct glamor_glyph_atlas   *glyph_atlas_argb;
+    struct xorg_list            glyph_pending;
     int                         glyph_atlas_dim;
     int                         glyph_max_dim;
     char                        *glyph_defines;
@@ -284,13 +370,26 @@ typedef struct glamor_screen_private {
     glamor_composite_shader composite_shader[SHADER_SOURCE_COUNT]
         [SHADER_MASK_COUNT]
         [glamor_program_alpha_count]
-        [SHADER_DEST_SWIZZLE_COUNT];
-
-    /* glamor gradient, 0 for small nstops, 1 for
-       large nstops and 2 for dynamic generate. */
-    GLint gradient_prog[SHADER_GRADIENT_COUNT][3];
-    int linear_max_nstops;
-    int radial_max_nstops;
+        [SHADER_DEST_SWIZZLE_COUNT]
+        [SHADER_FILTER_COUNT]
+        [SHADER_COMBINE_COUNT];
+    int convolution_max_taps;
+
+    /* Scratch copy of the destination for composite shaders and GC
+       programs that read it, when the destination texture can't be
+       sampled directly. */
+    glamor_pixmap_fbo *dest_copy_fbo;
+    /* Area, in pixmap coordinates, the next GC program reading the
+       destination copy copies, set by glamor_set_dest_copy_bounds. */
+    BoxRec dest_copy_box;
+    Bool dest_copy_pending;
+
+    /* glamor gradient programs, and the color ramps of recently
+       used gradients with an LRU serial. */
+    GLint gradient_prog[SHADER_GRADIENT_COUNT];
+    GLuint gradient_ramp_texture;
+    glamor_gradient_ramp gradient_ramps[GLAMOR_GRADIENT_RAMP_ROWS];
+    uint32_t gradient_ramp_serial;
 
     int screen_fbo;
     struct glamor_saved_procs saved_procs;
@@ -557,6 +656,9 @@ glamor_pixmap_fbo *glamor_create_fbo(glamor_screen_private *glamor_priv, int w,
 void glamor_destroy_fbo(glamor_screen_private *glamor_priv,
                         glamor_pixmap_fbo *fbo);
 void glamor_pixmap_destroy_fbo(PixmapPtr pixmap);
+glamor_pixmap_fbo *glamor_copy_dest_box(glamor_screen_private *glamor_priv,
+                                        glamor_pixmap_fbo *fbo,
+                                        const BoxRec *box, GLenum unit);
 Bool glamor_pixmap_fbo_fixup(ScreenPtr screen, PixmapPtr pixmap);
 
 /* Return whether 'picture' is alpha-only */
@@ -615,7 +717,10 @@ void glamor_set_destination_pixmap_fbo(glamor_screen_private *glamor_priv, glamo
 void glamor_set_destination_pixmap_priv_nc(glamor_screen_private *glamor_priv, PixmapPtr pixmap, glamor_pixmap_private *pixmap_priv);
 
 Bool glamor_set_alu(ScreenPtr screen, unsigned char alu);
-Bool glamor_set_planemask(int depth, unsigned long planemask);
+Bool glamor_set_planemask(ScreenPtr screen, int depth, unsigned long planemask);
+void glamor_set_gxcopy(ScreenPtr screen);
+Bool glamor_gc_needs_dest_read(ScreenPtr screen, GCPtr gc);
+Bool glamor_gc_needs_dest_copy(ScreenPtr screen, GCPtr gc);
 RegionPtr glamor_bitmap_to_region(PixmapPtr pixmap);
 
 void
@@ -649,14 +754,28 @@ void glamor_composite_rects(CARD8 op,
                             PicturePtr pDst,
                             xRenderColor *color, int nRect, xRectangle *rects);
 
+void glamor_fini_composite(ScreenPtr screen);
+
 /* glamor_trapezoid.c */
 void glamor_trapezoids(CARD8 op,
                        PicturePtr src, PicturePtr dst,
                        PictFormatPtr mask_format, INT16 x_src, INT16 y_src,
                        int ntrap, xTrapezoid *traps);
+void glamor_composite_trapezoids(CARD8 op,
+                                 PicturePtr src, PicturePtr dst,
+                                 PictFormatPtr mask_format,
+                                 INT16 x_src, INT16 y_src,
+                                 INT16 x_dst, INT16 y_dst,
+                                 int ntrap, xTrapezoid *traps);
+Bool glamor_rasterize_trapezoids(PixmapPtr pixmap, Bool sharp,
+                                 int x_off, int y_off,
+                                 int ntrap, xTrapezoid *traps);
 
 /* glamor_gradient.c */
 void glamor_init_gradient_shader(ScreenPtr screen);
+void glamor_fini_gradient_shader(ScreenPtr screen);
+GLfloat glamor_gradient_bind_ramp(ScreenPtr screen, PicturePtr picture,
+                                  int unit);
 PicturePtr glamor_generate_linear_gradient_picture(ScreenPtr screen,
                                                    PicturePtr src_picture,
                                                    int x_source, int y_source,
@@ -667,6 +786,10 @@ PicturePtr glamor_generate_radial_gradient_picture(ScreenPtr screen,
                                                    int x_source, int y_source,
                                                    int width, int height,
                                                    PictFormatShort format);
+Bool glamor_gradient_composite_supported(PicturePtr picture);
+void glamor_set_composite_gradient(ScreenPtr screen,
+                                   glamor_composite_shader *shader,
+                                   PicturePtr picture);
 
 /* glamor_triangles.c */
 void glamor_triangles(CARD8 op,
@@ -749,6 +872,20 @@ void glamor_image_text8(DrawablePtr pDrawable, GCPtr pGC,
 void glamor_image_text16(DrawablePtr pDrawable, GCPtr pGC,
                          int x, int y, int count, unsigned short *chars);
 
+void glamor_image_glyph_blt(DrawablePtr pDrawable, GCPtr pGC,
+                            int x, int y, unsigned int nglyph,
+                            CharInfoPtr *ppci, void *pglyphBase);
+
+Bool glamor_poly_glyph_blt_text(DrawablePtr pDrawable, GCPtr pGC,
+                                int x, int y, unsigned int nglyph,
+                                CharInfoPtr *ppci);
+
+void glamor_text_flush(glamor_screen_private *glamor_priv);
+
+void glamor_text_flush_pixmap(PixmapPtr pixmap);
+
+void glamor_text_fini(ScreenPtr screen);
+
 /* glamor_spans.c */
 void
 glamor_fill_spans(DrawablePtr drawable,
@@ -768,6 +905,11 @@ void
 glamor_poly_fill_rect(DrawablePtr drawable,
                       GCPtr gc, int nrect, xRectangle *prect);
 
+#define GLAMOR_CLEAR_MAX_BOXES  32
+
+void
+glamor_clear_boxes(PixmapPtr pixmap, BoxPtr box, int nbox, CARD32 pixel);
+
 /* glamor_image.c */
 void
 glamor_put_image(DrawablePtr drawable, GCPtr gc, int depth, int x, int y,
@@ -820,10 +962,6 @@ glamor_copy_plane(DrawablePtr src, DrawablePtr dst, GCPtr gc,
                   unsigned long bitplane);
 
 /* glamor_glyphblt.c */
-void glamor_image_glyph_blt(DrawablePtr pDrawable, GCPtr pGC,
-                            int x, int y, unsigned int nglyph,
-                            CharInfoPtr *ppci, void *pglyphBase);
-
 void glamor_poly_glyph_blt(DrawablePtr pDrawable, GCPtr pGC,
                            int x, int y, unsigned int nglyph,
                            CharInfoPtr *ppci, void *pglyphBase);
@@ -855,6 +993,15 @@ glamor_composite_glyphs(CARD8 op,
                         INT16 y_src, int nlist,
                         GlyphListPtr list, GlyphPtr *glyphs);
 
+Bool
+glamor_realize_glyph(ScreenPtr screen, GlyphPtr glyph);
+
+void
+glamor_unrealize_glyph(ScreenPtr screen, GlyphPtr glyph);
+
+void
+glamor_composite_glyphs_upload(ScreenPtr screen);
+
 /* glamor_sync.c */
 Bool
 glamor_sync_init(ScreenPtr screen);
@@ -871,6 +1018,10 @@ void
 glamor_solid_boxes(PixmapPtr pixmap,
                    BoxPtr box, int nbox, unsigned long fg_pixel);
 
+void
+glamor_solid_boxes_planemask(PixmapPtr pixmap, BoxPtr box, int nbox,
+                             unsigned long fg_pixel, unsigned long planemask);
+
 
 /* glamor_xv */
 typedef struct {
@@ -91,6 +91,346 @@ static const glamor_facet glamor_fill_opaque_stipple = {
     .use = use_opaque_stipple
 };
 
+/*
+ * Framebuffer fetch output stages. The alu one applies the GC function
+ * and planemask bit by bit on 8-bit channel values, using the alu as
+ * a truth table indexed by the source and destination bits. The blend
+ * one evaluates Render blending, including component alpha.
+ */
+static Bool
+use_fb_fetch_alu(PixmapPtr pixmap, GCPtr gc, glamor_program *prog, void *arg)
+{
+    int depth = gc ? gc->depth : pixmap->drawable.depth;
+    int alu = gc ? gc->alu : GXcopy;
+    unsigned long planemask = gc ? gc->planemask : ~0UL;
+    GLfloat alu_bits[4], planes[4];
+    int i;
+
+    /* Leave GL's own logic op and color mask off. */
+    glamor_set_gxcopy(pixmap->drawable.pScreen);
+
+    /* x: source and dest set, y: source only, z: dest only, w: neither */
+    for (i = 0; i < 4; i++)
+        alu_bits[i] = (alu >> i) & 1;
+
+    if (depth == 1) {
+        planes[0] = planes[1] = planes[2] = planes[3] =
+            (planemask & 1) ? 255 : 0;
+    } else if (depth == 8) {
+        planes[0] = planes[1] = planes[2] = planes[3] = planemask & 0xff;
+    } else {
+        planes[0] = (planemask >> 16) & 0xff;
+        planes[1] = (planemask >> 8) & 0xff;
+        planes[2] = planemask & 0xff;
+        planes[3] = depth == 32 ? (planemask >> 24) & 0xff : 0;
+    }
+
+    glUniform4fv(prog->fetch_alu_uniform, 1, alu_bits);
+    glUniform4fv(prog->fetch_planemask_uniform, 1, planes);
+    return TRUE;
+}
+
+#define FETCH_COMBINE_VARS                                              \
+    "uniform vec4 fetch_alu;\n"                                         \
+    "uniform vec4 fetch_planemask;\n"                                   \
+    "vec4 fetch_combine(vec4 src, vec4 dst)\n"                          \
+    "{\n"                                                               \
+    "       vec4 s = floor(src * 255.0 + 0.5);\n"                       \
+    "       vec4 d = floor(dst * 255.0 + 0.5);\n"                       \
+    "       vec4 pm = fetch_planemask;\n"                               \
+    "       vec4 result = vec4(0.0);\n"                                 \
+    "       float bit = 1.0;\n"                                         \
+    "       for (int i = 0; i < 8; i++) {\n"                            \
+    "               vec4 sb = mod(s, 2.0);\n"                           \
+    "               vec4 db = mod(d, 2.0);\n"                           \
+    "               vec4 rb = sb * db * fetch_alu.x +\n"                \
+    "                         sb * (1.0 - db) * fetch_alu.y +\n"        \
+    "                         (1.0 - sb) * db * fetch_alu.z +\n"        \
+    "                         (1.0 - sb) * (1.0 - db) * fetch_alu.w;\n" \
+    "               result += mix(db, rb, mod(pm, 2.0)) * bit;\n"       \
+    "               s = floor(s * 0.5);\n"                              \
+    "               d = floor(d * 0.5);\n"                              \
+    "               pm = floor(pm * 0.5);\n"                            \
+    "               bit *= 2.0;\n"                                      \
+    "       }\n"                                                        \
+    "       return result / 255.0;\n"                                   \
+    "}\n"
+
+static const glamor_facet glamor_fb_fetch_alu = {
+    .name = "fb_fetch_alu",
+    .fs_vars = FETCH_COMBINE_VARS,
+    .fs_exec = "       gl_FragColor = fetch_combine(gl_FragColor, LAST_FRAG_COLOR);\n",
+    .use = use_fb_fetch_alu,
+};
+
+/*
+ * Without framebuffer fetch, the alu stage reads a copy of the
+ * destination instead, taken when the program is set up over the
+ * bounds the caller passed to glamor_set_dest_copy_bounds.
+ */
+static const char glamor_dest_copy_header[] =
+    "#define LAST_FRAG_COLOR texture2D(fetch_dest, (gl_FragCoord.xy - fetch_dest_coords.xy) * fetch_dest_coords.zw)\n";
+
+static Bool
+use_dest_copy_alu(PixmapPtr pixmap, GCPtr gc, glamor_program *prog, void *arg)
+{
+    glamor_screen_private *glamor_priv =
+        glamor_get_screen_private(pixmap->drawable.pScreen);
+    glamor_pixmap_private *pixmap_priv = glamor_get_pixmap_private(pixmap);
+    glamor_pixmap_fbo *fbo = pixmap_priv->fbo;
+    glamor_pixmap_fbo *copy;
+    GLfloat coords[4];
+    BoxRec box;
+
+    /* Each set of bounds is good for one program setup */
+    if (!glamor_priv->dest_copy_pending) {
+        glamor_fallback("destination copy without bounds\n");
+        return FALSE;
+    }
+    glamor_priv->dest_copy_pending = FALSE;
+    box = glamor_priv->dest_copy_box;
+
+    /* The copy is taken once, so it has to cover the whole drawing. */
+    if (!glamor_pixmap_priv_is_small(pixmap_priv)) {
+        glamor_fallback("destination copy of a large pixmap\n");
+        return FALSE;
+    }
+
+    if (box.x1 >= box.x2 || box.y1 >= box.y2)
+        return use_fb_fetch_alu(pixmap, gc, prog, arg);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo->fb);
+    copy = glamor_copy_dest_box(glamor_priv, fbo, &box, GL_TEXTURE2);
+    if (!copy)
+        return FALSE;
+
+    coords[0] = box.x1;
+    coords[1] = box.y1;
+    coords[2] = 1.0 / copy->width;
+    coords[3] = 1.0 / copy->height;
+    glUniform1i(prog->fetch_dest_uniform, 2);
+    glUniform4fv(prog->fetch_dest_coords_uniform, 1, coords);
+
+    return use_fb_fetch_alu(pixmap, gc, prog, arg);
+}
+
+static const glamor_facet glamor_dest_copy_alu = {
+    .name = "dest_copy_alu",
+    .fs_vars = ("uniform sampler2D fetch_dest;\n"
+                "uniform vec4 fetch_dest_coords;\n"
+                FETCH_COMBINE_VARS),
+    .fs_exec = "       gl_FragColor = fetch_combine(gl_FragColor, LAST_FRAG_COLOR);\n",
+    .use = use_dest_copy_alu,
+};
+
+/*
+ * Adds a box to the bounds, noting whether it may overlap one added
+ * before. That is exact for boxes that come in rows from top to
+ * bottom, each row from left to right, like spans and region boxes,
+ * and for boxes each clear of all the ones before, like a run of
+ * glyphs. Anything else landing within the extents so far counts as
+ * overlapping.
+ */
+void
+glamor_dest_bounds_add(glamor_dest_bounds *bounds,
+                       int x1, int y1, int x2, int y2)
+{
+    BoxPtr extents = &bounds->extents;
+    BoxPtr band = &bounds->band;
+
+    if (x1 >= x2 || y1 >= y2)
+        return;
+
+    if (y1 >= extents->y2) {
+        /* Below everything so far, starting a new row */
+        band->x1 = x1;
+        band->y1 = y1;
+        band->x2 = x2;
+        band->y2 = y2;
+    } else if (y1 == band->y1 && y2 == band->y2 && x1 >= band->x2) {
+        /* Further along the current row */
+        band->x2 = x2;
+    } else if (x1 >= extents->x2 || x2 <= extents->x1 ||
+               y2 <= extents->y1) {
+        /* Clear of everything so far, but no longer in rows */
+        band->y2 = band->y1;
+    } else {
+        bounds->overlap = TRUE;
+    }
+
+    extents->x1 = min(extents->x1, x1);
+    extents->y1 = min(extents->y1, y1);
+    extents->x2 = max(extents->x2, x2);
+    extents->y2 = max(extents->y2, y2);
+}
+
+/*
+ * Sets the area the next program reading a destination copy will
+ * copy: the bounds, in screen coordinates, clipped by the GC and the
+ * pixmap. Returns FALSE when the primitives may overlap, which a
+ * single copy can't handle.
+ */
+Bool
+glamor_set_dest_copy_bounds(DrawablePtr drawable, GCPtr gc,
+                            const glamor_dest_bounds *bounds)
+{
+    glamor_screen_private *glamor_priv =
+        glamor_get_screen_private(drawable->pScreen);
+    PixmapPtr pixmap = glamor_get_drawable_pixmap(drawable);
+    BoxPtr clip = RegionExtents(gc->pCompositeClip);
+    BoxPtr box = &glamor_priv->dest_copy_box;
+    int off_x, off_y;
+
+    if (bounds->overlap) {
+        glamor_fallback("overlapping primitives need the destination between them\n");
+        return FALSE;
+    }
+
+    glamor_get_drawable_deltas(drawable, pixmap, &off_x, &off_y);
+
+    box->x1 = max(max(bounds->extents.x1, clip->x1) + off_x, 0);
+    box->y1 = max(max(bounds->extents.y1, clip->y1) + off_y, 0);
+    box->x2 = min(min(bounds->extents.x2, clip->x2) + off_x,
+                  pixmap->drawable.width);
+    box->y2 = min(min(bounds->extents.y2, clip->y2) + off_y,
+                  pixmap->drawable.height);
+    glamor_priv->dest_copy_pending = TRUE;
+    return TRUE;
+}
+
+/*
+ * Bounds for zero-width lines, in drawable coordinates.
+ */
+static void
+glamor_dest_bounds_add_line(glamor_dest_bounds *bounds, DrawablePtr drawable,
+                            int x1, int y1, int x2, int y2)
+{
+    glamor_dest_bounds_add(bounds,
+                           drawable->x + min(x1, x2),
+                           drawable->y + min(y1, y2),
+                           drawable->x + max(x1, x2) + 1,
+                           drawable->y + max(y1, y2) + 1);
+}
+
+#define GLAMOR_DEST_BOUNDS_MAX_LINES    16
+
+/*
+ * The lines of a zero-width polyline draw the points they share only
+ * once, so reading the destination as it was before the request is
+ * right for those. Each horizontal or vertical line after the first
+ * leaves out its first point, and the last one its end point when the
+ * polyline is closed; the polyline can use a destination copy if what
+ * is left of its lines doesn't overlap. That covers the rectangles of
+ * miPolyRectangle. Other lines keep their joints, and so overlap.
+ */
+Bool
+glamor_set_dest_copy_bounds_lines(DrawablePtr drawable, GCPtr gc,
+                                  int mode, int n, DDXPointPtr points)
+{
+    glamor_dest_bounds bounds;
+    BoxRec line[GLAMOR_DEST_BOUNDS_MAX_LINES];
+    int x = points[0].x, y = points[0].y;
+    int nline = 0;
+    int i, j;
+
+    glamor_dest_bounds_init(&bounds);
+
+    if (n - 1 > GLAMOR_DEST_BOUNDS_MAX_LINES) {
+        bounds.overlap = TRUE;
+        return glamor_set_dest_copy_bounds(drawable, gc, &bounds);
+    }
+
+    for (i = 1; i < n; i++) {
+        int next_x = points[i].x, next_y = points[i].y;
+        BoxPtr box = &line[nline];
+
+        if (mode == CoordModePrevious) {
+            next_x += x;
+            next_y += y;
+        }
+
+        box->x1 = drawable->x + min(x, next_x);
+        box->y1 = drawable->y + min(y, next_y);
+        box->x2 = drawable->x + max(x, next_x) + 1;
+        box->y2 = drawable->y + max(y, next_y) + 1;
+
+        /* Leave out the point shared with the line before, and with
+         * the first line when the polyline is closed
+         */
+        if (i > 1 && y == next_y) {
+            if (next_x >= x)
+                box->x1++;
+            else
+                box->x2--;
+            if (i == n - 1 && next_x == points[0].x && next_y == points[0].y) {
+                if (next_x >= x)
+                    box->x2--;
+                else
+                    box->x1++;
+            }
+        } else if (i > 1 && x == next_x) {
+            if (next_y >= y)
+                box->y1++;
+            else
+                box->y2--;
+            if (i == n - 1 && next_x == points[0].x && next_y == points[0].y) {
+                if (next_y >= y)
+                    box->y2--;
+                else
+                    box->y1++;
+            }
+        }
+
+        if (box->x1 < box->x2 && box->y1 < box->y2)
+            nline++;
+
+        x = next_x;
+        y = next_y;
+    }
+
+    for (i = 0; i < nline; i++) {
+        for (j = 0; j < i; j++)
+            if (line[i].x1 < line[j].x2 && line[j].x1 < line[i].x2 &&
+                line[i].y1 < line[j].y2 && line[j].y1 < line[i].y2)
+                bounds.overlap = TRUE;
+
+        bounds.extents.x1 = min(bounds.extents.x1, line[i].x1);
+        bounds.extents.y1 = min(bounds.extents.y1, line[i].y1);
+        bounds.extents.x2 = max(bounds.extents.x2, line[i].x2);
+        bounds.extents.y2 = max(bounds.extents.y2, line[i].y2);
+    }
+
+    return glamor_set_dest_copy_bounds(drawable, gc, &bounds);
+}
+
+Bool
+glamor_set_dest_copy_bounds_segments(DrawablePtr drawable, GCPtr gc,
+                                     int nseg, xSegment *segs)
+{
+    glamor_dest_bounds bounds;
+    int i;
+
+    glamor_dest_bounds_init(&bounds);
+    for (i = 0; i < nseg; i++)
+        glamor_dest_bounds_add_line(&bounds, drawable,
+                                    segs[i].x1, segs[i].y1,
+                                    segs[i].x2, segs[i].y2);
+    return glamor_set_dest_copy_bounds(drawable, gc, &bounds);
+}
+
+static const glamor_facet glamor_fb_fetch_blend = {
+    .name = "fb_fetch_blend",
+    .fs_vars = ("uniform vec3 fetch_blend_source;\n"
+                "uniform vec3 fetch_blend_dest;\n"),
+    .fs_exec = ("       vec4 dest = LAST_FRAG_COLOR;\n"
+                "       vec4 source_alpha = source.a * mask;\n"
+                "       gl_FragColor = source * mask *\n"
+                "               dot(fetch_blend_source, vec3(1.0, dest.a, 1.0 - dest.a)) +\n"
+                "               dest * (fetch_blend_dest.x +\n"
+                "                       fetch_blend_dest.y * source_alpha +\n"
+                "                       fetch_blend_dest.z * (1.0 - source_alpha));\n"),
+};
+
 static const glamor_facet *glamor_facet_fill[4] = {
     &glamor_fill_solid,
     &glamor_fill_tile,
@@ -142,6 +482,15 @@ static glamor_location_var location_vars[] = {
         .location = glamor_program_location_atlas,
         .fs_vars = "uniform sampler2D atlas;\n",
     },
+    {
+        .location = glamor_program_location_atlas_array,
+        .fs_vars = "uniform sampler2DArray atlas;\n",
+    },
+    {
+        .location = glamor_program_location_font_a8,
+        .vs_vars = "uniform vec2 font_size_inv;\n",
+        .fs_vars = "uniform sampler2D font;\n",
+    },
 };
 
 static char *
@@ -187,6 +536,7 @@ fs_location_vars(glamor_program_location locations)
 
 static const char vs_template[] =
     "%s"                                /* version */
+    "%s"                                /* compat */
     "%s"                                /* defines */
     "%s"                                /* prim vs_vars */
     "%s"                                /* fill vs_vars */
@@ -199,15 +549,19 @@ static const char vs_template[] =
 
 static const char fs_template[] =
     "%s"                                /* version */
+    "%s"                                /* extensions */
     GLAMOR_DEFAULT_PRECISION
+    "%s"                                /* compat */
     "%s"                                /* defines */
     "%s"                                /* prim fs_vars */
     "%s"                                /* fill fs_vars */
     "%s"                                /* location fs_vars */
+    "%s"                                /* fetch fs_vars */
     "void main() {\n"
     "%s"                                /* prim fs_exec */
     "%s"                                /* fill fs_exec */
     "%s"                                /* combine */
+    "%s"                                /* fetch fs_exec */
     "}\n";
 
 static const char *
@@ -222,6 +576,26 @@ static const glamor_facet facet_null_fill = {
     .name = ""
 };
 
+/* Maps the GLSL 1.30 dialect of our programs onto ESSL 3.00 */
+static const char es3_vs_compat[] =
+    "#define attribute in\n"
+    "#define varying out\n";
+
+static const char es3_fs_compat[] =
+    "precision mediump sampler2DArray;\n"
+    "#define varying in\n"
+    "#define texture2D texture\n"
+    "#ifdef FRAG_COLOR_INOUT\n"
+    "inout vec4 frag_color;\n"
+    "#else\n"
+    "out vec4 frag_color;\n"
+    "#endif\n"
+    "#define gl_FragColor frag_color\n";
+
+static const char dual_blend_fs_compat[] =
+    "out vec4 color0;\n"
+    "out vec4 color1;\n";
+
 #define DBG 0
 
 static GLint
@@ -251,9 +625,14 @@ glamor_build_program(ScreenPtr          screen,
 
     glamor_program_location     locations = prim->locations;
     glamor_program_flag         flags = prim->flags;
+    const glamor_facet          *fetch = &facet_null_fill;
+    const char                  *fetch_header = NULL;
 
     int                         version = prim->version;
     char                        *version_string = NULL;
+    Bool                        es3 = FALSE;
+    const char                  *vs_compat = NULL;
+    const char                  *fs_compat = NULL;
 
     char                        *fs_vars = NULL;
     char                        *vs_vars = NULL;
@@ -270,8 +649,43 @@ glamor_build_program(ScreenPtr          screen,
     flags |= fill->flags;
     version = MAX(version, fill->version);
 
-    if (version > glamor_priv->glsl_version)
-        goto fail;
+    if (version > glamor_priv->glsl_version) {
+        if (version != 130 || !glamor_priv->has_glsl_es3 ||
+            !(flags & glamor_program_flag_es3))
+            goto fail;
+        es3 = TRUE;
+    }
+
+    if (prog->alpha == glamor_program_alpha_fb_fetch) {
+        if (!glamor_priv->fb_fetch_header)
+            goto fail;
+        fetch = &glamor_fb_fetch_blend;
+        fetch_header = glamor_priv->fb_fetch_header;
+    } else if (prog->dest_read) {
+        if (glamor_priv->fb_fetch_header) {
+            fetch = &glamor_fb_fetch_alu;
+            fetch_header = glamor_priv->fb_fetch_header;
+        } else {
+            fetch = &glamor_dest_copy_alu;
+            fetch_header = glamor_dest_copy_header;
+        }
+    }
+
+    if (es3) {
+        /* Only the blend fetch reads the destination before anything
+         * writes the output, which ESSL 3.00 fetch needs; dual source
+         * blending isn't there at all.
+         */
+        if (prog->dest_read || prog->alpha == glamor_program_alpha_dual_blend)
+            goto fail;
+        if (fetch_header)
+            fetch_header = glamor_priv->fb_fetch_es3_header;
+        vs_compat = es3_vs_compat;
+        fs_compat = es3_fs_compat;
+    } else if (version >= 130 &&
+               prog->alpha == glamor_program_alpha_dual_blend) {
+        fs_compat = dual_blend_fs_compat;
+    }
 
     vs_vars = vs_location_vars(locations);
     fs_vars = fs_location_vars(locations);
@@ -281,7 +695,11 @@ glamor_build_program(ScreenPtr          screen,
     if (!fs_vars)
         goto fail;
 
-    if (version) {
+    if (es3) {
+        version_string = strdup("#version 300 es\n");
+        if (!version_string)
+            goto fail;
+    } else if (version) {
         if (asprintf(&version_string, "#version %d\n", version) < 0)
             version_string = NULL;
         if (!version_string)
@@ -291,6 +709,7 @@ glamor_build_program(ScreenPtr          screen,
     if (asprintf(&vs_prog_string,
                  vs_template,
                  str(version_string),
+                 str(vs_compat),
                  str(defines),
                  str(prim->vs_vars),
                  str(fill->vs_vars),
@@ -302,13 +721,17 @@ glamor_build_program(ScreenPtr          screen,
     if (asprintf(&fs_prog_string,
                  fs_template,
                  str(version_string),
+                 str(fetch_header),
+                 str(fs_compat),
                  str(defines),
                  str(prim->fs_vars),
                  str(fill->fs_vars),
                  fs_vars,
+                 str(fetch->fs_vars),
                  str(prim->fs_exec),
                  str(fill->fs_exec),
-                 str(combine)) < 0)
+                 str(combine),
+                 str(fetch->fs_exec)) < 0)
         fs_prog_string = NULL;
 
     if (!vs_prog_string || !fs_prog_string)
@@ -326,6 +749,7 @@ glamor_build_program(ScreenPtr          screen,
     prog->prim_use_render = prim->use_render;
     prog->fill_use = fill->use;
     prog->fill_use_render = fill->use_render;
+    prog->fetch_use = fetch->use;
 
     vs_prog = glamor_compile_glsl_prog(GL_VERTEX_SHADER, vs_prog_string);
     fs_prog = glamor_compile_glsl_prog(GL_FRAGMENT_SHADER, fs_prog_string);
@@ -355,12 +779,25 @@ glamor_build_program(ScreenPtr          screen,
     prog->bg_uniform = glamor_get_uniform(prog, glamor_program_location_bg, "bg");
     prog->fill_offset_uniform = glamor_get_uniform(prog, glamor_program_location_fillpos, "fill_offset");
     prog->fill_size_inv_uniform = glamor_get_uniform(prog, glamor_program_location_fillpos, "fill_size_inv");
-    prog->font_uniform = glamor_get_uniform(prog, glamor_program_location_font, "font");
+    prog->font_uniform = glamor_get_uniform(prog,
+                                            glamor_program_location_font |
+                                            glamor_program_location_font_a8,
+                                            "font");
+    prog->font_size_inv_uniform = glamor_get_uniform(prog, glamor_program_location_font_a8, "font_size_inv");
     prog->bitplane_uniform = glamor_get_uniform(prog, glamor_program_location_bitplane, "bitplane");
     prog->bitmul_uniform = glamor_get_uniform(prog, glamor_program_location_bitplane, "bitmul");
     prog->dash_uniform = glamor_get_uniform(prog, glamor_program_location_dash, "dash");
     prog->dash_length_uniform = glamor_get_uniform(prog, glamor_program_location_dash, "dash_length");
-    prog->atlas_uniform = glamor_get_uniform(prog, glamor_program_location_atlas, "atlas");
+    prog->atlas_uniform = glamor_get_uniform(prog,
+                                             glamor_program_location_atlas |
+                                             glamor_program_location_atlas_array,
+                                             "atlas");
+    prog->fetch_alu_uniform = glamor_get_uniform(prog, glamor_program_location_none, "fetch_alu");
+    prog->fetch_planemask_uniform = glamor_get_uniform(prog, glamor_program_location_none, "fetch_planemask");
+    prog->fetch_blend_source_uniform = glamor_get_uniform(prog, glamor_program_location_none, "fetch_blend_source");
+    prog->fetch_blend_dest_uniform = glamor_get_uniform(prog, glamor_program_location_none, "fetch_blend_dest");
+    prog->fetch_dest_uniform = glamor_get_uniform(prog, glamor_program_location_none, "fetch_dest");
+    prog->fetch_dest_coords_uniform = glamor_get_uniform(prog, glamor_program_location_none, "fetch_dest_coords");
 
     free(version_string);
     free(fs_vars);
@@ -384,15 +821,30 @@ glamor_use_program(PixmapPtr            pixmap,
                    glamor_program       *prog,
                    void                 *arg)
 {
+    glamor_screen_private *glamor_priv =
+        glamor_get_screen_private(pixmap->drawable.pScreen);
+    Bool ret = FALSE;
+
     glUseProgram(prog->prog);
 
+    /* Let the facets' alu and planemask checks pass; the fetch stage
+     * applies them.
+     */
+    glamor_priv->fb_fetch_active = prog->fetch_use != NULL;
+
+    if (prog->fetch_use && !prog->fetch_use(pixmap, gc, prog, arg))
+        goto bail;
+
     if (prog->prim_use && !prog->prim_use(pixmap, gc, prog, arg))
-        return FALSE;
+        goto bail;
 
     if (prog->fill_use && !prog->fill_use(pixmap, gc, prog, arg))
-        return FALSE;
+        goto bail;
 
-    return TRUE;
+    ret = TRUE;
+bail:
+    glamor_priv->fb_fetch_active = FALSE;
+    return ret;
 }
 
 glamor_program *
@@ -406,6 +858,10 @@ glamor_use_program_fill(PixmapPtr               pixmap,
 
     int                         fill_style = gc->fillStyle;
     const glamor_facet          *fill;
+    Bool                        dest_read = glamor_gc_needs_dest_read(screen, gc);
+
+    if (dest_read)
+        prog = &program_fill->fetch_progs[fill_style];
 
     if (prog->failed)
         return FALSE;
@@ -415,6 +871,7 @@ glamor_use_program_fill(PixmapPtr               pixmap,
         if (!fill)
             return NULL;
 
+        prog->dest_read = dest_read;
         if (!glamor_build_program(screen, prog, prim, fill, NULL, NULL))
             return NULL;
     }
@@ -441,10 +898,32 @@ static struct blendinfo composite_op_info[] = {
     [PictOpAdd] = {0, 0, GL_ONE, GL_ONE},
 };
 
+/* Selects the x, y or z term of the fetch blend factors. */
 static void
-glamor_set_blend(CARD8 op, glamor_program_alpha alpha, PicturePtr dst)
+glamor_set_fetch_blend_factor(GLenum blend, GLint uniform)
 {
-    glamor_screen_private *glamor_priv = glamor_get_screen_private(dst->pDrawable->pScreen);
+    GLfloat factor[3] = { 0.0, 0.0, 0.0 };
+
+    switch (blend) {
+    case GL_ONE:
+        factor[0] = 1.0;
+        break;
+    case GL_SRC_ALPHA:
+    case GL_DST_ALPHA:
+        factor[1] = 1.0;
+        break;
+    case GL_ONE_MINUS_SRC_ALPHA:
+    case GL_ONE_MINUS_DST_ALPHA:
+        factor[2] = 1.0;
+        break;
+    }
+    glUniform3fv(uniform, 1, factor);
+}
+
+static void
+glamor_set_blend(CARD8 op, glamor_program *prog, PicturePtr dst)
+{
+    glamor_program_alpha alpha = prog->alpha;
     GLenum src_blend, dst_blend;
     struct blendinfo *op_info;
 
@@ -459,10 +938,9 @@ glamor_set_blend(CARD8 op, glamor_program_alpha alpha, PicturePtr dst)
         break;
     }
 
-    if (glamor_priv->gl_flavor != GLAMOR_GL_ES2)
-        glDisable(GL_COLOR_LOGIC_OP);
+    glamor_set_gxcopy(dst->pDrawable->pScreen);
 
-    if (op == PictOpSrc)
+    if (op == PictOpSrc && alpha != glamor_program_alpha_fb_fetch)
         return;
 
     op_info = &composite_op_info[op];
@@ -480,6 +958,16 @@ glamor_set_blend(CARD8 op, glamor_program_alpha alpha, PicturePtr dst)
             src_blend = GL_ZERO;
     }
 
+    /* The shader blends with the fetched destination itself. */
+    if (alpha == glamor_program_alpha_fb_fetch) {
+        glDisable(GL_BLEND);
+        glamor_set_fetch_blend_factor(src_blend,
+                                      prog->fetch_blend_source_uniform);
+        glamor_set_fetch_blend_factor(dst_blend,
+                                      prog->fetch_blend_dest_uniform);
+        return;
+    }
+
     /* Set up the source alpha value for blending in component alpha mode. */
     if (alpha == glamor_program_alpha_dual_blend) {
         switch (dst_blend) {
@@ -509,7 +997,7 @@ static Bool
 use_source_solid(CARD8 op, PicturePtr src, PicturePtr dst, glamor_program *prog)
 {
 
-    glamor_set_blend(op, prog->alpha, dst);
+    glamor_set_blend(op, prog, dst);
 
     glamor_set_color_depth(dst->pDrawable->pScreen, 32,
                            src->pSourcePict->solidFill.color,
@@ -527,7 +1015,7 @@ static const glamor_facet glamor_source_solid = {
 static Bool
 use_source_picture(CARD8 op, PicturePtr src, PicturePtr dst, glamor_program *prog)
 {
-    glamor_set_blend(op, prog->alpha, dst);
+    glamor_set_blend(op, prog, dst);
 
     return glamor_set_texture((PixmapPtr) src->pDrawable,
                               glamor_picture_red_is_alpha(dst),
@@ -547,7 +1035,7 @@ static const glamor_facet glamor_source_picture = {
 static Bool
 use_source_1x1_picture(CARD8 op, PicturePtr src, PicturePtr dst, glamor_program *prog)
 {
-    glamor_set_blend(op, prog->alpha, dst);
+    glamor_set_blend(op, prog, dst);
 
     return glamor_set_texture_pixmap((PixmapPtr) src->pDrawable,
                                      glamor_picture_red_is_alpha(dst));
@@ -571,7 +1059,8 @@ static const char *glamor_combine[] = {
     [glamor_program_alpha_ca_first]  = "       gl_FragColor = source.a * mask;\n",
     [glamor_program_alpha_ca_second] = "       gl_FragColor = source * mask;\n",
     [glamor_program_alpha_dual_blend] = "      color0 = source * mask;\n"
-                                        "      color1 = source.a * mask;\n"
+                                        "      color1 = source.a * mask;\n",
+    [glamor_program_alpha_fb_fetch] = NULL,
 };
 
 static Bool
@@ -620,6 +1109,9 @@ glamor_setup_program_render(CARD8                 op,
     if (glamor_is_component_alpha(mask)) {
         if (glamor_priv->has_dual_blend) {
             alpha = glamor_program_alpha_dual_blend;
+        } else if (glamor_priv->fb_fetch_header &&
+                   !glamor_picture_red_is_alpha(dst)) {
+            alpha = glamor_program_alpha_fb_fetch;
         } else {
             /* This only works for PictOpOver */
             if (op != PictOpOver)
@@ -33,10 +33,14 @@ typedef enum {
     glamor_program_location_bitplane = 32,
     glamor_program_location_dash = 64,
     glamor_program_location_atlas = 128,
+    glamor_program_location_atlas_array = 256,
+    glamor_program_location_font_a8 = 512,
 } glamor_program_location;
 
 typedef enum {
     glamor_program_flag_none = 0,
+    /* A 1.30 program that also builds as ESSL 3.00 on GLES 3 */
+    glamor_program_flag_es3 = 1,
 } glamor_program_flag;
 
 typedef enum {
@@ -44,6 +48,7 @@ typedef enum {
     glamor_program_alpha_ca_first,
     glamor_program_alpha_ca_second,
     glamor_program_alpha_dual_blend,
+    glamor_program_alpha_fb_fetch,
     glamor_program_alpha_count
 } glamor_program_alpha;
 
@@ -78,22 +83,32 @@ struct _glamor_program {
     GLint                       fill_size_inv_uniform;
     GLint                       fill_offset_uniform;
     GLint                       font_uniform;
+    GLint                       font_size_inv_uniform;
     GLint                       bitplane_uniform;
     GLint                       bitmul_uniform;
     GLint                       dash_uniform;
     GLint                       dash_length_uniform;
     GLint                       atlas_uniform;
+    GLint                       fetch_alu_uniform;
+    GLint                       fetch_planemask_uniform;
+    GLint                       fetch_blend_source_uniform;
+    GLint                       fetch_blend_dest_uniform;
+    GLint                       fetch_dest_uniform;
+    GLint                       fetch_dest_coords_uniform;
     glamor_program_location     locations;
     glamor_program_flag         flags;
     glamor_use                  prim_use;
     glamor_use                  fill_use;
+    glamor_use                  fetch_use;
     glamor_program_alpha        alpha;
+    Bool                        dest_read;
     glamor_use_render           prim_use_render;
     glamor_use_render           fill_use_render;
 };
 
 typedef struct {
     glamor_program      progs[4];
+    glamor_program      fetch_progs[4];
 } glamor_program_fill;
 
 extern const glamor_facet glamor_fill_solid;
@@ -118,6 +133,46 @@ glamor_use_program_fill(PixmapPtr               pixmap,
                         glamor_program_fill     *program_fill,
                         const glamor_facet      *prim);
 
+/*
+ * Without framebuffer fetch, GC programs applying the alu read a copy
+ * of the destination taken when the program is set up, so every
+ * primitive drawn sees the destination as it was before the request.
+ * Callers collect the bounds of what they are about to draw, in
+ * screen coordinates like the GC clip, which limit the copy; requests
+ * whose primitives may overlap fall back.
+ */
+typedef struct {
+    BoxRec      extents;
+    BoxRec      band;
+    Bool        overlap;
+} glamor_dest_bounds;
+
+static inline void
+glamor_dest_bounds_init(glamor_dest_bounds *bounds)
+{
+    bounds->extents.x1 = bounds->extents.y1 = MAXSHORT;
+    bounds->extents.x2 = bounds->extents.y2 = MINSHORT;
+    bounds->band.x1 = bounds->band.y1 = 0;
+    bounds->band.x2 = bounds->band.y2 = 0;
+    bounds->overlap = FALSE;
+}
+
+void
+glamor_dest_bounds_add(glamor_dest_bounds *bounds,
+                       int x1, int y1, int x2, int y2);
+
+Bool
+glamor_set_dest_copy_bounds(DrawablePtr drawable, GCPtr gc,
+                            const glamor_dest_bounds *bounds);
+
+Bool
+glamor_set_dest_copy_bounds_lines(DrawablePtr drawable, GCPtr gc,
+                                  int mode, int n, DDXPointPtr points);
+
+Bool
+glamor_set_dest_copy_bounds_segments(DrawablePtr drawable, GCPtr gc,
+                                     int nseg, xSegment *segs);
+
 typedef enum {
     glamor_program_source_solid,
     glamor_program_source_picture,
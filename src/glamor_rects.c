@@ -39,6 +39,103 @@ static const glamor_facet glamor_facet_polyfillrect_120 = {
                 GLAMOR_POS(gl_Position, primitive.xy)),
 };
 
+/*
+ * Fills boxes, in pixmap coordinates, with a pixel value using one
+ * scissored clear per box. That skips all program, vertex and blend
+ * setup, and tiled GPUs clear without touching memory. Past a few
+ * dozen boxes a single draw is cheaper.
+ */
+void
+glamor_clear_boxes(PixmapPtr pixmap, BoxPtr box, int nbox, CARD32 pixel)
+{
+    ScreenPtr screen = pixmap->drawable.pScreen;
+    glamor_screen_private *glamor_priv = glamor_get_screen_private(screen);
+    glamor_pixmap_private *pixmap_priv = glamor_get_pixmap_private(pixmap);
+    int depth = pixmap->drawable.depth;
+    float color[4];
+    int box_index;
+    int n;
+
+    glamor_get_rgba_from_pixel(pixel,
+                               &color[0], &color[1], &color[2], &color[3],
+                               format_for_depth(depth));
+
+    if ((depth == 1 || depth == 8) &&
+        glamor_priv->one_channel_format == GL_RED)
+        color[0] = color[3];
+
+    glamor_make_current(glamor_priv);
+    glamor_set_gxcopy(screen);
+
+    glClearColor(color[0], color[1], color[2], color[3]);
+    glEnable(GL_SCISSOR_TEST);
+
+    glamor_pixmap_loop(pixmap_priv, box_index) {
+        BoxPtr fbo_box = glamor_pixmap_box_at(pixmap_priv, box_index);
+        glamor_pixmap_fbo *fbo = glamor_pixmap_fbo_at(pixmap_priv, box_index);
+
+        glBindFramebuffer(GL_FRAMEBUFFER, fbo->fb);
+
+        for (n = 0; n < nbox; n++) {
+            int x1 = max(box[n].x1, fbo_box->x1);
+            int y1 = max(box[n].y1, fbo_box->y1);
+            int x2 = min(box[n].x2, fbo_box->x2);
+            int y2 = min(box[n].y2, fbo_box->y2);
+
+            if (x1 >= x2 || y1 >= y2)
+                continue;
+
+            glScissor(x1 - fbo_box->x1, y1 - fbo_box->y1, x2 - x1, y2 - y1);
+            glClear(GL_COLOR_BUFFER_BIT);
+        }
+    }
+
+    glDisable(GL_SCISSOR_TEST);
+}
+
+/*
+ * Solid GXcopy fills of a few rectangles, like window backgrounds and
+ * borders, are done with clears. The rectangles go through a region
+ * first, which clips them and merges touching and overlapping ones,
+ * so each clear covers as much as the clip allows.
+ */
+static Bool
+glamor_poly_fill_rect_clear(DrawablePtr drawable,
+                            GCPtr gc, int nrect, xRectangle *prect)
+{
+    PixmapPtr pixmap = glamor_get_drawable_pixmap(drawable);
+    RegionPtr region;
+    int off_x, off_y;
+
+    if (gc->fillStyle != FillSolid || gc->alu != GXcopy ||
+        !glamor_pm_is_solid(gc->depth, gc->planemask))
+        return FALSE;
+
+    if (nrect > GLAMOR_CLEAR_MAX_BOXES)
+        return FALSE;
+
+    region = RegionFromRects(nrect, prect, CT_UNSORTED);
+    if (!region)
+        return FALSE;
+
+    RegionTranslate(region, drawable->x, drawable->y);
+    RegionIntersect(region, region, gc->pCompositeClip);
+
+    if (RegionNumRects(region) > GLAMOR_CLEAR_MAX_BOXES) {
+        RegionDestroy(region);
+        return FALSE;
+    }
+
+    glamor_get_drawable_deltas(drawable, pixmap, &off_x, &off_y);
+    RegionTranslate(region, off_x, off_y);
+
+    glamor_clear_boxes(pixmap, RegionRects(region), RegionNumRects(region),
+                       gc->fgPixel);
+
+    RegionDestroy(region);
+    return TRUE;
+}
+
 static Bool
 glamor_poly_fill_rect_gl(DrawablePtr drawable,
                          GCPtr gc, int nrect, xRectangle *prect)
@@ -57,8 +154,26 @@ glamor_poly_fill_rect_gl(DrawablePtr drawable,
     if (!GLAMOR_PIXMAP_PRIV_HAS_FBO(pixmap_priv))
         goto bail;
 
+    if (glamor_poly_fill_rect_clear(drawable, gc, nrect, prect))
+        return TRUE;
+
     glamor_make_current(glamor_priv);
 
+    if (glamor_gc_needs_dest_copy(screen, gc)) {
+        glamor_dest_bounds bounds;
+        int n;
+
+        glamor_dest_bounds_init(&bounds);
+        for (n = 0; n < nrect; n++)
+            glamor_dest_bounds_add(&bounds,
+                                   drawable->x + prect[n].x,
+                                   drawable->y + prect[n].y,
+                                   drawable->x + prect[n].x + prect[n].width,
+                                   drawable->y + prect[n].y + prect[n].height);
+        if (!glamor_set_dest_copy_bounds(drawable, gc, &bounds))
+            goto bail;
+    }
+
     if (glamor_priv->glsl_version >= 130) {
         prog = glamor_use_program_fill(pixmap, gc,
                                        &glamor_priv->poly_fill_rect_program,
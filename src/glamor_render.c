@@ -32,6 +32,8 @@
  * Render acceleration implementation
  */
 
+#include <math.h>
+
 #include "glamor_priv.h"
 
 #include "mipict.h"
@@ -59,9 +61,74 @@ static struct blendinfo composite_op_info[] = {
     [PictOpAdd] = {0, 0, GL_ONE, GL_ONE},
 };
 
+/* Blend factors of the Disjoint and Conjoint operators, evaluated in the
+ * shader as in pixman's combine_disjoint/conjoint_general. The factor
+ * values index the vec4(0, 1, out_part, in_part) of the combine code.
+ */
+enum combine_factor {
+    COMBINE_ZERO,
+    COMBINE_ONE,
+    COMBINE_OUT,
+    COMBINE_IN,
+};
+
+static const struct {
+    CARD8 fa;
+    CARD8 fb;
+} combine_op_factors[] = {
+    [PictOpClear] = {COMBINE_ZERO, COMBINE_ZERO},
+    [PictOpSrc] = {COMBINE_ONE, COMBINE_ZERO},
+    [PictOpDst] = {COMBINE_ZERO, COMBINE_ONE},
+    [PictOpOver] = {COMBINE_ONE, COMBINE_OUT},
+    [PictOpOverReverse] = {COMBINE_OUT, COMBINE_ONE},
+    [PictOpIn] = {COMBINE_IN, COMBINE_ZERO},
+    [PictOpInReverse] = {COMBINE_ZERO, COMBINE_IN},
+    [PictOpOut] = {COMBINE_OUT, COMBINE_ZERO},
+    [PictOpOutReverse] = {COMBINE_ZERO, COMBINE_OUT},
+    [PictOpAtop] = {COMBINE_IN, COMBINE_OUT},
+    [PictOpAtopReverse] = {COMBINE_OUT, COMBINE_IN},
+    [PictOpXor] = {COMBINE_OUT, COMBINE_OUT},
+};
+
+static enum shader_combine
+glamor_composite_op_combine(CARD8 op)
+{
+    /* Saturate is DisjointOverReverse: Fa = min(1, (1 - da) / sa). */
+    if (op == PictOpSaturate ||
+        (op >= PictOpDisjointMinimum && op <= PictOpDisjointMaximum))
+        return SHADER_COMBINE_DISJOINT;
+    if (op >= PictOpConjointMinimum && op <= PictOpConjointMaximum)
+        return SHADER_COMBINE_CONJOINT;
+    if (op >= PictOpBlendMinimum && op < PictOpHSLHue)
+        return SHADER_COMBINE_SEPARABLE;
+    if (op >= PictOpHSLHue && op <= PictOpBlendMaximum)
+        return SHADER_COMBINE_NONSEPARABLE;
+    return SHADER_COMBINE_BLEND;
+}
+
+static inline Bool
+glamor_shader_source_is_gradient(enum shader_source source)
+{
+    return (source == SHADER_SOURCE_LINEAR_GRADIENT ||
+            source == SHADER_SOURCE_RADIAL_GRADIENT ||
+            source == SHADER_SOURCE_CONICAL_GRADIENT);
+}
+
+/* Whether the composite shader can evaluate a gradient source itself. */
+static Bool
+glamor_composite_gradient_supported(PicturePtr picture)
+{
+#ifdef GLAMOR_GRADIENT_SHADER
+    return glamor_gradient_composite_supported(picture);
+#else
+    return FALSE;
+#endif
+}
+
 #define RepeatFix			10
 static GLuint
-glamor_create_composite_fs(struct shader_key *key)
+glamor_create_composite_fs(glamor_screen_private *glamor_priv,
+                           struct shader_key *key)
 {
     const char *repeat_define =
         "#define RepeatNone               	      0\n"
@@ -150,6 +217,165 @@ glamor_create_composite_fs(struct shader_key *key)
         "		return rel_sampler(source_sampler, source_texture,\n"
         "				   source_wh, source_repeat_mode, 1);\n"
         "}\n";
+    /* Convolution sources sample the texture once per kernel tap,
+     * following pixman: the taps start at the pixel containing
+     * (x - (width - 1) / 2, y - (height - 1) / 2) and the sum is
+     * clamped.
+     */
+    const char *source_alpha_convolution_tap =
+        "varying vec2 source_texture;\n"
+        "uniform sampler2D source_sampler;\n"
+        "uniform vec4 source_wh;\n"
+        "uniform vec2 source_texel;\n"
+        "uniform vec4 source_kernel_size;\n"
+        "vec4 source_tap(vec2 tex)\n"
+        "{\n"
+        "	if (source_repeat_mode < RepeatFix)\n"
+        "		return texture2D(source_sampler, tex);\n"
+        "	else \n"
+        "		return rel_sampler(source_sampler, tex,\n"
+        "				   source_wh, source_repeat_mode, 0);\n"
+        "}\n";
+    const char *source_convolution_tap =
+        "varying vec2 source_texture;\n"
+        "uniform sampler2D source_sampler;\n"
+        "uniform vec4 source_wh;\n"
+        "uniform vec2 source_texel;\n"
+        "uniform vec4 source_kernel_size;\n"
+        "vec4 source_tap(vec2 tex)\n"
+        "{\n"
+        "	if (source_repeat_mode < RepeatFix)\n"
+        "		return vec4(texture2D(source_sampler, tex).rgb, 1);\n"
+        "	else \n"
+        "		return rel_sampler(source_sampler, tex,\n"
+        "				   source_wh, source_repeat_mode, 1);\n"
+        "}\n";
+    const char *source_convolution_fetch =
+        "uniform float source_kernel[CONVOLUTION_MAX_TAPS];\n"
+        "vec4 get_source()\n"
+        "{\n"
+        "	vec2 first = floor(source_texture / source_texel -\n"
+        "			   source_kernel_size.zw - 1.0 / 65536.0) + 0.5;\n"
+        "	int width = int(source_kernel_size.x);\n"
+        "	int taps = width * int(source_kernel_size.y);\n"
+        "	vec4 color = vec4(0.0);\n"
+        "	for (int t = 0; t < CONVOLUTION_MAX_TAPS; t++) {\n"
+        "		if (t >= taps)\n"
+        "			break;\n"
+        "		int j = t / width;\n"
+        "		vec2 tap = first + vec2(float(t - j * width), float(j));\n"
+        "		color += source_kernel[t] * source_tap(tap * source_texel);\n"
+        "	}\n"
+        "	return clamp(color, 0.0, 1.0);\n"
+        "}\n";
+    const char *source_separable_fetch =
+        "uniform float source_kernel_x[CONVOLUTION_MAX_AXIS];\n"
+        "uniform float source_kernel_y[CONVOLUTION_MAX_AXIS];\n"
+        "vec4 get_source()\n"
+        "{\n"
+        "	vec2 first = floor(source_texture / source_texel -\n"
+        "			   source_kernel_size.zw - 1.0 / 65536.0) + 0.5;\n"
+        "	int width = int(source_kernel_size.x);\n"
+        "	int height = int(source_kernel_size.y);\n"
+        "	vec4 color = vec4(0.0);\n"
+        "	for (int j = 0; j < CONVOLUTION_MAX_AXIS; j++) {\n"
+        "		if (j >= height)\n"
+        "			break;\n"
+        "		vec4 row = vec4(0.0);\n"
+        "		for (int i = 0; i < CONVOLUTION_MAX_AXIS; i++) {\n"
+        "			if (i >= width)\n"
+        "				break;\n"
+        "			vec2 tap = first + vec2(float(i), float(j));\n"
+        "			row += source_kernel_x[i] * source_tap(tap * source_texel);\n"
+        "		}\n"
+        "		color += source_kernel_y[j] * row;\n"
+        "	}\n"
+        "	return clamp(color, 0.0, 1.0);\n"
+        "}\n";
+    /* Gradient sources are evaluated per fragment from the picture
+     * coordinates, following pixman's linear, radial and conical
+     * gradients.
+     */
+    const char *source_gradient_common =
+        "#if defined(GL_ES) && defined(GL_FRAGMENT_PRECISION_HIGH)\n"
+        "precision highp float;\n"
+        "#endif\n"
+        "varying vec2 source_texture;\n"
+        "uniform mat3 source_transform;\n"
+        "uniform vec4 source_gradient;\n"
+        "uniform vec4 source_gradient_delta;\n"
+        "uniform sampler2D source_sampler;\n"
+        "uniform float source_ramp_row;\n"
+        "vec2 source_gradient_pos()\n"
+        "{\n"
+        "	vec3 pos = source_transform * vec3(source_texture, 1.0);\n"
+        "	return pos.xy / pos.z;\n"
+        "}\n"
+        "vec4 source_gradient_color(float t)\n"
+        "{\n"
+        "	if (source_repeat_mode == RepeatNormal)\n"
+        "		t = fract(t);\n"
+        "	else if (source_repeat_mode == RepeatReflect)\n"
+        "		t = abs(fract(t * 0.5 + 0.5) * 2.0 - 1.0);\n"
+        "	else if (source_repeat_mode == RepeatNone &&\n"
+        "		 (t < 0.0 || t > 1.0))\n"
+        "		return vec4(0.0);\n"
+        "	t = clamp(t, 0.0, 1.0);\n"
+        "	return texture2D(source_sampler,\n"
+        "			 vec2((t * (GRADIENT_RAMP_WIDTH - 1.0) + 0.5) /\n"
+        "			      GRADIENT_RAMP_WIDTH, source_ramp_row));\n"
+        "}\n";
+    const char *source_linear_fetch =
+        "vec4 get_source()\n"
+        "{\n"
+        "	vec2 pos = source_gradient_pos();\n"
+        "	return source_gradient_color(dot(vec3(pos, 1.0),\n"
+        "					 source_gradient.xyz));\n"
+        "}\n";
+    const char *source_radial_fetch =
+        "vec4 get_source()\n"
+        "{\n"
+        "	vec2 pd = source_gradient_pos() - source_gradient.xy;\n"
+        "	vec3 cd = source_gradient_delta.xyz;\n"
+        "	float r1 = source_gradient.z;\n"
+        "	float a = source_gradient.w;\n"
+        "	float b = dot(pd, cd.xy) + r1 * cd.z;\n"
+        "	float c = dot(pd, pd) - r1 * r1;\n"
+        "	float t1, t2;\n"
+        "	if (abs(a) < 0.00001) {\n"
+        "		if (b == 0.0)\n"
+        "			return vec4(0.0);\n"
+        "		t1 = 0.5 * c / b;\n"
+        "		t2 = t1;\n"
+        "	} else {\n"
+        "		float discr = b * b - a * c;\n"
+        "		if (discr < 0.0)\n"
+        "			return vec4(0.0);\n"
+        "		discr = sqrt(discr);\n"
+        "		t1 = (b + discr) / a;\n"
+        "		t2 = (b - discr) / a;\n"
+        "	}\n"
+        /* Prefer the bigger root that is still valid. */
+        "	if (source_repeat_mode == RepeatNone) {\n"
+        "		if (t1 < 0.0 || t1 > 1.0)\n"
+        "			t1 = t2;\n"
+        "		if (t1 < 0.0 || t1 > 1.0)\n"
+        "			return vec4(0.0);\n"
+        "	} else {\n"
+        "		if (t1 * cd.z < -r1)\n"
+        "			t1 = t2;\n"
+        "		if (t1 * cd.z < -r1)\n"
+        "			return vec4(0.0);\n"
+        "	}\n"
+        "	return source_gradient_color(t1);\n"
+        "}\n";
+    const char *source_conical_fetch =
+        "vec4 get_source()\n"
+        "{\n"
+        "	vec2 pos = source_gradient_pos() - source_gradient.xy;\n"
+        "	float t = atan(pos.y, pos.x) + source_gradient.z;\n"
+        "	return source_gradient_color(1.0 - fract(t / 6.28318530718));\n"
+        "}\n";
     const char *mask_none =
         "vec4 get_mask()\n"
         "{\n"
@@ -223,14 +449,208 @@ glamor_create_composite_fs(struct shader_key *key)
         "}\n";
     const char *header_ca_dual_blend =
         "#version 130\n";
+    /* Operators that can't be expressed with blending read the
+     * destination with framebuffer fetch, or else from a texture
+     * covering the fbo, or a copy of part of it, addressed by window
+     * position.
+     */
+    const char *dest_texture_texel =
+        "uniform sampler2D dest_sampler;\n"
+        "uniform vec4 dest_coords;\n"
+        "vec4 dest_texel()\n"
+        "{\n"
+        "	return texture2D(dest_sampler, (gl_FragCoord.xy -\n"
+        "					dest_coords.xy) * dest_coords.zw);\n"
+        "}\n";
+    const char *dest_fb_fetch_texel =
+        "vec4 dest_texel()\n"
+        "{\n"
+        "	return LAST_FRAG_COLOR;\n"
+        "}\n";
+    const char *dest_fetch =
+        "uniform float dest_opaque;\n"
+        "vec4 get_dest()\n"
+        "{\n"
+        "	vec4 color = dest_texel();\n"
+        "	color.a = max(color.a, dest_opaque);\n"
+        "	return color;\n"
+        "}\n";
+    const char *dest_red_fetch =
+        "uniform float dest_opaque;\n"
+        "vec4 get_dest()\n"
+        "{\n"
+        "	return vec4(0.0, 0.0, 0.0, max(dest_texel().r, dest_opaque));\n"
+        "}\n";
+    const char *combine_disjoint =
+        "float out_part(float a, float b)\n"
+        "{\n"
+        "	return 1.0 - b >= a ? 1.0 : (1.0 - b) / a;\n"
+        "}\n"
+        "float in_part(float a, float b)\n"
+        "{\n"
+        "	return 1.0 - b >= a ? 0.0 : 1.0 - (1.0 - b) / a;\n"
+        "}\n";
+    const char *combine_conjoint =
+        "float out_part(float a, float b)\n"
+        "{\n"
+        "	return b >= a ? 0.0 : 1.0 - b / a;\n"
+        "}\n"
+        "float in_part(float a, float b)\n"
+        "{\n"
+        "	return b >= a ? 1.0 : b / a;\n"
+        "}\n";
+    const char *combine_factors =
+        "uniform vec4 combine_fa;\n"
+        "uniform vec4 combine_fb;\n"
+        "vec4 combine(vec4 src, vec4 dst)\n"
+        "{\n"
+        "	float fa = dot(combine_fa, vec4(0.0, 1.0,\n"
+        "					out_part(src.a, dst.a),\n"
+        "					in_part(src.a, dst.a)));\n"
+        "	float fb = dot(combine_fb, vec4(0.0, 1.0,\n"
+        "					out_part(dst.a, src.a),\n"
+        "					in_part(dst.a, src.a)));\n"
+        "	return min(src * fa + dst * fb, 1.0);\n"
+        "}\n";
+    /* PDF blend modes, following pixman's float combiners: the result
+     * is (1 - as) * d + (1 - ad) * s + B(s, d) with B taken on
+     * premultiplied colors, picked by combine_mode.
+     */
+    const char *combine_separable =
+        "uniform int combine_mode;\n"
+        "float blend_channel(float sa, float s, float da, float d)\n"
+        "{\n"
+        "	if (combine_mode == 0)\n"           /* Multiply */
+        "		return s * d;\n"
+        "	else if (combine_mode == 1)\n"      /* Screen */
+        "		return s * da + d * sa - s * d;\n"
+        "	else if (combine_mode == 2) {\n"    /* Overlay */
+        "		if (2.0 * d < da)\n"
+        "			return 2.0 * s * d;\n"
+        "		return sa * da - 2.0 * (da - d) * (sa - s);\n"
+        "	} else if (combine_mode == 3)\n"    /* Darken */
+        "		return min(s * da, d * sa);\n"
+        "	else if (combine_mode == 4)\n"      /* Lighten */
+        "		return max(s * da, d * sa);\n"
+        "	else if (combine_mode == 5) {\n"    /* ColorDodge */
+        "		if (d == 0.0)\n"
+        "			return 0.0;\n"
+        "		if (d * sa >= sa * da - s * da || sa - s == 0.0)\n"
+        "			return sa * da;\n"
+        "		return sa * sa * d / (sa - s);\n"
+        "	} else if (combine_mode == 6) {\n"  /* ColorBurn */
+        "		if (d >= da)\n"
+        "			return sa * da;\n"
+        "		if (sa * (da - d) >= s * da || s == 0.0)\n"
+        "			return 0.0;\n"
+        "		return sa * (da - sa * (da - d) / s);\n"
+        "	} else if (combine_mode == 7) {\n"  /* HardLight */
+        "		if (2.0 * s < sa)\n"
+        "			return 2.0 * s * d;\n"
+        "		return sa * da - 2.0 * (da - d) * (sa - s);\n"
+        "	} else if (combine_mode == 8) {\n"  /* SoftLight */
+        "		if (da == 0.0)\n"
+        "			return d * sa;\n"
+        "		if (2.0 * s <= sa)\n"
+        "			return d * sa - d * (da - d) * (sa - 2.0 * s) / da;\n"
+        "		if (4.0 * d <= da)\n"
+        "			return d * sa + (2.0 * s - sa) * d *\n"
+        "				((16.0 * d / da - 12.0) * d / da + 3.0);\n"
+        "		return d * sa + (sqrt(d * da) - d) * (2.0 * s - sa);\n"
+        "	} else if (combine_mode == 9)\n"    /* Difference */
+        "		return abs(s * da - d * sa);\n"
+        "	else\n"                             /* Exclusion */
+        "		return s * da + d * sa - 2.0 * s * d;\n"
+        "}\n"
+        "vec3 blend(vec4 src, vec4 dst)\n"
+        "{\n"
+        "	return vec3(blend_channel(src.a, src.r, dst.a, dst.r),\n"
+        "		    blend_channel(src.a, src.g, dst.a, dst.g),\n"
+        "		    blend_channel(src.a, src.b, dst.a, dst.b));\n"
+        "}\n";
+    const char *combine_nonseparable =
+        "uniform int combine_mode;\n"
+        "float lum(vec3 c)\n"
+        "{\n"
+        "	return dot(c, vec3(0.3, 0.59, 0.11));\n"
+        "}\n"
+        "float sat(vec3 c)\n"
+        "{\n"
+        "	return max(max(c.r, c.g), c.b) - min(min(c.r, c.g), c.b);\n"
+        "}\n"
+        "vec3 clip_color(vec3 c, float a)\n"
+        "{\n"
+        "	float l = lum(c);\n"
+        "	float n = min(min(c.r, c.g), c.b);\n"
+        "	float x = max(max(c.r, c.g), c.b);\n"
+        "	if (n < 0.0) {\n"
+        "		if (l - n == 0.0)\n"
+        "			c = vec3(0.0);\n"
+        "		else\n"
+        "			c = l + (c - l) * l / (l - n);\n"
+        "	}\n"
+        "	if (x > a) {\n"
+        "		if (x - l == 0.0)\n"
+        "			c = vec3(a);\n"
+        "		else\n"
+        "			c = l + (c - l) * (a - l) / (x - l);\n"
+        "	}\n"
+        "	return c;\n"
+        "}\n"
+        "vec3 set_lum(vec3 c, float a, float l)\n"
+        "{\n"
+        "	return clip_color(c + (l - lum(c)), a);\n"
+        "}\n"
+        "vec3 set_sat(vec3 c, float s)\n"
+        "{\n"
+        "	float n = min(min(c.r, c.g), c.b);\n"
+        "	float x = max(max(c.r, c.g), c.b);\n"
+        "	if (x > n)\n"
+        "		return (c - n) * s / (x - n);\n"
+        "	return vec3(0.0);\n"
+        "}\n"
+        "vec3 blend(vec4 src, vec4 dst)\n"
+        "{\n"
+        "	float sa = src.a;\n"
+        "	float da = dst.a;\n"
+        "	if (combine_mode == 0)\n"           /* HSLHue */
+        "		return set_lum(set_sat(src.rgb * da, sat(dst.rgb) * sa),\n"
+        "			       sa * da, lum(dst.rgb) * sa);\n"
+        "	else if (combine_mode == 1)\n"      /* HSLSaturation */
+        "		return set_lum(set_sat(dst.rgb * sa, sat(src.rgb) * da),\n"
+        "			       sa * da, lum(dst.rgb) * sa);\n"
+        "	else if (combine_mode == 2)\n"      /* HSLColor */
+        "		return set_lum(src.rgb * da, sa * da, lum(dst.rgb) * sa);\n"
+        "	else\n"                             /* HSLLuminosity */
+        "		return set_lum(dst.rgb * sa, sa * da, lum(src.rgb) * da);\n"
+        "}\n";
+    const char *combine_pdf =
+        "vec4 combine(vec4 src, vec4 dst)\n"
+        "{\n"
+        "	return vec4((1.0 - src.a) * dst.rgb + (1.0 - dst.a) * src.rgb +\n"
+        "		    blend(src, dst),\n"
+        "		    src.a + dst.a - src.a * dst.a);\n"
+        "}\n";
+    const char *in_combine =
+        "void main()\n"
+        "{\n"
+        "	gl_FragColor = dest_swizzle(combine(get_source() * get_mask().a,\n"
+        "					    get_dest()));\n"
+        "}\n";
 
     char *source;
+    char *source_define = NULL;
+    const char *source_common = "";
     const char *source_fetch;
     const char *mask_fetch = "";
     const char *in;
     const char *header;
     const char *header_norm = "";
     const char *dest_swizzle;
+    const char *dest_texel = "";
+    const char *dest_read = "";
+    const char *combine = "";
+    const char *combine_common = "";
     GLuint prog;
 
     switch (key->source) {
@@ -243,10 +663,45 @@ glamor_create_composite_fs(struct shader_key *key)
     case SHADER_SOURCE_TEXTURE:
         source_fetch = source_pixmap_fetch;
         break;
+    case SHADER_SOURCE_LINEAR_GRADIENT:
+        source_fetch = source_linear_fetch;
+        break;
+    case SHADER_SOURCE_RADIAL_GRADIENT:
+        source_fetch = source_radial_fetch;
+        break;
+    case SHADER_SOURCE_CONICAL_GRADIENT:
+        source_fetch = source_conical_fetch;
+        break;
     default:
         FatalError("Bad composite shader source");
     }
 
+    if (glamor_shader_source_is_gradient(key->source)) {
+        source_common = source_gradient_common;
+        XNFasprintf(&source_define, "#define GRADIENT_RAMP_WIDTH %d.0\n",
+                    GLAMOR_GRADIENT_RAMP_WIDTH);
+    }
+
+    if (key->filter != SHADER_FILTER_NONE) {
+        if (key->source == SHADER_SOURCE_TEXTURE_ALPHA)
+            source_common = source_alpha_convolution_tap;
+        else if (key->source == SHADER_SOURCE_TEXTURE)
+            source_common = source_convolution_tap;
+        else
+            FatalError("Bad composite shader convolution source");
+
+        if (key->filter == SHADER_FILTER_SEPARABLE)
+            source_fetch = source_separable_fetch;
+        else
+            source_fetch = source_convolution_fetch;
+
+        XNFasprintf(&source_define,
+                    "#define CONVOLUTION_MAX_TAPS %d\n"
+                    "#define CONVOLUTION_MAX_AXIS %d\n",
+                    glamor_priv->convolution_max_taps,
+                    glamor_priv->convolution_max_taps / 2);
+    }
+
     switch (key->mask) {
     case SHADER_MASK_NONE:
         mask_fetch = mask_none;
@@ -298,14 +753,58 @@ glamor_create_composite_fs(struct shader_key *key)
         FatalError("Bad composite IN type");
     }
 
+    if (key->combine != SHADER_COMBINE_BLEND) {
+        if (key->in != glamor_program_alpha_normal)
+            FatalError("Bad composite combine IN type");
+
+        if (glamor_priv->fb_fetch_header) {
+            header = glamor_priv->fb_fetch_header;
+            dest_texel = dest_fb_fetch_texel;
+        }
+        else
+            dest_texel = dest_texture_texel;
+
+        if (key->dest_swizzle == SHADER_DEST_SWIZZLE_ALPHA_TO_RED)
+            dest_read = dest_red_fetch;
+        else
+            dest_read = dest_fetch;
+
+        switch (key->combine) {
+        case SHADER_COMBINE_DISJOINT:
+            combine_common = combine_disjoint;
+            combine = combine_factors;
+            break;
+        case SHADER_COMBINE_CONJOINT:
+            combine_common = combine_conjoint;
+            combine = combine_factors;
+            break;
+        case SHADER_COMBINE_SEPARABLE:
+            combine_common = combine_separable;
+            combine = combine_pdf;
+            break;
+        case SHADER_COMBINE_NONSEPARABLE:
+            combine_common = combine_nonseparable;
+            combine = combine_pdf;
+            break;
+        default:
+            FatalError("Bad composite shader combine");
+        }
+        in = in_combine;
+    }
+
     XNFasprintf(&source,
                 "%s"
                 GLAMOR_DEFAULT_PRECISION
-                "%s%s%s%s%s%s%s", header, repeat_define, relocate_texture,
-                rel_sampler, source_fetch, mask_fetch, dest_swizzle, in);
+                "%s%s%s%s%s%s%s%s%s%s%s%s%s%s", header,
+                source_define ? source_define : "",
+                repeat_define, relocate_texture,
+                rel_sampler, source_common, source_fetch, mask_fetch,
+                dest_texel, dest_read, combine_common, combine,
+                dest_swizzle, in);
 
     prog = glamor_compile_glsl_prog(GL_FRAGMENT_SHADER, source);
     free(source);
+    free(source_define);
 
     return prog;
 }
@@ -359,7 +858,7 @@ glamor_create_composite_shader(ScreenPtr screen, struct shader_key *key,
     vs = glamor_create_composite_vs(key);
     if (vs == 0)
         return;
-    fs = glamor_create_composite_fs(key);
+    fs = glamor_create_composite_fs(glamor_priv, key);
     if (fs == 0)
         return;
 
@@ -384,6 +883,18 @@ glamor_create_composite_shader(ScreenPtr screen, struct shader_key *key,
     if (key->source == SHADER_SOURCE_SOLID) {
         shader->source_uniform_location = glGetUniformLocation(prog, "source");
     }
+    else if (glamor_shader_source_is_gradient(key->source)) {
+        shader->source_repeat_mode =
+            glGetUniformLocation(prog, "source_repeat_mode");
+        shader->source_transform =
+            glGetUniformLocation(prog, "source_transform");
+        shader->source_gradient = glGetUniformLocation(prog, "source_gradient");
+        shader->source_gradient_delta =
+            glGetUniformLocation(prog, "source_gradient_delta");
+        shader->source_ramp_row =
+            glGetUniformLocation(prog, "source_ramp_row");
+        glUniform1i(glGetUniformLocation(prog, "source_sampler"), 0);
+    }
     else {
         source_sampler_uniform_location =
             glGetUniformLocation(prog, "source_sampler");
@@ -391,6 +902,21 @@ glamor_create_composite_shader(ScreenPtr screen, struct shader_key *key,
         shader->source_wh = glGetUniformLocation(prog, "source_wh");
         shader->source_repeat_mode =
             glGetUniformLocation(prog, "source_repeat_mode");
+
+        if (key->filter != SHADER_FILTER_NONE) {
+            shader->source_texel = glGetUniformLocation(prog, "source_texel");
+            shader->source_kernel_size =
+                glGetUniformLocation(prog, "source_kernel_size");
+            if (key->filter == SHADER_FILTER_SEPARABLE) {
+                shader->source_kernel_x =
+                    glGetUniformLocation(prog, "source_kernel_x");
+                shader->source_kernel_y =
+                    glGetUniformLocation(prog, "source_kernel_y");
+            } else {
+                shader->source_kernel =
+                    glGetUniformLocation(prog, "source_kernel");
+            }
+        }
     }
 
     if (key->mask != SHADER_MASK_NONE) {
@@ -406,6 +932,15 @@ glamor_create_composite_shader(ScreenPtr screen, struct shader_key *key,
                 glGetUniformLocation(prog, "mask_repeat_mode");
         }
     }
+
+    if (key->combine != SHADER_COMBINE_BLEND) {
+        glUniform1i(glGetUniformLocation(prog, "dest_sampler"), 2);
+        shader->dest_coords = glGetUniformLocation(prog, "dest_coords");
+        shader->dest_opaque = glGetUniformLocation(prog, "dest_opaque");
+        shader->combine_fa = glGetUniformLocation(prog, "combine_fa");
+        shader->combine_fb = glGetUniformLocation(prog, "combine_fb");
+        shader->combine_mode = glGetUniformLocation(prog, "combine_mode");
+    }
 }
 
 static glamor_composite_shader *
@@ -416,7 +951,7 @@ glamor_lookup_composite_shader(ScreenPtr screen, struct
     glamor_screen_private *glamor_priv = glamor_get_screen_private(screen);
     glamor_composite_shader *shader;
 
-    shader = &glamor_priv->composite_shader[key->source][key->mask][key->in][key->dest_swizzle];
+    shader = &glamor_priv->composite_shader[key->source][key->mask][key->in][key->dest_swizzle][key->filter][key->combine];
     if (shader->prog == 0)
         glamor_create_composite_shader(screen, key, shader);
 
@@ -450,6 +985,15 @@ glamor_set_composite_op(ScreenPtr screen,
     GLenum source_blend, dest_blend;
     struct blendinfo *op_info;
 
+    /* The shader writes the combined result itself. */
+    if (key->combine != SHADER_COMBINE_BLEND) {
+        op_info_result->source_blend = GL_ONE;
+        op_info_result->dest_blend = GL_ZERO;
+        op_info_result->source_alpha = FALSE;
+        op_info_result->dest_alpha = FALSE;
+        return TRUE;
+    }
+
     if (op >= ARRAY_SIZE(composite_op_info)) {
         glamor_fallback("unsupported render op %d \n", op);
         return GL_FALSE;
@@ -579,7 +1123,7 @@ glamor_set_composite_texture(glamor_screen_private *glamor_priv, int unit,
      **/
     if (glamor_pixmap_priv_is_large(pixmap_priv) ||
         (glamor_priv->gl_flavor == GLAMOR_GL_ES2 && repeat_type == RepeatNone &&
-         picture->transform)) {
+         (picture->transform || picture->filter == PictFilterConvolution))) {
         glamor_pixmap_fbo_fix_wh_ratio(wh, pixmap, pixmap_priv);
         glUniform4fv(wh_location, 1, wh);
 
@@ -595,6 +1139,232 @@ glamor_set_composite_solid(float *color, GLint uniform_location)
     glUniform4fv(uniform_location, 1, color);
 }
 
+static void
+glamor_set_composite_combine(glamor_composite_shader *shader,
+                             enum shader_combine combine, CARD8 op)
+{
+    GLfloat fa[4] = { 0.0, 0.0, 0.0, 0.0 };
+    GLfloat fb[4] = { 0.0, 0.0, 0.0, 0.0 };
+
+    if (combine == SHADER_COMBINE_SEPARABLE) {
+        glUniform1i(shader->combine_mode, op - PictOpMultiply);
+        return;
+    }
+    if (combine == SHADER_COMBINE_NONSEPARABLE) {
+        glUniform1i(shader->combine_mode, op - PictOpHSLHue);
+        return;
+    }
+
+    if (op == PictOpSaturate)
+        op = PictOpDisjointOverReverse;
+    if (op >= PictOpConjointMinimum)
+        op -= PictOpConjointMinimum;
+    else
+        op -= PictOpDisjointMinimum;
+
+    fa[combine_op_factors[op].fa] = 1.0;
+    fb[combine_op_factors[op].fb] = 1.0;
+    glUniform4fv(shader->combine_fa, 1, fa);
+    glUniform4fv(shader->combine_fb, 1, fb);
+}
+
+/**
+ * Makes the destination under the rectangles readable by the composite
+ * shader.
+ *
+ * Shaders using framebuffer fetch need nothing more. With
+ * NV_texture_barrier the shader samples the destination texture on
+ * unit 2 itself, which is safe as each pixel is read and written by a
+ * single fragment. Otherwise the covered area of the fbo is first copied
+ * to a scratch texture.
+ */
+static Bool
+glamor_set_composite_dest_read(glamor_screen_private *glamor_priv,
+                               glamor_composite_shader *shader,
+                               PicturePtr dest,
+                               glamor_pixmap_private *dest_priv,
+                               glamor_composite_rect_t *rects, int nrect,
+                               int dest_x_off, int dest_y_off)
+{
+    glamor_pixmap_fbo *fbo = dest_priv->fbo;
+    glamor_pixmap_fbo *copy;
+    BoxRec box;
+    int x1 = MAXSHORT, y1 = MAXSHORT, x2 = MINSHORT, y2 = MINSHORT;
+    int fbo_x_off, fbo_y_off;
+    GLfloat coords[4];
+    int i;
+
+    glUniform1f(shader->dest_opaque, PICT_FORMAT_A(dest->format) ? 0.0 : 1.0);
+
+    if (glamor_priv->fb_fetch_header)
+        return TRUE;
+
+    if (glamor_priv->has_nv_texture_barrier) {
+        glamor_bind_texture(glamor_priv, GL_TEXTURE2, fbo,
+                            glamor_fbo_red_is_alpha(glamor_priv, fbo));
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        coords[0] = 0;
+        coords[1] = 0;
+        coords[2] = 1.0 / fbo->width;
+        coords[3] = 1.0 / fbo->height;
+        glUniform4fv(shader->dest_coords, 1, coords);
+        glTextureBarrierNV();
+        return TRUE;
+    }
+
+    for (i = 0; i < nrect; i++) {
+        x1 = MIN(x1, rects[i].x_dst);
+        y1 = MIN(y1, rects[i].y_dst);
+        x2 = MAX(x2, rects[i].x_dst + rects[i].width);
+        y2 = MAX(y2, rects[i].y_dst + rects[i].height);
+    }
+
+    pixmap_priv_get_fbo_off(dest_priv, &fbo_x_off, &fbo_y_off);
+    x1 = MAX(x1 + dest_x_off + fbo_x_off, 0);
+    y1 = MAX(y1 + dest_y_off + fbo_y_off, 0);
+    x2 = MIN(x2 + dest_x_off + fbo_x_off, fbo->width);
+    y2 = MIN(y2 + dest_y_off + fbo_y_off, fbo->height);
+    if (x1 >= x2 || y1 >= y2)
+        return TRUE;
+
+    box.x1 = x1;
+    box.y1 = y1;
+    box.x2 = x2;
+    box.y2 = y2;
+    copy = glamor_copy_dest_box(glamor_priv, fbo, &box, GL_TEXTURE2);
+    if (!copy)
+        return FALSE;
+
+    coords[0] = x1;
+    coords[1] = y1;
+    coords[2] = 1.0 / copy->width;
+    coords[3] = 1.0 / copy->height;
+    glUniform4fv(shader->dest_coords, 1, coords);
+
+    return TRUE;
+}
+
+void
+glamor_fini_composite(ScreenPtr screen)
+{
+    glamor_screen_private *glamor_priv = glamor_get_screen_private(screen);
+
+    if (glamor_priv->dest_copy_fbo) {
+        glamor_destroy_fbo(glamor_priv, glamor_priv->dest_copy_fbo);
+        glamor_priv->dest_copy_fbo = NULL;
+    }
+}
+
+/**
+ * Splits a convolution kernel into a row and a column vector when it is
+ * their outer product, which is the case for the usual box, tent and
+ * gaussian scaling filters.
+ */
+static Bool
+glamor_convolution_separate(const xFixed *kernel, int width, int height,
+                            GLfloat *kernel_x, GLfloat *kernel_y)
+{
+    double total = 0.0;
+    int i, j;
+
+    for (i = 0; i < width; i++)
+        kernel_x[i] = 0.0;
+    for (j = 0; j < height; j++)
+        kernel_y[j] = 0.0;
+
+    for (j = 0; j < height; j++) {
+        for (i = 0; i < width; i++) {
+            double k = pixman_fixed_to_double(kernel[j * width + i]);
+
+            kernel_x[i] += k;
+            kernel_y[j] += k;
+            total += k;
+        }
+    }
+
+    if (fabs(total) < 1.0 / 65536.0)
+        return FALSE;
+
+    for (j = 0; j < height; j++)
+        kernel_y[j] /= total;
+
+    for (j = 0; j < height; j++) {
+        for (i = 0; i < width; i++) {
+            double k = pixman_fixed_to_double(kernel[j * width + i]);
+
+            if (fabs(kernel_x[i] * kernel_y[j] - k) > 2.0 / 65536.0)
+                return FALSE;
+        }
+    }
+    return TRUE;
+}
+
+/**
+ * Picks the shader variant for a convolution filtered picture, or
+ * SHADER_FILTER_NONE if the kernel doesn't fit in the shader.
+ */
+static enum shader_filter
+glamor_convolution_shader_filter(glamor_screen_private *glamor_priv,
+                                 PicturePtr picture)
+{
+    GLfloat kernel_x[GLAMOR_CONVOLUTION_MAX_TAPS];
+    GLfloat kernel_y[GLAMOR_CONVOLUTION_MAX_TAPS];
+    int max_taps = glamor_priv->convolution_max_taps;
+    int width, height;
+
+    if (picture->filter_nparams < 2)
+        return SHADER_FILTER_NONE;
+
+    width = pixman_fixed_to_int(picture->filter_params[0]);
+    height = pixman_fixed_to_int(picture->filter_params[1]);
+    if (width <= 0 || height <= 0 ||
+        picture->filter_nparams != 2 + width * height)
+        return SHADER_FILTER_NONE;
+
+    if (width <= max_taps / 2 && height <= max_taps / 2 &&
+        glamor_convolution_separate(picture->filter_params + 2,
+                                    width, height, kernel_x, kernel_y))
+        return SHADER_FILTER_SEPARABLE;
+
+    if (width * height <= max_taps)
+        return SHADER_FILTER_CONVOLUTION;
+
+    return SHADER_FILTER_NONE;
+}
+
+static void
+glamor_set_composite_convolution(glamor_composite_shader *shader,
+                                 enum shader_filter filter,
+                                 PicturePtr picture,
+                                 PixmapPtr pixmap)
+{
+    glamor_pixmap_private *pixmap_priv = glamor_get_pixmap_private(pixmap);
+    xFixed *params = picture->filter_params;
+    int width = pixman_fixed_to_int(params[0]);
+    int height = pixman_fixed_to_int(params[1]);
+    GLfloat kernel[GLAMOR_CONVOLUTION_MAX_TAPS];
+    GLfloat xscale, yscale;
+    int i;
+
+    pixmap_priv_get_scale(pixmap_priv, &xscale, &yscale);
+    glUniform2f(shader->source_texel, xscale, yscale);
+    glUniform4f(shader->source_kernel_size, width, height,
+                pixman_fixed_to_double((params[0] - pixman_fixed_1) >> 1),
+                pixman_fixed_to_double((params[1] - pixman_fixed_1) >> 1));
+
+    if (filter == SHADER_FILTER_SEPARABLE) {
+        glamor_convolution_separate(params + 2, width, height,
+                                    kernel, kernel + width);
+        glUniform1fv(shader->source_kernel_x, width, kernel);
+        glUniform1fv(shader->source_kernel_y, height, kernel + width);
+    } else {
+        for (i = 0; i < width * height; i++)
+            kernel[i] = pixman_fixed_to_double(params[2 + i]);
+        glUniform1fv(shader->source_kernel, width * height, kernel);
+    }
+}
+
 static char
 glamor_get_picture_location(PicturePtr picture)
 {
@@ -844,6 +1614,19 @@ glamor_composite_choose_shader(CARD8 op,
                                        &source_solid_color[2],
                                        &source_solid_color[3], PICT_a8r8g8b8);
         }
+        else if (glamor_composite_gradient_supported(source)) {
+            switch (source->pSourcePict->type) {
+            case SourcePictTypeLinear:
+                key.source = SHADER_SOURCE_LINEAR_GRADIENT;
+                break;
+            case SourcePictTypeRadial:
+                key.source = SHADER_SOURCE_RADIAL_GRADIENT;
+                break;
+            default:
+                key.source = SHADER_SOURCE_CONICAL_GRADIENT;
+                break;
+            }
+        }
         else
             goto fail;
     }
@@ -852,6 +1635,14 @@ glamor_composite_choose_shader(CARD8 op,
             key.source = SHADER_SOURCE_TEXTURE_ALPHA;
         else
             key.source = SHADER_SOURCE_TEXTURE;
+
+        if (source->filter == PictFilterConvolution) {
+            key.filter = glamor_convolution_shader_filter(glamor_priv, source);
+            if (key.filter == SHADER_FILTER_NONE) {
+                glamor_fallback("unsupported convolution kernel\n");
+                goto fail;
+            }
+        }
     }
 
     if (mask) {
@@ -906,6 +1697,13 @@ glamor_composite_choose_shader(CARD8 op,
         key.dest_swizzle = SHADER_DEST_SWIZZLE_DEFAULT;
     }
 
+    key.combine = glamor_composite_op_combine(op);
+    if (key.combine != SHADER_COMBINE_BLEND &&
+        key.in != glamor_program_alpha_normal) {
+        glamor_fallback("Unsupported component alpha op: %d\n", op);
+        goto fail;
+    }
+
     if (source && source->alphaMap) {
         glamor_fallback("source alphaMap\n");
         goto fail;
@@ -1083,12 +1881,22 @@ glamor_composite_set_shader_blend(glamor_screen_private *glamor_priv,
         glamor_set_composite_solid(shader->source_solid_color,
                                    shader->source_uniform_location);
     }
+#ifdef GLAMOR_GRADIENT_SHADER
+    else if (glamor_shader_source_is_gradient(key->source)) {
+        glamor_set_composite_gradient(glamor_priv->screen, shader,
+                                      shader->source);
+    }
+#endif
     else {
         glamor_set_composite_texture(glamor_priv, 0,
                                      shader->source,
                                      shader->source_pixmap, shader->source_wh,
                                      shader->source_repeat_mode,
                                      dest_priv);
+        if (key->filter != SHADER_FILTER_NONE)
+            glamor_set_composite_convolution(shader, key->filter,
+                                             shader->source,
+                                             shader->source_pixmap);
     }
 
     if (key->mask != SHADER_MASK_NONE) {
@@ -1172,7 +1980,7 @@ glamor_composite_with_shader(CARD8 op,
 
     glamor_set_destination_pixmap_priv_nc(glamor_priv, dest_pixmap, dest_pixmap_priv);
     glamor_composite_set_shader_blend(glamor_priv, dest_pixmap_priv, &key, shader, &op_info);
-    glamor_set_alu(screen, GXcopy);
+    glamor_set_gxcopy(screen);
 
     glamor_priv->has_source_coords = key.source != SHADER_SOURCE_SOLID;
     glamor_priv->has_mask_coords = (key.mask != SHADER_MASK_NONE &&
@@ -1184,7 +1992,20 @@ glamor_composite_with_shader(CARD8 op,
                                &dest_x_off, &dest_y_off);
     pixmap_priv_get_dest_scale(dest_pixmap, dest_pixmap_priv, &dst_xscale, &dst_yscale);
 
-    if (glamor_priv->has_source_coords) {
+    if (key.combine != SHADER_COMBINE_BLEND) {
+        glamor_set_composite_combine(shader, key.combine, op);
+        if (!glamor_set_composite_dest_read(glamor_priv, shader, dest,
+                                            dest_pixmap_priv, rects, nrect,
+                                            dest_x_off, dest_y_off))
+            goto fail;
+    }
+
+    if (glamor_shader_source_is_gradient(key.source)) {
+        /* Gradients are evaluated in picture space. */
+        source_x_off = 0;
+        source_y_off = 0;
+    }
+    else if (glamor_priv->has_source_coords) {
         glamor_get_drawable_deltas(source->pDrawable,
                                    source_pixmap, &source_x_off, &source_y_off);
         pixmap_priv_get_scale(source_pixmap_priv, &src_xscale, &src_yscale);
@@ -1245,7 +2066,13 @@ glamor_composite_with_shader(CARD8 op,
                                              vertices,
                                              vb_stride);
             vertices += 2;
-            if (key.source != SHADER_SOURCE_SOLID) {
+            if (glamor_shader_source_is_gradient(key.source)) {
+                glamor_set_tcoords_ext(x_source, y_source,
+                                       x_source + width, y_source + height,
+                                       vertices, vb_stride);
+                vertices += 2;
+            }
+            else if (key.source != SHADER_SOURCE_SOLID) {
                 glamor_set_normalize_tcoords_generic(source_pixmap,
                                                      source_pixmap_priv,
                                                      source->repeatType,
@@ -1421,6 +2248,7 @@ glamor_composite_clipped_region(CARD8 op,
     /* Is the composite operation equivalent to a copy? */
     if (!mask && !source->alphaMap && !dest->alphaMap
         && source->pDrawable && !source->transform
+        && source->filter != PictFilterConvolution
         /* CopyArea is only defined with matching depths. */
         && dest->pDrawable->depth == source->pDrawable->depth
         && ((op == PictOpSrc
@@ -1453,7 +2281,8 @@ glamor_composite_clipped_region(CARD8 op,
     /* XXX is it possible source mask have non-zero drawable.x/y? */
     if (source
         && ((!source->pDrawable
-             && (source->pSourcePict->type != SourcePictTypeSolidFill))
+             && (source->pSourcePict->type != SourcePictTypeSolidFill)
+             && !glamor_composite_gradient_supported(source))
             || (source->pDrawable
                 && !GLAMOR_PIXMAP_PRIV_HAS_FBO(source_pixmap_priv)
                 && (source_pixmap->drawable.width != width
@@ -1578,6 +2407,158 @@ glamor_composite_clipped_region(CARD8 op,
     return ok;
 }
 
+static Bool
+glamor_picture_is_opaque(PicturePtr picture, INT16 x, INT16 y,
+                         CARD16 width, CARD16 height)
+{
+    if (picture->alphaMap)
+        return FALSE;
+
+    if (!picture->pDrawable)
+        return picture->pSourcePict->type == SourcePictTypeSolidFill &&
+            (picture->pSourcePict->solidFill.color >> 24) == 0xff;
+
+    if (PICT_FORMAT_A(picture->format) != 0)
+        return FALSE;
+
+    /* Convolution kernels need not sum to one */
+    if (picture->filter == PictFilterConvolution)
+        return FALSE;
+
+    if (picture->repeatType != RepeatNone)
+        return TRUE;
+
+    /* Samples outside a non-repeating drawable are transparent, so
+     * every sample has to come from inside it.
+     */
+    return !picture->transform &&
+        x >= 0 && x + width <= picture->pDrawable->width &&
+        y >= 0 && y + height <= picture->pDrawable->height;
+}
+
+/*
+ * Rewrites the op into a cheaper equivalent, knowing which of the
+ * source and destination alpha are always one. Ops that end up as Src
+ * run without blending, and may become plain copies or clears. A mask
+ * that is an opaque solid is dropped.
+ */
+static CARD8
+glamor_composite_simplify_op(CARD8 op, PicturePtr source, PicturePtr *mask,
+                             PicturePtr dest, INT16 x_source, INT16 y_source,
+                             CARD16 width, CARD16 height)
+{
+    Bool dest_opaque = PICT_FORMAT_A(dest->format) == 0 && !dest->alphaMap;
+    int i;
+
+    if (op > PictOpAdd)
+        return op;
+
+    if (*mask && !(*mask)->pDrawable && !(*mask)->alphaMap &&
+        (*mask)->pSourcePict->type == SourcePictTypeSolidFill) {
+        CARD32 color = (*mask)->pSourcePict->solidFill.color;
+
+        if ((*mask)->componentAlpha ? color == 0xffffffff :
+            (color >> 24) == 0xff)
+            *mask = NULL;
+    }
+
+    for (i = 0; i < 2; i++) {
+        if (dest_opaque) {
+            switch (op) {
+            case PictOpOverReverse:
+                op = PictOpDst;
+                break;
+            case PictOpIn:
+                op = PictOpSrc;
+                break;
+            case PictOpOut:
+                op = PictOpClear;
+                break;
+            case PictOpAtop:
+                op = PictOpOver;
+                break;
+            case PictOpAtopReverse:
+                op = PictOpInReverse;
+                break;
+            case PictOpXor:
+                op = PictOpOutReverse;
+                break;
+            }
+        }
+
+        if (!*mask && glamor_picture_is_opaque(source, x_source, y_source,
+                                                width, height)) {
+            switch (op) {
+            case PictOpOver:
+                op = PictOpSrc;
+                break;
+            case PictOpInReverse:
+                op = PictOpDst;
+                break;
+            case PictOpOutReverse:
+                op = PictOpClear;
+                break;
+            case PictOpAtop:
+                op = PictOpIn;
+                break;
+            case PictOpAtopReverse:
+                op = PictOpOverReverse;
+                break;
+            case PictOpXor:
+                op = PictOpOut;
+                break;
+            }
+        }
+    }
+
+    return op;
+}
+
+/*
+ * Clear, and Src or Over of an opaque solid color, only store a pixel
+ * value, which a clear does without the composite pipeline.
+ */
+static Bool
+glamor_composite_clear(CARD8 op, PicturePtr source, PicturePtr mask,
+                       PicturePtr dest, PixmapPtr dest_pixmap,
+                       RegionPtr region)
+{
+    int depth = dest->pDrawable->depth;
+    int dest_x_off, dest_y_off;
+    CARD32 color, pixel;
+
+    if (mask || dest->alphaMap ||
+        RegionNumRects(region) > GLAMOR_CLEAR_MAX_BOXES)
+        return FALSE;
+
+    if ((depth != 8 && depth != 24 && depth != 32) ||
+        dest->format != format_for_depth(depth))
+        return FALSE;
+
+    if (op == PictOpClear)
+        color = 0;
+    else if (!source->pDrawable &&
+             source->pSourcePict->type == SourcePictTypeSolidFill) {
+        color = source->pSourcePict->solidFill.color;
+        if (op == PictOpOver && (color >> 24) == 0xff)
+            op = PictOpSrc;
+        if (op != PictOpSrc)
+            return FALSE;
+    }
+    else
+        return FALSE;
+
+    pixel = depth == 8 ? color >> 24 : color;
+
+    glamor_get_drawable_deltas(dest->pDrawable, dest_pixmap,
+                               &dest_x_off, &dest_y_off);
+    RegionTranslate(region, dest_x_off, dest_y_off);
+    glamor_clear_boxes(dest_pixmap, RegionRects(region),
+                       RegionNumRects(region), pixel);
+    RegionTranslate(region, -dest_x_off, -dest_y_off);
+    return TRUE;
+}
+
 void
 glamor_composite(CARD8 op,
                  PicturePtr source,
@@ -1618,7 +2599,13 @@ glamor_composite(CARD8 op,
     if (!glamor_pixmap_has_fbo(dest_pixmap))
         goto fail;
 
-    if (op >= ARRAY_SIZE(composite_op_info)) {
+    op = glamor_composite_simplify_op(op, source, &mask, dest,
+                                      x_source, y_source, width, height);
+    if (op == PictOpDst)
+        return;
+
+    if (op >= ARRAY_SIZE(composite_op_info) &&
+        glamor_composite_op_combine(op) == SHADER_COMBINE_BLEND) {
         glamor_fallback("Unsupported composite op %x\n", op);
         goto fail;
     }
@@ -1632,8 +2619,15 @@ glamor_composite(CARD8 op,
         }
     }
 
-    if ((source && source->filter >= PictFilterConvolution)
-        || (mask && mask->filter >= PictFilterConvolution)) {
+    /* Convolution is only implemented for the source, and only on
+     * the non-tiled path.
+     */
+    if ((source && source->filter > PictFilterConvolution)
+        || (mask && mask->filter >= PictFilterConvolution)
+        || (source_pixmap && source->filter == PictFilterConvolution &&
+            (glamor_priv->convolution_max_taps == 0 ||
+             glamor_pixmap_is_large(source_pixmap) ||
+             glamor_pixmap_is_large(dest_pixmap)))) {
         glamor_fallback("glamor_composite(): unsupported filter\n");
         goto fail;
     }
@@ -1660,6 +2654,11 @@ glamor_composite(CARD8 op,
     if (nbox == 0)
         return;
 
+    if (glamor_composite_clear(op, source, mask, dest, dest_pixmap, &region)) {
+        REGION_UNINIT(dest->pDrawable->pScreen, &region);
+        return;
+    }
+
     /* If destination is not a large pixmap, but the region is larger
      * than texture size limitation, and source or mask is memory pixmap,
      * then there may be need to load a large memory pixmap to a
@@ -1676,7 +2675,8 @@ glamor_composite(CARD8 op,
                 (glamor_pixmap_is_memory(mask_pixmap) ||
                  mask->repeatType == RepeatPad))
             || (!source_pixmap &&
-                (source->pSourcePict->type != SourcePictTypeSolidFill))
+                (source->pSourcePict->type != SourcePictTypeSolidFill) &&
+                !glamor_composite_gradient_supported(source))
             || (!mask_pixmap && mask &&
                 mask->pSourcePict->type != SourcePictTypeSolidFill)))
         force_clip = 1;
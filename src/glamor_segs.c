@@ -57,6 +57,10 @@ glamor_poly_segment_solid_gl(DrawablePtr drawable, GCPtr gc,
 
     glamor_make_current(glamor_priv);
 
+    if (glamor_gc_needs_dest_copy(screen, gc) &&
+        !glamor_set_dest_copy_bounds_segments(drawable, gc, nseg, segs))
+        goto bail;
+
     prog = glamor_use_program_fill(pixmap, gc,
                                    &glamor_priv->poly_segment_program,
                                    &glamor_facet_poly_segment);
@@ -63,6 +63,17 @@ glamor_fill_spans_gl(DrawablePtr drawable,
 
     glamor_make_current(glamor_priv);
 
+    if (glamor_gc_needs_dest_copy(screen, gc)) {
+        glamor_dest_bounds bounds;
+
+        glamor_dest_bounds_init(&bounds);
+        for (c = 0; c < n; c++)
+            glamor_dest_bounds_add(&bounds, points[c].x, points[c].y,
+                                   points[c].x + widths[c], points[c].y + 1);
+        if (!glamor_set_dest_copy_bounds(drawable, gc, &bounds))
+            goto bail;
+    }
+
     if (glamor_priv->glsl_version >= 130) {
         prog = glamor_use_program_fill(pixmap, gc, &glamor_priv->fill_spans_program,
                                        &glamor_facet_fillspans_130);
@@ -84,66 +84,72 @@ glamor_get_glyphs(FontPtr font, glamor_font_t *glamor_font,
 }
 
 /*
- * Construct quads for the provided list of characters and draw them
+ * Where each glyph of a string lands, and where it lives in the font
+ * texture pages
+ */
+
+typedef struct {
+    GLshort     x, y;
+    GLshort     width, height;
+    GLshort     tx, ty;
+    int         page;
+} glamor_text_glyph;
+
+/*
+ * Place one glyph, found at the given row and column counted from the
+ * first ones in the font, making sure its row has been uploaded
+ */
+
+static Bool
+glamor_text_place(ScreenPtr screen, FontPtr font,
+                  glamor_font_t *glamor_font,
+                  glamor_text_glyph *glyph, CharInfoPtr ci,
+                  int x, int y, int font_row, int font_col)
+{
+    if (!glamor_font_load_row(screen, font, glamor_font, font_row))
+        return FALSE;
+
+    glyph->x = x + ci->metrics.leftSideBearing;
+    glyph->y = y - ci->metrics.ascent;
+    glyph->width = GLYPHWIDTHPIXELS(ci);
+    glyph->height = GLYPHHEIGHTPIXELS(ci);
+    glyph->tx = (font_col % glamor_font->cols_per_strip) *
+        glamor_font->glyph_width_bytes * 8;
+    glyph->ty = ((font_row % glamor_font->rows_per_page) *
+                 glamor_font->strips_per_row +
+                 font_col / glamor_font->cols_per_strip) *
+        glamor_font->glyph_height;
+    glyph->page = font_row / glamor_font->rows_per_page;
+    return TRUE;
+}
+
+/*
+ * Lay out the provided list of characters, making sure the font rows
+ * they use have been uploaded. Returns the number of glyphs to draw,
+ * or -1 if the font couldn't be loaded
  */
 
 static int
-glamor_text(DrawablePtr drawable, GCPtr gc,
-            glamor_font_t *glamor_font,
-            glamor_program *prog,
-            int x, int y,
-            int count, char *s_chars, CharInfoPtr *charinfo,
-            Bool sixteen)
+glamor_text_layout(ScreenPtr screen, FontPtr font,
+                   glamor_font_t *glamor_font,
+                   int *xp, int y,
+                   int count, char *s_chars, CharInfoPtr *charinfo,
+                   Bool sixteen, glamor_text_glyph *glyphs)
 {
     unsigned char *chars = (unsigned char *) s_chars;
-    FontPtr font = gc->font;
-    int off_x, off_y;
+    int x = *xp;
     int c;
     int nglyph;
-    GLshort *v;
-    char *vbo_offset;
     CharInfoPtr ci;
     int firstRow = font->info.firstRow;
     int firstCol = font->info.firstCol;
-    int glyph_spacing_x = glamor_font->glyph_width_bytes * 8;
-    int glyph_spacing_y = glamor_font->glyph_height;
-    int box_index;
-    PixmapPtr pixmap = glamor_get_drawable_pixmap(drawable);
-    glamor_pixmap_private *pixmap_priv = glamor_get_pixmap_private(pixmap);
-
-    /* Set the font as texture 1 */
-
-    glActiveTexture(GL_TEXTURE1);
-    glBindTexture(GL_TEXTURE_2D, glamor_font->texture_id);
-    glUniform1i(prog->font_uniform, 1);
-
-    /* Set up the vertex buffers for the font and destination */
-
-    v = glamor_get_vbo_space(drawable->pScreen, count * (6 * sizeof (GLshort)), &vbo_offset);
 
-    glEnableVertexAttribArray(GLAMOR_VERTEX_POS);
-    glVertexAttribDivisor(GLAMOR_VERTEX_POS, 1);
-    glVertexAttribPointer(GLAMOR_VERTEX_POS, 4, GL_SHORT, GL_FALSE,
-                          6 * sizeof (GLshort), vbo_offset);
-
-    glEnableVertexAttribArray(GLAMOR_VERTEX_SOURCE);
-    glVertexAttribDivisor(GLAMOR_VERTEX_SOURCE, 1);
-    glVertexAttribPointer(GLAMOR_VERTEX_SOURCE, 2, GL_SHORT, GL_FALSE,
-                          6 * sizeof (GLshort), vbo_offset + 4 * sizeof (GLshort));
-
-    /* Set the vertex coordinates */
     nglyph = 0;
 
     for (c = 0; c < count; c++) {
         if ((ci = *charinfo++)) {
-            int     x1 = x + ci->metrics.leftSideBearing;
-            int     y1 = y - ci->metrics.ascent;
-            int     width = GLYPHWIDTHPIXELS(ci);
-            int     height = GLYPHHEIGHTPIXELS(ci);
-            int     tx, ty = 0;
             int     row = 0, col;
-            int     second_row = 0;
-            x += ci->metrics.characterWidth;
+            int     font_row = 0;
 
             if (sixteen) {
                 if (ci == glamor_font->default_char) {
@@ -153,10 +159,8 @@ glamor_text(DrawablePtr drawable, GCPtr gc,
                     row = chars[0];
                     col = chars[1];
                 }
-                if (FONTLASTROW(font) != 0) {
-                    ty = ((row - firstRow) / 2) * glyph_spacing_y;
-                    second_row = (row - firstRow) & 1;
-                }
+                if (FONTLASTROW(font) != 0)
+                    font_row = row - firstRow;
                 else
                     col += row << 8;
             } else {
@@ -166,35 +170,143 @@ glamor_text(DrawablePtr drawable, GCPtr gc,
                     col = chars[0];
             }
 
-            tx = (col - firstCol) * glyph_spacing_x;
-            /* adjust for second row layout */
-            tx += second_row * glamor_font->row_width * 8;
-
-            v[ 0] = x1;
-            v[ 1] = y1;
-            v[ 2] = width;
-            v[ 3] = height;
-            v[ 4] = tx;
-            v[ 5] = ty;
-
-            v += 6;
+            if (!glamor_text_place(screen, font, glamor_font, &glyphs[nglyph],
+                                   ci, x, y, font_row, col - firstCol))
+                return -1;
             nglyph++;
+
+            x += ci->metrics.characterWidth;
         }
         chars += 1 + sixteen;
     }
-    glamor_put_vbo_space(drawable->pScreen);
+    *xp = x;
+    return nglyph;
+}
+
+/*
+ * Construct quads for the laid out glyphs and draw them, one draw for
+ * each font texture page in use. Glyphs are in pixmap coordinates,
+ * the clip is offset from them by dx, dy
+ */
+
+static void
+glamor_text(PixmapPtr pixmap, RegionPtr clip, int dx, int dy,
+            glamor_font_t *glamor_font,
+            glamor_program *prog,
+            glamor_text_glyph *glyphs, int nglyph)
+{
+    ScreenPtr screen = pixmap->drawable.pScreen;
+    int off_x, off_y;
+    int first, next;
+    int i, n;
+    GLshort *v;
+    char *vbo_offset;
+    int box_index;
+    glamor_pixmap_private *pixmap_priv = glamor_get_pixmap_private(pixmap);
+    glamor_screen_private *glamor_priv = glamor_get_screen_private(screen);
+    Bool instanced = glamor_priv->glsl_version >= 130;
+
+    /* The font pages go in texture 1 */
+
+    glUniform1i(prog->font_uniform, 1);
+    if (!instanced)
+        glUniform2f(prog->font_size_inv_uniform,
+                    1.0f / glamor_font->page_width,
+                    1.0f / glamor_font->page_height);
+
+    for (first = 0; first < nglyph; first = next) {
+        int page = glamor_font->num_pages;
+
+        /* Set up the vertex buffers for the font and destination. Without
+         * instancing, each glyph is a quad of four vertices.
+         */
+
+        if (instanced) {
+            v = glamor_get_vbo_space(screen, (nglyph - first) * (6 * sizeof (GLshort)), &vbo_offset);
+
+            glEnableVertexAttribArray(GLAMOR_VERTEX_POS);
+            glVertexAttribDivisor(GLAMOR_VERTEX_POS, 1);
+            glVertexAttribPointer(GLAMOR_VERTEX_POS, 4, GL_SHORT, GL_FALSE,
+                                  6 * sizeof (GLshort), vbo_offset);
+
+            glEnableVertexAttribArray(GLAMOR_VERTEX_SOURCE);
+            glVertexAttribDivisor(GLAMOR_VERTEX_SOURCE, 1);
+            glVertexAttribPointer(GLAMOR_VERTEX_SOURCE, 2, GL_SHORT, GL_FALSE,
+                                  6 * sizeof (GLshort), vbo_offset + 4 * sizeof (GLshort));
+        } else {
+            v = glamor_get_vbo_space(screen, (nglyph - first) * (16 * sizeof (GLshort)), &vbo_offset);
+
+            glEnableVertexAttribArray(GLAMOR_VERTEX_POS);
+            glVertexAttribPointer(GLAMOR_VERTEX_POS, 2, GL_SHORT, GL_FALSE,
+                                  4 * sizeof (GLshort), vbo_offset);
+
+            glEnableVertexAttribArray(GLAMOR_VERTEX_SOURCE);
+            glVertexAttribPointer(GLAMOR_VERTEX_SOURCE, 2, GL_SHORT, GL_FALSE,
+                                  4 * sizeof (GLshort), vbo_offset + 2 * sizeof (GLshort));
+        }
+
+        /* Set the vertex coordinates for the glyphs on the first
+         * page not yet drawn, marking them as done
+         */
+        n = 0;
+        next = nglyph;
+
+        for (i = first; i < nglyph; i++) {
+            glamor_text_glyph *g = &glyphs[i];
+
+            if (g->page < 0)
+                continue;
+            if (page == glamor_font->num_pages)
+                page = g->page;
+            if (g->page != page) {
+                if (next == nglyph)
+                    next = i;
+                continue;
+            }
+
+            if (instanced) {
+                v[ 0] = g->x;
+                v[ 1] = g->y;
+                v[ 2] = g->width;
+                v[ 3] = g->height;
+                v[ 4] = g->tx;
+                v[ 5] = g->ty;
+
+                v += 6;
+            } else {
+                v[ 0] = g->x;                   v[ 1] = g->y;
+                v[ 2] = g->tx;                  v[ 3] = g->ty;
+                v[ 4] = g->x + g->width;        v[ 5] = g->y;
+                v[ 6] = g->tx + g->width;       v[ 7] = g->ty;
+                v[ 8] = g->x + g->width;        v[ 9] = g->y + g->height;
+                v[10] = g->tx + g->width;       v[11] = g->ty + g->height;
+                v[12] = g->x;                   v[13] = g->y + g->height;
+                v[14] = g->tx;                  v[15] = g->ty + g->height;
+
+                v += 16;
+            }
+            g->page = -1;
+            n++;
+        }
+        glamor_put_vbo_space(screen);
+
+        if (n == 0)
+            continue;
 
-    if (nglyph != 0) {
+        glActiveTexture(GL_TEXTURE1);
+        glBindTexture(GL_TEXTURE_2D, glamor_font->page_texture[page]);
 
         glEnable(GL_SCISSOR_TEST);
 
         glamor_pixmap_loop(pixmap_priv, box_index) {
-            BoxPtr box = RegionRects(gc->pCompositeClip);
-            int nbox = RegionNumRects(gc->pCompositeClip);
+            BoxPtr box = RegionRects(clip);
+            int nbox = RegionNumRects(clip);
 
-            glamor_set_destination_drawable(drawable, box_index, TRUE, FALSE,
+            glamor_set_destination_drawable(&pixmap->drawable, box_index, TRUE, FALSE,
                                             prog->matrix_uniform,
                                             &off_x, &off_y);
+            off_x += dx;
+            off_y += dy;
 
             /* Run over the clip list, drawing the glyphs
              * in each box
@@ -206,18 +318,293 @@ glamor_text(DrawablePtr drawable, GCPtr gc,
                           box->x2 - box->x1,
                           box->y2 - box->y1);
                 box++;
-                glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, nglyph);
+                if (instanced)
+                    glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, n);
+                else
+                    glamor_glDrawArrays_GL_QUADS(glamor_priv, n);
             }
         }
         glDisable(GL_SCISSOR_TEST);
     }
 
-    glVertexAttribDivisor(GLAMOR_VERTEX_SOURCE, 0);
+    if (instanced) {
+        glVertexAttribDivisor(GLAMOR_VERTEX_SOURCE, 0);
+        glVertexAttribDivisor(GLAMOR_VERTEX_POS, 0);
+    }
     glDisableVertexAttribArray(GLAMOR_VERTEX_SOURCE);
-    glVertexAttribDivisor(GLAMOR_VERTEX_POS, 0);
     glDisableVertexAttribArray(GLAMOR_VERTEX_POS);
+}
+
+/*
+ * Text requests are queued up while the destination, font and drawing
+ * state stay the same, so that a terminal redrawing line by line ends
+ * up as a few draws. Anything else using the GL context goes through
+ * glamor_make_current, which draws the queued text first. The few GC
+ * fields solid text uses are copied into the batch, as the client's GC
+ * may change before the text is drawn.
+ *
+ * Image text backgrounds are queued as well, and all drawn before the
+ * glyphs; a background covering a queued glyph starts a new batch.
+ */
+
+#define GLAMOR_TEXT_BATCH_GLYPHS        4096
+#define GLAMOR_TEXT_BATCH_BOXES         256
+
+struct glamor_text_batch {
+    PixmapPtr           pixmap;
+    GCRec               gc;
+    glamor_font_t       *font;
+    glamor_program_fill *prog_fill;
+    const glamor_facet  *facet;
+    glamor_program      *prog;
+    RegionRec           clip;
+    int                 dx, dy;
+    BoxRec              extents;
+    int                 nbox;
+    BoxRec              boxes[GLAMOR_TEXT_BATCH_BOXES];
+    int                 nglyph;
+    glamor_text_glyph   glyphs[GLAMOR_TEXT_BATCH_GLYPHS];
+};
+
+static glamor_program *
+glamor_text_use_program(PixmapPtr pixmap, GCPtr gc,
+                        glamor_program_fill *prog_fill,
+                        const glamor_facet *facet,
+                        glamor_program *prog)
+{
+    if (prog_fill)
+        return glamor_use_program_fill(pixmap, gc, prog_fill, facet);
+    if (!glamor_use_program(pixmap, gc, prog, NULL))
+        return NULL;
+    return prog;
+}
+
+void
+glamor_text_flush(glamor_screen_private *glamor_priv)
+{
+    struct glamor_text_batch *batch = glamor_priv->text_batch;
+    glamor_program *prog;
+
+    if (!glamor_priv->text_pending)
+        return;
+    glamor_priv->text_pending = FALSE;
+
+    if (batch->nbox)
+        glamor_solid_boxes_planemask(batch->pixmap, batch->boxes, batch->nbox,
+                                     batch->gc.bgPixel, batch->gc.planemask);
+
+    prog = glamor_text_use_program(batch->pixmap, &batch->gc, batch->prog_fill,
+                                   batch->facet, batch->prog);
+    if (prog && batch->nglyph)
+        glamor_text(batch->pixmap, &batch->clip, batch->dx, batch->dy,
+                    batch->font, prog, batch->glyphs, batch->nglyph);
+
+    RegionUninit(&batch->clip);
+    batch->nbox = 0;
+    batch->nglyph = 0;
+}
+
+/*
+ * Queued text holds on to its destination; draw it before the pixmap
+ * goes away or its fbo is replaced
+ */
+void
+glamor_text_flush_pixmap(PixmapPtr pixmap)
+{
+    glamor_screen_private *glamor_priv =
+        glamor_get_screen_private(pixmap->drawable.pScreen);
+
+    if (glamor_priv->text_pending &&
+        glamor_priv->text_batch->pixmap == pixmap)
+        glamor_make_current(glamor_priv);
+}
+
+void
+glamor_text_fini(ScreenPtr screen)
+{
+    glamor_screen_private *glamor_priv = glamor_get_screen_private(screen);
+    struct glamor_text_batch *batch = glamor_priv->text_batch;
 
-    return x;
+    if (glamor_priv->text_pending) {
+        glamor_priv->text_pending = FALSE;
+        RegionUninit(&batch->clip);
+    }
+    free(batch);
+    glamor_priv->text_batch = NULL;
+}
+
+static Bool
+glamor_text_batch_matches(glamor_screen_private *glamor_priv,
+                          PixmapPtr pixmap, GCPtr gc,
+                          glamor_font_t *glamor_font,
+                          glamor_program_fill *prog_fill,
+                          const glamor_facet *facet,
+                          glamor_program *prog,
+                          Bool solid,
+                          int dx, int dy, int nglyph,
+                          BoxPtr boxes, int nbox)
+{
+    struct glamor_text_batch *batch = glamor_priv->text_batch;
+    int i;
+
+    /* Only solid text is queued */
+    if (!(glamor_priv->text_pending && solid &&
+          batch->nglyph + nglyph <= GLAMOR_TEXT_BATCH_GLYPHS &&
+          batch->nbox + nbox <= GLAMOR_TEXT_BATCH_BOXES &&
+          batch->pixmap == pixmap &&
+          batch->font == glamor_font &&
+          batch->prog_fill == prog_fill &&
+          batch->facet == facet &&
+          batch->prog == prog &&
+          batch->gc.alu == gc->alu &&
+          batch->gc.planemask == gc->planemask &&
+          batch->gc.fgPixel == gc->fgPixel &&
+          batch->gc.bgPixel == gc->bgPixel &&
+          batch->dx == dx && batch->dy == dy &&
+          RegionEqual(&batch->clip, gc->pCompositeClip)))
+        return FALSE;
+
+    for (i = 0; i < nbox; i++)
+        if (boxes[i].x1 < batch->extents.x2 && batch->extents.x1 < boxes[i].x2 &&
+            boxes[i].y1 < batch->extents.y2 && batch->extents.y1 < boxes[i].y2)
+            return FALSE;
+    return TRUE;
+}
+
+/*
+ * Start a new batch, with a copy of the GC state. The program is set
+ * up here too, so that a failure is noticed while the request can
+ * still fall back
+ */
+static Bool
+glamor_text_batch_start(glamor_screen_private *glamor_priv,
+                        PixmapPtr pixmap, GCPtr gc,
+                        glamor_font_t *glamor_font,
+                        glamor_program_fill *prog_fill,
+                        const glamor_facet *facet,
+                        glamor_program *prog,
+                        int dx, int dy)
+{
+    struct glamor_text_batch *batch = glamor_priv->text_batch;
+
+    /* A destination copy only holds for the request it was taken for */
+    if (glamor_gc_needs_dest_copy(pixmap->drawable.pScreen, gc))
+        return FALSE;
+
+    if (!batch) {
+        batch = malloc(sizeof (struct glamor_text_batch));
+        if (!batch)
+            return FALSE;
+        glamor_priv->text_batch = batch;
+    }
+
+    memset(&batch->gc, 0, sizeof (batch->gc));
+    batch->gc.pScreen = pixmap->drawable.pScreen;
+    batch->gc.depth = pixmap->drawable.depth;
+    batch->gc.alu = gc->alu;
+    batch->gc.planemask = gc->planemask;
+    batch->gc.fgPixel = gc->fgPixel;
+    batch->gc.bgPixel = gc->bgPixel;
+    batch->gc.fillStyle = FillSolid;
+
+    if (!glamor_text_use_program(pixmap, &batch->gc, prog_fill, facet, prog))
+        return FALSE;
+
+    batch->pixmap = pixmap;
+    batch->font = glamor_font;
+    batch->prog_fill = prog_fill;
+    batch->facet = facet;
+    batch->prog = prog;
+    RegionNull(&batch->clip);
+    RegionCopy(&batch->clip, gc->pCompositeClip);
+    batch->dx = dx;
+    batch->dy = dy;
+    batch->extents.x1 = batch->extents.y1 = MAXSHORT;
+    batch->extents.x2 = batch->extents.y2 = MINSHORT;
+    batch->nbox = 0;
+    batch->nglyph = 0;
+    glamor_priv->text_pending = TRUE;
+    return TRUE;
+}
+
+/*
+ * Queue the laid out glyphs, along with any image text background
+ * boxes in pixmap coordinates, or draw them right away when the GC
+ * state can't be copied
+ */
+static Bool
+glamor_text_queue(DrawablePtr drawable, GCPtr gc,
+                  glamor_font_t *glamor_font,
+                  glamor_program_fill *prog_fill,
+                  const glamor_facet *facet,
+                  glamor_program *prog,
+                  Bool solid,
+                  glamor_text_glyph *glyphs, int nglyph,
+                  BoxPtr boxes, int nbox)
+{
+    glamor_screen_private *glamor_priv = glamor_get_screen_private(drawable->pScreen);
+    PixmapPtr pixmap = glamor_get_drawable_pixmap(drawable);
+    struct glamor_text_batch *batch;
+    int off_x, off_y;
+    int i;
+
+    glamor_get_drawable_deltas(drawable, pixmap, &off_x, &off_y);
+
+    /* Move the glyphs to pixmap coordinates */
+    for (i = 0; i < nglyph; i++) {
+        glyphs[i].x += drawable->x + off_x;
+        glyphs[i].y += drawable->y + off_y;
+    }
+
+    if (!glamor_text_batch_matches(glamor_priv, pixmap, gc, glamor_font,
+                                   prog_fill, facet, prog, solid,
+                                   off_x, off_y, nglyph, boxes, nbox)) {
+        /* Draws any other queued text */
+        glamor_make_current(glamor_priv);
+
+        if (!solid || nglyph > GLAMOR_TEXT_BATCH_GLYPHS ||
+            nbox > GLAMOR_TEXT_BATCH_BOXES ||
+            !glamor_text_batch_start(glamor_priv, pixmap, gc, glamor_font,
+                                     prog_fill, facet, prog, off_x, off_y)) {
+            if (nbox)
+                glamor_solid_boxes_planemask(pixmap, boxes, nbox,
+                                             gc->bgPixel, gc->planemask);
+            if (!nglyph)
+                return TRUE;
+            if (prog_fill && glamor_gc_needs_dest_copy(drawable->pScreen, gc)) {
+                glamor_dest_bounds bounds;
+
+                glamor_dest_bounds_init(&bounds);
+                for (i = 0; i < nglyph; i++)
+                    glamor_dest_bounds_add(&bounds,
+                                           glyphs[i].x - off_x,
+                                           glyphs[i].y - off_y,
+                                           glyphs[i].x - off_x + glyphs[i].width,
+                                           glyphs[i].y - off_y + glyphs[i].height);
+                if (!glamor_set_dest_copy_bounds(drawable, gc, &bounds))
+                    return FALSE;
+            }
+            prog = glamor_text_use_program(pixmap, gc, prog_fill, facet, prog);
+            if (!prog)
+                return FALSE;
+            glamor_text(pixmap, gc->pCompositeClip, off_x, off_y,
+                        glamor_font, prog, glyphs, nglyph);
+            return TRUE;
+        }
+    }
+
+    batch = glamor_priv->text_batch;
+    memcpy(&batch->boxes[batch->nbox], boxes, nbox * sizeof (boxes[0]));
+    batch->nbox += nbox;
+    for (i = 0; i < nglyph; i++) {
+        batch->extents.x1 = min(batch->extents.x1, glyphs[i].x);
+        batch->extents.y1 = min(batch->extents.y1, glyphs[i].y);
+        batch->extents.x2 = max(batch->extents.x2, glyphs[i].x + glyphs[i].width);
+        batch->extents.y2 = max(batch->extents.y2, glyphs[i].y + glyphs[i].height);
+    }
+    memcpy(&batch->glyphs[batch->nglyph], glyphs, nglyph * sizeof (glyphs[0]));
+    batch->nglyph += nglyph;
+    return TRUE;
 }
 
 static const char vs_vars_text[] =
@@ -253,6 +640,31 @@ static const char fs_exec_te[] =
     "       else\n"
     "               gl_FragColor = fg;\n";
 
+/*
+ * GLSL 1.20 versions, drawing a quad per glyph from the A8 font
+ * texture
+ */
+
+static const char vs_vars_text_120[] =
+    "attribute vec2 primitive;\n"
+    "attribute vec2 source;\n"
+    "varying vec2 glyph_pos;\n";
+
+static const char vs_exec_text_120[] =
+    "       vec2 pos = vec2(0,0);\n"
+    GLAMOR_POS(gl_Position, primitive.xy)
+    "       glyph_pos = source * font_size_inv;\n";
+
+static const char fs_exec_text_120[] =
+    "       if (texture2D(font, glyph_pos).w == 0.0)\n"
+    "               discard;\n";
+
+static const char fs_exec_te_120[] =
+    "       if (texture2D(font, glyph_pos).w == 0.0)\n"
+    "               gl_FragColor = bg;\n"
+    "       else\n"
+    "               gl_FragColor = fg;\n";
+
 static const glamor_facet glamor_facet_poly_text = {
     .name = "poly_text",
     .version = 130,
@@ -264,6 +676,16 @@ static const glamor_facet glamor_facet_poly_text = {
     .locations = glamor_program_location_font,
 };
 
+static const glamor_facet glamor_facet_poly_text_120 = {
+    .name = "poly_text",
+    .vs_vars = vs_vars_text_120,
+    .vs_exec = vs_exec_text_120,
+    .fs_vars = fs_vars_text,
+    .fs_exec = fs_exec_text_120,
+    .source_name = "source",
+    .locations = glamor_program_location_font_a8,
+};
+
 static Bool
 glamor_poly_text(DrawablePtr drawable, GCPtr gc,
                  int x, int y, int count, char *chars, Bool sixteen, int *final_pos)
@@ -271,10 +693,12 @@ glamor_poly_text(DrawablePtr drawable, GCPtr gc,
     ScreenPtr screen = drawable->pScreen;
     glamor_screen_private *glamor_priv = glamor_get_screen_private(screen);
     PixmapPtr pixmap = glamor_get_drawable_pixmap(drawable);
-    glamor_program *prog;
     glamor_pixmap_private *pixmap_priv;
     glamor_font_t *glamor_font;
+    const glamor_facet *facet;
     CharInfoPtr charinfo[255];  /* encoding only has 1 byte for count */
+    glamor_text_glyph glyphs[255];
+    int nglyph;
 
     glamor_font = glamor_font_get(drawable->pScreen, gc->font);
     if (!glamor_font)
@@ -286,15 +710,25 @@ glamor_poly_text(DrawablePtr drawable, GCPtr gc,
     if (!GLAMOR_PIXMAP_PRIV_HAS_FBO(pixmap_priv))
         goto bail;
 
-    glamor_make_current(glamor_priv);
-
-    prog = glamor_use_program_fill(pixmap, gc, &glamor_priv->poly_text_progs, &glamor_facet_poly_text);
+    /* Leave any queued text alone until we know whether this joins it */
+    glamor_make_context_current(glamor_priv);
 
-    if (!prog)
+    nglyph = glamor_text_layout(screen, gc->font, glamor_font, &x, y,
+                                count, chars, charinfo, sixteen, glyphs);
+    if (nglyph < 0)
         goto bail;
 
-    x = glamor_text(drawable, gc, glamor_font, prog,
-                    x, y, count, chars, charinfo, sixteen);
+    if (glamor_priv->glsl_version >= 130)
+        facet = &glamor_facet_poly_text;
+    else
+        facet = &glamor_facet_poly_text_120;
+
+    if (nglyph &&
+        !glamor_text_queue(drawable, gc, glamor_font,
+                           &glamor_priv->poly_text_progs, facet, NULL,
+                           gc->fillStyle == FillSolid, glyphs, nglyph,
+                           NULL, 0))
+        goto bail;
 
     *final_pos = x;
     return TRUE;
@@ -345,6 +779,16 @@ static const glamor_facet glamor_facet_image_text = {
     .locations = glamor_program_location_font,
 };
 
+static const glamor_facet glamor_facet_image_text_120 = {
+    .name = "image_text",
+    .vs_vars = vs_vars_text_120,
+    .vs_exec = vs_exec_text_120,
+    .fs_vars = fs_vars_text,
+    .fs_exec = fs_exec_text_120,
+    .source_name = "source",
+    .locations = glamor_program_location_font_a8,
+};
+
 static Bool
 use_image_solid(PixmapPtr pixmap, GCPtr gc, glamor_program *prog, void *arg)
 {
@@ -379,32 +823,35 @@ static const glamor_facet glamor_facet_te_text = {
     .use = glamor_te_text_use,
 };
 
+static const glamor_facet glamor_facet_te_text_120 = {
+    .name = "te_text",
+    .vs_vars = vs_vars_text_120,
+    .vs_exec = vs_exec_text_120,
+    .fs_vars = fs_vars_text,
+    .fs_exec = fs_exec_te_120,
+    .locations = glamor_program_location_fg | glamor_program_location_bg | glamor_program_location_font_a8,
+    .source_name = "source",
+    .use = glamor_te_text_use,
+};
+
+/*
+ * Draw laid out image text: the background, unless the font's glyphs
+ * cover it exactly, and then the glyphs
+ */
 static Bool
-glamor_image_text(DrawablePtr drawable, GCPtr gc,
-                  int x, int y, int count, char *chars,
-                  Bool sixteen)
+glamor_image_glyphs(DrawablePtr drawable, GCPtr gc,
+                    glamor_font_t *glamor_font,
+                    int x, int y, int count, CharInfoPtr *charinfo,
+                    glamor_text_glyph *glyphs, int nglyph)
 {
     ScreenPtr screen = drawable->pScreen;
     glamor_screen_private *glamor_priv = glamor_get_screen_private(screen);
     PixmapPtr pixmap = glamor_get_drawable_pixmap(drawable);
     glamor_program *prog;
-    glamor_pixmap_private *pixmap_priv;
-    glamor_font_t *glamor_font;
     const glamor_facet *prim_facet;
     const glamor_facet *fill_facet;
-    CharInfoPtr charinfo[255];  /* encoding only has 1 byte for count */
-
-    pixmap_priv = glamor_get_pixmap_private(pixmap);
-    if (!GLAMOR_PIXMAP_PRIV_HAS_FBO(pixmap_priv))
-        return FALSE;
-
-    glamor_font = glamor_font_get(drawable->pScreen, gc->font);
-    if (!glamor_font)
-        return FALSE;
-
-    glamor_get_glyphs(gc->font, glamor_font, count, chars, sixteen, charinfo);
-
-    glamor_make_current(glamor_priv);
+    RegionRec region;
+    Bool ret;
 
     if (TERMINALFONT(gc->font))
         prog = &glamor_priv->te_text_prog;
@@ -412,33 +859,34 @@ glamor_image_text(DrawablePtr drawable, GCPtr gc,
         prog = &glamor_priv->image_text_prog;
 
     if (prog->failed)
-        goto bail;
+        return FALSE;
 
     if (!prog->prog) {
+        Bool use_130 = glamor_priv->glsl_version >= 130;
+
         if (TERMINALFONT(gc->font)) {
-            prim_facet = &glamor_facet_te_text;
+            prim_facet = use_130 ? &glamor_facet_te_text : &glamor_facet_te_text_120;
             fill_facet = NULL;
         } else {
-            prim_facet = &glamor_facet_image_text;
+            prim_facet = use_130 ? &glamor_facet_image_text : &glamor_facet_image_text_120;
             fill_facet = &glamor_facet_image_fill;
         }
 
         if (!glamor_build_program(screen, prog, prim_facet, fill_facet, NULL, NULL))
-            goto bail;
+            return FALSE;
     }
 
     if (!TERMINALFONT(gc->font)) {
         int width = 0;
         int c;
-        RegionRec region;
         BoxRec box;
         int off_x, off_y;
 
         /* Check planemask before drawing background to
          * bail early if it's not OK
          */
-        if (!glamor_set_planemask(gc->depth, gc->planemask))
-            goto bail;
+        if (!glamor_set_planemask(screen, gc->depth, gc->planemask))
+            return FALSE;
         for (c = 0; c < count; c++)
             if (charinfo[c])
                 width += charinfo[c]->metrics.characterWidth;
@@ -457,20 +905,53 @@ glamor_image_text(DrawablePtr drawable, GCPtr gc,
         RegionInit(&region, &box, 1);
         RegionIntersect(&region, &region, gc->pCompositeClip);
         RegionTranslate(&region, off_x, off_y);
-        glamor_solid_boxes(pixmap, RegionRects(&region), RegionNumRects(&region), gc->bgPixel);
-        RegionUninit(&region);
-    }
+    } else
+        RegionNull(&region);
+
+    /* Image text is always drawn solid */
+    ret = ((!nglyph && !RegionNotEmpty(&region)) ||
+           glamor_text_queue(drawable, gc, glamor_font, NULL, NULL, prog,
+                             TRUE, glyphs, nglyph,
+                             RegionRects(&region), RegionNumRects(&region)));
+    RegionUninit(&region);
+    return ret;
+}
 
-    if (!glamor_use_program(pixmap, gc, prog, NULL))
-        goto bail;
+static Bool
+glamor_image_text(DrawablePtr drawable, GCPtr gc,
+                  int x, int y, int count, char *chars,
+                  Bool sixteen)
+{
+    ScreenPtr screen = drawable->pScreen;
+    glamor_screen_private *glamor_priv = glamor_get_screen_private(screen);
+    PixmapPtr pixmap = glamor_get_drawable_pixmap(drawable);
+    glamor_pixmap_private *pixmap_priv;
+    glamor_font_t *glamor_font;
+    CharInfoPtr charinfo[255];  /* encoding only has 1 byte for count */
+    glamor_text_glyph glyphs[255];
+    int nglyph;
+    int x_end = x;
 
-    (void) glamor_text(drawable, gc, glamor_font, prog,
-                       x, y, count, chars, charinfo, sixteen);
+    pixmap_priv = glamor_get_pixmap_private(pixmap);
+    if (!GLAMOR_PIXMAP_PRIV_HAS_FBO(pixmap_priv))
+        return FALSE;
 
-    return TRUE;
+    glamor_font = glamor_font_get(drawable->pScreen, gc->font);
+    if (!glamor_font)
+        return FALSE;
 
-bail:
-    return FALSE;
+    glamor_get_glyphs(gc->font, glamor_font, count, chars, sixteen, charinfo);
+
+    /* Leave any queued text alone until we know whether this joins it */
+    glamor_make_context_current(glamor_priv);
+
+    nglyph = glamor_text_layout(screen, gc->font, glamor_font, &x_end, y,
+                                count, chars, charinfo, sixteen, glyphs);
+    if (nglyph < 0)
+        return FALSE;
+
+    return glamor_image_glyphs(drawable, gc, glamor_font, x, y,
+                               count, charinfo, glyphs, nglyph);
 }
 
 void
@@ -488,3 +969,114 @@ glamor_image_text16(DrawablePtr drawable, GCPtr gc,
     if (!glamor_image_text(drawable, gc, x, y, count, (char *) chars, TRUE))
         miImageText16(drawable, gc, x, y, count, chars);
 }
+
+/*
+ * Lay out glyphs from the GC font given only their CharInfo, finding
+ * them in the font texture. Returns the number of glyphs to draw, or
+ * -1 if any of them couldn't be found
+ */
+static int
+glamor_glyph_blt_layout(ScreenPtr screen, GCPtr gc, glamor_font_t *glamor_font,
+                        int x, int y, unsigned int nglyph, CharInfoPtr *ppci,
+                        glamor_text_glyph *glyphs)
+{
+    unsigned int c;
+    int n = 0;
+
+    for (c = 0; c < nglyph; c++) {
+        CharInfoPtr ci = ppci[c];
+        int row, col;
+
+        if (!glamor_font_find_char(gc->font, glamor_font, ci, &row, &col))
+            return -1;
+        if (!glamor_text_place(screen, gc->font, glamor_font, &glyphs[n],
+                               ci, x, y, row, col))
+            return -1;
+        if (GLYPHWIDTHPIXELS(ci) && GLYPHHEIGHTPIXELS(ci))
+            n++;
+        x += ci->metrics.characterWidth;
+    }
+    return n;
+}
+
+/*
+ * ImageGlyphBlt and PolyGlyphBlt with glyphs from the GC font, drawn
+ * like text from the font texture
+ */
+static Bool
+glamor_glyph_blt_text(DrawablePtr drawable, GCPtr gc,
+                      int x, int y, unsigned int nglyph,
+                      CharInfoPtr *ppci, Bool image)
+{
+    ScreenPtr screen = drawable->pScreen;
+    glamor_screen_private *glamor_priv = glamor_get_screen_private(screen);
+    PixmapPtr pixmap = glamor_get_drawable_pixmap(drawable);
+    glamor_pixmap_private *pixmap_priv;
+    glamor_font_t *glamor_font;
+    glamor_text_glyph glyphs_stack[255], *glyphs = glyphs_stack;
+    const glamor_facet *facet;
+    int n;
+    Bool ret = FALSE;
+
+    pixmap_priv = glamor_get_pixmap_private(pixmap);
+    if (!GLAMOR_PIXMAP_PRIV_HAS_FBO(pixmap_priv))
+        return FALSE;
+
+    if (!gc->font)
+        return FALSE;
+
+    glamor_font = glamor_font_get(screen, gc->font);
+    if (!glamor_font)
+        return FALSE;
+
+    if (nglyph > ARRAY_SIZE(glyphs_stack)) {
+        glyphs = xallocarray(nglyph, sizeof (glamor_text_glyph));
+        if (!glyphs)
+            return FALSE;
+    }
+
+    /* Leave any queued text alone until we know whether this joins it */
+    glamor_make_context_current(glamor_priv);
+
+    n = glamor_glyph_blt_layout(screen, gc, glamor_font, x, y, nglyph, ppci, glyphs);
+    if (n < 0)
+        goto bail;
+
+    if (image) {
+        ret = glamor_image_glyphs(drawable, gc, glamor_font, x, y,
+                                  nglyph, ppci, glyphs, n);
+    } else {
+        if (glamor_priv->glsl_version >= 130)
+            facet = &glamor_facet_poly_text;
+        else
+            facet = &glamor_facet_poly_text_120;
+
+        ret = (n == 0 ||
+               glamor_text_queue(drawable, gc, glamor_font,
+                                 &glamor_priv->poly_text_progs, facet, NULL,
+                                 gc->fillStyle == FillSolid, glyphs, n,
+                                 NULL, 0));
+    }
+
+bail:
+    if (glyphs != glyphs_stack)
+        free(glyphs);
+    return ret;
+}
+
+Bool
+glamor_poly_glyph_blt_text(DrawablePtr drawable, GCPtr gc,
+                           int x, int y, unsigned int nglyph,
+                           CharInfoPtr *ppci)
+{
+    return glamor_glyph_blt_text(drawable, gc, x, y, nglyph, ppci, FALSE);
+}
+
+void
+glamor_image_glyph_blt(DrawablePtr drawable, GCPtr gc,
+                       int x, int y, unsigned int nglyph,
+                       CharInfoPtr *ppci, void *pglyph_base)
+{
+    if (!glamor_glyph_blt_text(drawable, gc, x, y, nglyph, ppci, TRUE))
+        miImageGlyphBlt(drawable, gc, x, y, nglyph, ppci, pglyph_base);
+}
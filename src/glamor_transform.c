@@ -132,9 +132,6 @@ glamor_set_solid(PixmapPtr      pixmap,
     CARD32      pixel;
     int         alu = use_alu ? gc->alu : GXcopy;
 
-    if (!glamor_set_planemask(gc->depth, gc->planemask))
-        return FALSE;
-
     pixel = gc->fgPixel;
 
     if (!glamor_set_alu(pixmap->drawable.pScreen, alu)) {
@@ -152,6 +149,11 @@ glamor_set_solid(PixmapPtr      pixmap,
             return FALSE;
         }
     }
+
+    if (!glamor_set_planemask(pixmap->drawable.pScreen, gc->depth,
+                              gc->planemask))
+        return FALSE;
+
     glamor_set_color(pixmap, gc->fgPixel, uniform);
 
     return TRUE;
@@ -206,7 +208,8 @@ glamor_set_tiled(PixmapPtr      pixmap,
     if (!glamor_set_alu(pixmap->drawable.pScreen, gc->alu))
         return FALSE;
 
-    if (!glamor_set_planemask(gc->depth, gc->planemask))
+    if (!glamor_set_planemask(pixmap->drawable.pScreen, gc->depth,
+                              gc->planemask))
         return FALSE;
 
     return glamor_set_texture(gc->tile.pixmap,
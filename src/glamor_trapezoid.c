@@ -31,10 +31,314 @@
  */
 
 #include "glamor_priv.h"
+#include "glamor_program.h"
+#include "glamor_transform.h"
 
 #include "mipict.h"
 #include "fbpict.h"
 
+/*
+ * Each trapezoid is drawn as a quad covering its bounding box. Every
+ * vertex carries the trapezoid top/bottom and the x coordinates of the
+ * left and right edges at top and bottom, all relative to the mask
+ * origin, so the fragment shader can compute coverage analytically.
+ */
+#define GLAMOR_TRAP_VERTEX_FLOATS       8
+
+#define GLAMOR_TRAP_VS_VARS                             \
+    "attribute vec4 primitive;\n"                       \
+    "attribute vec4 edges;\n"                           \
+    "varying vec4 trap_pos;\n"                          \
+    "varying vec4 trap_edges;\n"
+
+#define GLAMOR_TRAP_VS_EXEC                             \
+    "       trap_pos = primitive;\n"                    \
+    "       trap_edges = edges;\n"                      \
+    GLAMOR_POS(gl_Position, primitive.xy)
+
+#define GLAMOR_TRAP_FS_VARS                             \
+    "#ifdef GL_ES\n"                                    \
+    "#ifdef GL_FRAGMENT_PRECISION_HIGH\n"               \
+    "precision highp float;\n"                          \
+    "#endif\n"                                          \
+    "#endif\n"                                          \
+    "varying vec4 trap_pos;\n"                          \
+    "varying vec4 trap_edges;\n"
+
+/* Match pixman's a8 sampling: 15 sample rows per pixel, with the
+ * horizontal coverage of each row computed exactly.
+ */
+static const glamor_facet glamor_facet_trapezoid_aa = {
+    .name = "trapezoid_aa",
+    .vs_vars = GLAMOR_TRAP_VS_VARS,
+    .vs_exec = GLAMOR_TRAP_VS_EXEC,
+    .fs_vars = GLAMOR_TRAP_FS_VARS,
+    .fs_exec = ("       vec2 pixel = floor(trap_pos.xy);\n"
+                "       float cov = 0.0;\n"
+                "       for (int i = 0; i < 15; i++) {\n"
+                "               float y = pixel.y + (float(i) + 0.5) / 15.0;\n"
+                "               if (y >= trap_pos.z && y < trap_pos.w) {\n"
+                "                       float t = (y - trap_pos.z) / (trap_pos.w - trap_pos.z);\n"
+                "                       float l = mix(trap_edges.x, trap_edges.y, t);\n"
+                "                       float r = mix(trap_edges.z, trap_edges.w, t);\n"
+                "                       cov += clamp(min(r, pixel.x + 1.0) - max(l, pixel.x), 0.0, 1.0);\n"
+                "               }\n"
+                "       }\n"
+                "       gl_FragColor = vec4(cov / 15.0);\n"),
+    .source_name = "edges",
+};
+
+/* PolyEdgeSharp, a1 style: a pixel is in when its centre is. */
+static const glamor_facet glamor_facet_trapezoid_sharp = {
+    .name = "trapezoid_sharp",
+    .vs_vars = GLAMOR_TRAP_VS_VARS,
+    .vs_exec = GLAMOR_TRAP_VS_EXEC,
+    .fs_vars = GLAMOR_TRAP_FS_VARS,
+    .fs_exec = ("       vec2 centre = floor(trap_pos.xy) + vec2(0.5);\n"
+                "       float t = (centre.y - trap_pos.z) / (trap_pos.w - trap_pos.z);\n"
+                "       float l = mix(trap_edges.x, trap_edges.y, t);\n"
+                "       float r = mix(trap_edges.z, trap_edges.w, t);\n"
+                "       if (centre.y < trap_pos.z || centre.y >= trap_pos.w ||\n"
+                "           centre.x < l || centre.x >= r)\n"
+                "               discard;\n"
+                "       gl_FragColor = vec4(1.0);\n"),
+    .source_name = "edges",
+};
+
+static inline double
+glamor_trap_edge_x(const xLineFixed *edge, double y)
+{
+    double x1 = pixman_fixed_to_double(edge->p1.x);
+    double y1 = pixman_fixed_to_double(edge->p1.y);
+    double x2 = pixman_fixed_to_double(edge->p2.x);
+    double y2 = pixman_fixed_to_double(edge->p2.y);
+
+    return x1 + (y - y1) * (x2 - x1) / (y2 - y1);
+}
+
+/**
+ * Creates a GPU resident pixmap for the trapezoid coverage. An A8
+ * texture is preferred; when the GL can't render to it, the coverage
+ * is replicated into an a8r8g8b8 pixmap instead.
+ */
+static PicturePtr
+glamor_create_trap_mask_picture(ScreenPtr screen, int width, int height)
+{
+    PictFormatPtr pict_format = NULL;
+    PixmapPtr pixmap;
+    PicturePtr picture;
+    int error;
+
+    pixmap = glamor_create_pixmap(screen, width, height, 8,
+                                  GLAMOR_CREATE_FBO_NO_FBO);
+    if (pixmap) {
+        if (GLAMOR_PIXMAP_PRIV_HAS_FBO(glamor_get_pixmap_private(pixmap)) &&
+            glamor_pixmap_ensure_fbo(pixmap, gl_iformat_for_pixmap(pixmap), 0)) {
+            pict_format = PictureMatchFormat(screen, 8, PICT_a8);
+        } else {
+            glamor_destroy_pixmap(pixmap);
+            pixmap = NULL;
+        }
+    }
+
+    if (!pixmap) {
+        pixmap = glamor_create_pixmap(screen, width, height, 32, 0);
+        if (!pixmap)
+            return NULL;
+        if (!GLAMOR_PIXMAP_PRIV_HAS_FBO(glamor_get_pixmap_private(pixmap))) {
+            glamor_destroy_pixmap(pixmap);
+            return NULL;
+        }
+        pict_format = PictureMatchFormat(screen, 32, PICT_a8r8g8b8);
+    }
+
+    if (!pict_format) {
+        glamor_destroy_pixmap(pixmap);
+        return NULL;
+    }
+
+    picture = CreatePicture(0, &pixmap->drawable, pict_format,
+                            0, 0, serverClient, &error);
+    glamor_destroy_pixmap(pixmap);
+    return picture;
+}
+
+/**
+ * Accumulates trapezoid coverage into pixmap with additive blending,
+ * like pixman_rasterize_trapezoid does. The trapezoids are translated
+ * by (x_off, y_off) first. Returns FALSE if the GL can't do it, in
+ * which case nothing has been drawn.
+ */
+Bool
+glamor_rasterize_trapezoids(PixmapPtr pixmap, Bool sharp,
+                            int x_off, int y_off,
+                            int ntrap, xTrapezoid *traps)
+{
+    ScreenPtr screen = pixmap->drawable.pScreen;
+    glamor_screen_private *glamor_priv = glamor_get_screen_private(screen);
+    glamor_pixmap_private *pixmap_priv = glamor_get_pixmap_private(pixmap);
+    int width = pixmap->drawable.width;
+    int height = pixmap->drawable.height;
+    glamor_program *prog;
+    const glamor_facet *facet;
+    GLfloat *v;
+    char *vbo_offset;
+    int off_x, off_y;
+    int n, nquad;
+
+    if (!GLAMOR_PIXMAP_PRIV_HAS_FBO(pixmap_priv) ||
+        !glamor_pixmap_priv_is_small(pixmap_priv) ||
+        !pixmap_priv->fbo->fb)
+        return FALSE;
+
+    if (sharp) {
+        prog = &glamor_priv->trapezoid_progs[1];
+        facet = &glamor_facet_trapezoid_sharp;
+    } else {
+        prog = &glamor_priv->trapezoid_progs[0];
+        facet = &glamor_facet_trapezoid_aa;
+    }
+
+    glamor_make_current(glamor_priv);
+
+    if (prog->failed)
+        return FALSE;
+
+    if (!prog->prog) {
+        if (!glamor_build_program(screen, prog, facet, NULL, NULL, NULL))
+            return FALSE;
+    }
+
+    if (!glamor_use_program(pixmap, NULL, prog, NULL))
+        return FALSE;
+
+    v = glamor_get_vbo_space(screen,
+                             ntrap * 4 * GLAMOR_TRAP_VERTEX_FLOATS *
+                             sizeof (GLfloat), &vbo_offset);
+
+    glEnableVertexAttribArray(GLAMOR_VERTEX_POS);
+    glVertexAttribPointer(GLAMOR_VERTEX_POS, 4, GL_FLOAT, GL_FALSE,
+                          GLAMOR_TRAP_VERTEX_FLOATS * sizeof (GLfloat),
+                          vbo_offset);
+    glEnableVertexAttribArray(GLAMOR_VERTEX_SOURCE);
+    glVertexAttribPointer(GLAMOR_VERTEX_SOURCE, 4, GL_FLOAT, GL_FALSE,
+                          GLAMOR_TRAP_VERTEX_FLOATS * sizeof (GLfloat),
+                          vbo_offset + 4 * sizeof (GLfloat));
+
+    nquad = 0;
+    for (n = 0; n < ntrap; n++) {
+        xTrapezoid *t = &traps[n];
+        double top, bottom;
+        GLfloat lt, lb, rt, rb;
+        GLfloat x1, x2, y1, y2;
+        int i;
+
+        if (t->left.p1.y == t->left.p2.y || t->right.p1.y == t->right.p2.y ||
+            t->top >= t->bottom)
+            continue;
+
+        top = pixman_fixed_to_double(t->top);
+        bottom = pixman_fixed_to_double(t->bottom);
+
+        lt = glamor_trap_edge_x(&t->left, top) + x_off;
+        lb = glamor_trap_edge_x(&t->left, bottom) + x_off;
+        rt = glamor_trap_edge_x(&t->right, top) + x_off;
+        rb = glamor_trap_edge_x(&t->right, bottom) + x_off;
+
+        x1 = MAX(floor(MIN(lt, lb)), 0);
+        x2 = MIN(ceil(MAX(rt, rb)), width);
+        y1 = MAX(floor(top + y_off), 0);
+        y2 = MIN(ceil(bottom + y_off), height);
+
+        if (x1 >= x2 || y1 >= y2)
+            continue;
+
+        for (i = 0; i < 4; i++) {
+            v[i * GLAMOR_TRAP_VERTEX_FLOATS + 2] = top + y_off;
+            v[i * GLAMOR_TRAP_VERTEX_FLOATS + 3] = bottom + y_off;
+            v[i * GLAMOR_TRAP_VERTEX_FLOATS + 4] = lt;
+            v[i * GLAMOR_TRAP_VERTEX_FLOATS + 5] = lb;
+            v[i * GLAMOR_TRAP_VERTEX_FLOATS + 6] = rt;
+            v[i * GLAMOR_TRAP_VERTEX_FLOATS + 7] = rb;
+        }
+        v[0 * GLAMOR_TRAP_VERTEX_FLOATS + 0] = x1;
+        v[0 * GLAMOR_TRAP_VERTEX_FLOATS + 1] = y1;
+        v[1 * GLAMOR_TRAP_VERTEX_FLOATS + 0] = x1;
+        v[1 * GLAMOR_TRAP_VERTEX_FLOATS + 1] = y2;
+        v[2 * GLAMOR_TRAP_VERTEX_FLOATS + 0] = x2;
+        v[2 * GLAMOR_TRAP_VERTEX_FLOATS + 1] = y2;
+        v[3 * GLAMOR_TRAP_VERTEX_FLOATS + 0] = x2;
+        v[3 * GLAMOR_TRAP_VERTEX_FLOATS + 1] = y1;
+
+        v += 4 * GLAMOR_TRAP_VERTEX_FLOATS;
+        nquad++;
+    }
+
+    glamor_put_vbo_space(screen);
+
+    if (nquad) {
+        glamor_set_destination_drawable(&pixmap->drawable, 0, FALSE, FALSE,
+                                        prog->matrix_uniform, &off_x, &off_y);
+        glamor_set_gxcopy(screen);
+
+        glEnable(GL_BLEND);
+        glBlendFunc(GL_ONE, GL_ONE);
+        glamor_glDrawArrays_GL_QUADS(glamor_priv, nquad);
+        glDisable(GL_BLEND);
+    }
+
+    glDisableVertexAttribArray(GLAMOR_VERTEX_SOURCE);
+    glDisableVertexAttribArray(GLAMOR_VERTEX_POS);
+
+    return TRUE;
+}
+
+/**
+ * Rasterizes the trapezoids into a freshly allocated GPU mask the size
+ * of bounds. Returns NULL when the GL path can't be used.
+ */
+static PicturePtr
+glamor_trapezoids_mask_gl(ScreenPtr screen,
+                          PicturePtr dst,
+                          PictFormatPtr mask_format,
+                          BoxPtr bounds,
+                          int ntrap, xTrapezoid *traps)
+{
+    glamor_screen_private *glamor_priv = glamor_get_screen_private(screen);
+    PixmapPtr dst_pixmap = glamor_get_drawable_pixmap(dst->pDrawable);
+    int width = bounds->x2 - bounds->x1;
+    int height = bounds->y2 - bounds->y1;
+    PicturePtr picture;
+    PixmapPtr pixmap;
+
+    if (!GLAMOR_PIXMAP_PRIV_HAS_FBO(glamor_get_pixmap_private(dst_pixmap)))
+        return NULL;
+
+    if (mask_format->format != PICT_a8 && mask_format->format != PICT_a1)
+        return NULL;
+
+    if (!glamor_check_fbo_size(glamor_priv, width, height))
+        return NULL;
+
+    picture = glamor_create_trap_mask_picture(screen, width, height);
+    if (!picture)
+        return NULL;
+
+    pixmap = glamor_get_drawable_pixmap(picture->pDrawable);
+
+    glamor_solid(pixmap, 0, 0, width, height, 0);
+
+    if (!glamor_rasterize_trapezoids(pixmap,
+                                     mask_format->format == PICT_a1,
+                                     -bounds->x1, -bounds->y1,
+                                     ntrap, traps)) {
+        FreePicture(picture, 0);
+        return NULL;
+    }
+
+    return picture;
+}
+
 /**
  * Creates an appropriate picture for temp mask use.
  */
@@ -70,75 +374,64 @@ glamor_create_mask_picture(ScreenPtr screen,
 }
 
 /**
- * glamor_trapezoids will generate trapezoid mask accumulating in
- * system memory.
+ * Accumulates the trapezoids into a single temporary mask and composites
+ * src through it. The mask is generated on the GPU when possible,
+ * otherwise in system memory with pixman.
  */
 void
-glamor_trapezoids(CARD8 op,
-                  PicturePtr src, PicturePtr dst,
-                  PictFormatPtr mask_format, INT16 x_src, INT16 y_src,
-                  int ntrap, xTrapezoid *traps)
+glamor_composite_trapezoids(CARD8 op,
+                            PicturePtr src, PicturePtr dst,
+                            PictFormatPtr mask_format,
+                            INT16 x_src, INT16 y_src,
+                            INT16 x_dst, INT16 y_dst,
+                            int ntrap, xTrapezoid *traps)
 {
     ScreenPtr screen = dst->pDrawable->pScreen;
     BoxRec bounds;
     PicturePtr picture;
-    INT16 x_dst, y_dst;
     INT16 x_rel, y_rel;
     int width, height, stride;
     PixmapPtr pixmap;
     pixman_image_t *image = NULL;
 
-    /* If a mask format wasn't provided, we get to choose, but behavior should
-     * be as if there was no temporary mask the traps were accumulated into.
-     */
-    if (!mask_format) {
-        if (dst->polyEdge == PolyEdgeSharp)
-            mask_format = PictureMatchFormat(screen, 1, PICT_a1);
-        else
-            mask_format = PictureMatchFormat(screen, 8, PICT_a8);
-        for (; ntrap; ntrap--, traps++)
-            glamor_trapezoids(op, src, dst, mask_format, x_src,
-                              y_src, 1, traps);
-        return;
-    }
-
     miTrapezoidBounds(ntrap, traps, &bounds);
 
     if (bounds.y1 >= bounds.y2 || bounds.x1 >= bounds.x2)
         return;
 
-    x_dst = traps[0].left.p1.x >> 16;
-    y_dst = traps[0].left.p1.y >> 16;
-
     width = bounds.x2 - bounds.x1;
     height = bounds.y2 - bounds.y1;
     stride = PixmapBytePad(width, mask_format->depth);
 
-    picture = glamor_create_mask_picture(screen, dst, mask_format,
-                                         width, height);
-    if (!picture)
-        return;
+    picture = glamor_trapezoids_mask_gl(screen, dst, mask_format, &bounds,
+                                        ntrap, traps);
+    if (!picture) {
+        picture = glamor_create_mask_picture(screen, dst, mask_format,
+                                             width, height);
+        if (!picture)
+            return;
 
-    image = pixman_image_create_bits(picture->format,
-                                     width, height, NULL, stride);
-    if (!image) {
-        FreePicture(picture, 0);
-        return;
-    }
+        image = pixman_image_create_bits(picture->format,
+                                         width, height, NULL, stride);
+        if (!image) {
+            FreePicture(picture, 0);
+            return;
+        }
 
-    for (; ntrap; ntrap--, traps++)
-        pixman_rasterize_trapezoid(image,
-                                   (pixman_trapezoid_t *) traps,
-                                   -bounds.x1, -bounds.y1);
+        for (; ntrap; ntrap--, traps++)
+            pixman_rasterize_trapezoid(image,
+                                       (pixman_trapezoid_t *) traps,
+                                       -bounds.x1, -bounds.y1);
 
-    pixmap = glamor_get_drawable_pixmap(picture->pDrawable);
+        pixmap = glamor_get_drawable_pixmap(picture->pDrawable);
 
-    screen->ModifyPixmapHeader(pixmap, width, height,
-                               mask_format->depth,
-                               BitsPerPixel(mask_format->depth),
-                               PixmapBytePad(width,
-                                             mask_format->depth),
-                               pixman_image_get_data(image));
+        screen->ModifyPixmapHeader(pixmap, width, height,
+                                   mask_format->depth,
+                                   BitsPerPixel(mask_format->depth),
+                                   PixmapBytePad(width,
+                                                 mask_format->depth),
+                                   pixman_image_get_data(image));
+    }
 
     x_rel = bounds.x1 + x_src - x_dst;
     y_rel = bounds.y1 + y_src - y_dst;
@@ -154,3 +447,35 @@ glamor_trapezoids(CARD8 op,
 
     FreePicture(picture, 0);
 }
+
+/**
+ * glamor_trapezoids will generate trapezoid mask accumulating on the
+ * GPU, or in system memory when that isn't possible.
+ */
+void
+glamor_trapezoids(CARD8 op,
+                  PicturePtr src, PicturePtr dst,
+                  PictFormatPtr mask_format, INT16 x_src, INT16 y_src,
+                  int ntrap, xTrapezoid *traps)
+{
+    ScreenPtr screen = dst->pDrawable->pScreen;
+
+    /* If a mask format wasn't provided, we get to choose, but behavior should
+     * be as if there was no temporary mask the traps were accumulated into.
+     */
+    if (!mask_format) {
+        if (dst->polyEdge == PolyEdgeSharp)
+            mask_format = PictureMatchFormat(screen, 1, PICT_a1);
+        else
+            mask_format = PictureMatchFormat(screen, 8, PICT_a8);
+        for (; ntrap; ntrap--, traps++)
+            glamor_trapezoids(op, src, dst, mask_format, x_src,
+                              y_src, 1, traps);
+        return;
+    }
+
+    glamor_composite_trapezoids(op, src, dst, mask_format, x_src, y_src,
+                                traps[0].left.p1.x >> 16,
+                                traps[0].left.p1.y >> 16,
+                                ntrap, traps);
+}
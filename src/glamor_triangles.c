@@ -28,6 +28,69 @@
 
 #include "glamor_priv.h"
 
+#include "mipict.h"
+
+static inline Bool
+glamor_point_greater_y(xPointFixed *a, xPointFixed *b)
+{
+    if (a->y == b->y)
+        return a->x > b->x;
+    return a->y > b->y;
+}
+
+static inline Bool
+glamor_point_clockwise(xPointFixed *ref, xPointFixed *a, xPointFixed *b)
+{
+    int64_t adx = a->x - ref->x, ady = a->y - ref->y;
+    int64_t bdx = b->x - ref->x, bdy = b->y - ref->y;
+
+    return bdy * adx - ady * bdx < 0;
+}
+
+/**
+ * Splits a triangle into two trapezoids the same way pixman does, so
+ * the coverage matches fbTriangles exactly. One of them may be empty.
+ */
+static void
+glamor_triangle_to_trapezoids(xTriangle *tri, xTrapezoid *traps)
+{
+    xPointFixed *top = &tri->p1, *left = &tri->p2, *right = &tri->p3, *tmp;
+
+    if (glamor_point_greater_y(top, left)) {
+        tmp = left; left = top; top = tmp;
+    }
+    if (glamor_point_greater_y(top, right)) {
+        tmp = right; right = top; top = tmp;
+    }
+    if (glamor_point_clockwise(top, right, left)) {
+        tmp = right; right = left; left = tmp;
+    }
+
+    traps[0].top = top->y;
+    traps[0].bottom = MIN(left->y, right->y);
+    traps[0].left.p1 = *top;
+    traps[0].left.p2 = *left;
+    traps[0].right.p1 = *top;
+    traps[0].right.p2 = *right;
+
+    traps[1] = traps[0];
+    if (right->y < left->y) {
+        traps[1].top = right->y;
+        traps[1].bottom = left->y;
+        traps[1].right.p1 = *right;
+        traps[1].right.p2 = *left;
+    } else {
+        traps[1].top = left->y;
+        traps[1].bottom = right->y;
+        traps[1].left.p1 = *left;
+        traps[1].left.p2 = *right;
+    }
+}
+
+/**
+ * Triangles are rendered by splitting them into trapezoids and running
+ * those through the trapezoid mask path, which rasterizes on the GPU.
+ */
 void
 glamor_triangles(CARD8 op,
                  PicturePtr pSrc,
@@ -35,6 +98,55 @@ glamor_triangles(CARD8 op,
                  PictFormatPtr maskFormat,
                  INT16 xSrc, INT16 ySrc, int ntris, xTriangle * tris)
 {
+    ScreenPtr screen = pDst->pDrawable->pScreen;
+    xTrapezoid stack_traps[64], *traps = stack_traps;
+    INT16 x_dst, y_dst;
+    int n;
+
+    if (ntris <= 0)
+        return;
+
+    x_dst = tris[0].p1.x >> 16;
+    y_dst = tris[0].p1.y >> 16;
+
+    /* Without a mask format each triangle is composited on its own,
+     * through a mask matching the picture's edge mode.
+     */
+    if (!maskFormat) {
+        if (pDst->polyEdge == PolyEdgeSharp)
+            maskFormat = PictureMatchFormat(screen, 1, PICT_a1);
+        else
+            maskFormat = PictureMatchFormat(screen, 8, PICT_a8);
+        if (!maskFormat)
+            return;
+
+        for (n = 0; n < ntris; n++) {
+            glamor_triangle_to_trapezoids(&tris[n], stack_traps);
+            glamor_composite_trapezoids(op, pSrc, pDst, maskFormat,
+                                        xSrc, ySrc, x_dst, y_dst,
+                                        2, stack_traps);
+        }
+        return;
+    }
+
+    if (ntris * 2 > ARRAY_SIZE(stack_traps)) {
+        traps = xallocarray(ntris, 2 * sizeof(xTrapezoid));
+        if (!traps)
+            goto fallback;
+    }
+
+    for (n = 0; n < ntris; n++)
+        glamor_triangle_to_trapezoids(&tris[n], &traps[n * 2]);
+
+    glamor_composite_trapezoids(op, pSrc, pDst, maskFormat,
+                                xSrc, ySrc, x_dst, y_dst,
+                                ntris * 2, traps);
+
+    if (traps != stack_traps)
+        free(traps);
+    return;
+
+fallback:
     if (glamor_prepare_access_picture(pDst, GLAMOR_ACCESS_RW) &&
         glamor_prepare_access_picture(pSrc, GLAMOR_ACCESS_RO)) {
         fbTriangles(op, pSrc, pDst, maskFormat, xSrc, ySrc, ntris, tris);
@@ -25,6 +25,13 @@
 void
 glamor_solid_boxes(PixmapPtr pixmap,
                    BoxPtr box, int nbox, unsigned long fg_pixel)
+{
+    glamor_solid_boxes_planemask(pixmap, box, nbox, fg_pixel, ~0UL);
+}
+
+void
+glamor_solid_boxes_planemask(PixmapPtr pixmap, BoxPtr box, int nbox,
+                             unsigned long fg_pixel, unsigned long planemask)
 {
     DrawablePtr drawable = &pixmap->drawable;
     GCPtr gc;
@@ -43,10 +50,11 @@ glamor_solid_boxes(PixmapPtr pixmap,
 
     gc = GetScratchGC(drawable->depth, drawable->pScreen);
     if (gc) {
-        ChangeGCVal vals[1];
+        ChangeGCVal vals[2];
 
-        vals[0].val = fg_pixel;
-        ChangeGC(NullClient, gc, GCForeground, vals);
+        vals[0].val = planemask;
+        vals[1].val = fg_pixel;
+        ChangeGC(NullClient, gc, GCPlaneMask | GCForeground, vals);
         ValidateGC(drawable, gc);
         gc->ops->PolyFillRect(drawable, gc, nbox, rect);
         FreeScratchGC(gc);
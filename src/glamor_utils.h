@@ -513,6 +513,18 @@
 	(vertices)[5] = (vertices)[7];					\
     } while(0)
 
+#define glamor_set_tcoords_ext(x1, y1, x2, y2, vertices, stride)       \
+    do {								\
+	(vertices)[0] = (x1);						\
+	(vertices)[1 * stride] = (x2);					\
+	(vertices)[2 * stride] = (x2);					\
+	(vertices)[3 * stride] = (x1);					\
+	(vertices)[1] = (y1);						\
+	(vertices)[1 * stride + 1] = (y1);				\
+	(vertices)[2 * stride + 1] = (y2);				\
+	(vertices)[3 * stride + 1] = (y2);				\
+    } while(0)
+
 #define glamor_set_normalize_vcoords_ext(priv, xscale, yscale,		\
 				     x1, y1, x2, y2,			\
                                          vertices, stride)              \
@@ -720,7 +732,7 @@ glamor_is_large_pixmap(PixmapPtr pixmap)
 }
 
 static inline void
-glamor_make_current(glamor_screen_private *glamor_priv)
+glamor_make_context_current(glamor_screen_private *glamor_priv)
 {
     if (lastGLContext != &glamor_priv->ctx) {
         lastGLContext = &glamor_priv->ctx;
@@ -728,6 +740,17 @@ glamor_make_current(glamor_screen_private *glamor_priv)
     }
 }
 
+/* Everything else that uses GL comes through here, so queued text
+ * gets drawn before anything can depend on it
+ */
+static inline void
+glamor_make_current(glamor_screen_private *glamor_priv)
+{
+    glamor_make_context_current(glamor_priv);
+    if (_X_UNLIKELY(glamor_priv->text_pending))
+        glamor_text_flush(glamor_priv);
+}
+
 /**
  * Helper function for implementing draws with GL_QUADS on GLES2,
  * where we don't have them.